@@ -17,6 +17,7 @@ const char *progname = "bestguess";
 #include "optable.h"
 #include "reports.h"
 #include "cli.h"
+#include "launch.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -27,15 +28,57 @@ OptionValues option = {
   .graph = false,
   .runs = 1,
   .warmups = 0,
+  .jobs = 1,
+  .adaptive = false,
+  .race = false,
+  .order = orderSequential,
+  .seed = -1,
+  .timeout = -1,
+  .cpu_limit = -1,
+  .mem_limit = -1,
+  .files_limit = -1,
+  .calibrate = false,
+  .fork_server = false,
+  .repeat = 1,
+  .cpu_state = false,
+  .cpus = NULL,
+  .harness_cpu = -1,
+  .no_smt = false,
+  .nice = NICE_INHERIT,
+  .sched_policy = -1,
+  .quiet = -1,
+  .interference = -1,
+  .max_reruns = DEFAULT_MAX_RERUNS,
+  .include_interfered = false,
+  .cache = -1,
+  .n_cache_files = 0,
+  .rate = 0,
+  .arrivals = arrivalsConstant,
+  .max_inflight = DEFAULT_MAX_INFLIGHT,
+  .sweep = -1,
+  .cgroup = false,
+  .cpu_quota = 0,
+  .memory_high = -1,
+  .memory_max = -1,
+  .io_max = NULL,
+  .wait_descendants = false,
+  .min_runs = -1,		// 10, or max_runs if lower
+  .max_runs = 1000,
+  .target_ci = 0.01,
+  .target_metric = -1,		// F_TOTAL unless set
   .first = 0,
   .show_output = false,
+  .capture_output = false,
   .ignore_failure = false,
   .input_filename = NULL,
   .output_filename = NULL,
+  .metadata = false,
   .csv_filename = NULL,
   .hf_filename = NULL,
   .prep_command = NULL,
   .shell = "",
+  .launcher = DEFAULT_LAUNCHER,
+  .launcher_report = false,
   .n_commands = 0,
   .commands = {NULL},
   .names = {NULL},
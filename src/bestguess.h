@@ -58,20 +58,87 @@ typedef enum Action {
   actionReport,		   // Report on already-collected raw data
 } Action;
 
+// With --repeat auto, we choose how many times to execute the command
+// in each run (up to MAXREPEAT)
+#define REPEAT_AUTO 0
+#define MAXREPEAT 10000
+
+// Runs spoiled by other processes (see --interference) are done
+// again, up to this many times per command by default
+#define DEFAULT_MAX_RERUNS 10
+
+// With --rate, at most this many runs are in flight at once by
+// default.  The limit can be raised as far as MAXINFLIGHT.
+#define DEFAULT_MAX_INFLIGHT 64
+#define MAXINFLIGHT 1024
+
+// With --sweep auto, the concurrency goes up to the number of cores
+// that runs may use
+#define SWEEP_AUTO 0
+
+// Input files named with --cache-file
+#define MAXCACHEARGS 64
+
+// Outside the range of nice values, so runs keep our own
+#define NICE_INHERIT 100
+
 typedef struct OptionValues {
   int    action;
   int    helpversion;
   int    runs;
   int    warmups;
+  int    jobs;
+  bool   adaptive;		// Run until the median converges
+  bool   race;			// Drop commands that are clearly slower
+  int    order;			// RunOrder
+  int64_t seed;			// For random order, or -1 for any
+  int64_t timeout;		// Per run, in ns, or -1 for none
+  int64_t cpu_limit;		// Seconds, or -1 for none
+  int64_t mem_limit;		// Address space in bytes, or -1 for none
+  int64_t files_limit;		// Open files, or -1 for none
+  bool   calibrate;		// Measure harness overhead first
+  bool   fork_server;		// Fork runs from a preloaded copy
+  int    repeat;		// Executions per run, or REPEAT_AUTO
+  bool   cpu_state;		// Sample CPU frequency and temperature
+  const char *cpus;		// CPU list that runs are pinned to, or NULL
+  int    harness_cpu;		// CPU that we are pinned to, or -1
+  bool   no_smt;		// Avoid SMT siblings of busy cores
+  int    nice;			// For runs, or NICE_INHERIT
+  int    sched_policy;		// For runs, or -1 to inherit ours
+  int    quiet;			// Busy % to wait out before runs, or -1
+  int    interference;		// Busy % that taints a run, or -1
+  int    max_reruns;		// Per command, of tainted runs
+  bool   include_interfered;	// Keep tainted runs in the statistics
+  int    cache;			// CacheMode, or -1 to leave the cache alone
+  int    n_cache_files;
+  const char *cache_files[MAXCACHEARGS];  // Input files to evict or preload
+  double rate;			// Runs started per second, or 0 (closed loop)
+  int    arrivals;		// Arrivals, with --rate
+  int    max_inflight;		// Runs in flight at once, with --rate
+  int    sweep;			// Highest concurrency, SWEEP_AUTO, or -1
+  bool   cgroup;		// Each run in a cgroup leaf of its own
+  double cpu_quota;		// CPUs (cpu.max), or 0 for no limit
+  int64_t memory_high;		// Bytes (memory.high), or -1 for none
+  int64_t memory_max;		// Bytes (memory.max), or -1 for none
+  const char *io_max;		// A line for io.max, or NULL
+  bool   wait_descendants;	// Reap what each run leaves behind
+  int    min_runs;
+  int    max_runs;
+  double target_ci;		// Relative CI half-width, e.g. 0.01
+  int    target_metric;		// FieldCode
   int    first;
   bool   show_output;
+  bool   capture_output;	// Drain stdout and stderr through a pipe
   bool   ignore_failure;
   int    n_commands;
   const char *commands[MAXCMDS];
   const char *names[MAXCMDS];
   const char  *shell;
+  int    launcher;
+  bool   launcher_report;
   char  *input_filename;
   char  *output_filename;
+  bool   metadata;		// Write "# key=value" lines before the header
   char  *csv_filename;
   char  *hf_filename;
   char  *prep_command;
@@ -0,0 +1,349 @@
+//  -*- Mode: C; -*-
+//
+//  cgroup.c  Accounting for whole process trees with cgroup v2
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "cgroup.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long to wait for killed leftovers to leave a leaf
+#define EMPTY_WAIT_NS (1000LL * 1000 * 1000)
+
+#define MAXCGROUPFILE (64 * 1024)
+
+static char *base;		// The cgroup we started in
+static char *harness;		// Our own leaf, under 'base'
+static char enabled[64];	// Controllers we enabled in 'base'
+static char available[64];	// Controllers enabled for the leaves
+static int leaves;		// For naming them
+static CgroupLimits limits = {-1, -1, -1, -1, NULL};
+
+static char message[MAXCMDLEN];
+
+// -----------------------------------------------------------------------------
+// Reading and writing cgroup files
+// -----------------------------------------------------------------------------
+
+static char *read_file(const char *dir, const char *file) {
+  char *path;
+  ASPRINTF(&path, "%s/%s", dir, file);
+  FILE *f = fopen(path, "r");
+  free(path);
+  if (!f) return NULL;
+  char *text = malloc(MAXCGROUPFILE);
+  if (!text) PANIC_OOM();
+  size_t n = fread(text, 1, MAXCGROUPFILE - 1, f);
+  text[n] = '\0';
+  fclose(f);
+  return text;
+}
+
+static bool write_file(const char *dir, const char *file, const char *text) {
+  char *path;
+  ASPRINTF(&path, "%s/%s", dir, file);
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  free(path);
+  if (fd < 0) return false;
+  ssize_t n = write(fd, text, strlen(text));
+  int err = errno;
+  close(fd);
+  errno = err;
+  return (n == (ssize_t) strlen(text));
+}
+
+// True if 'word' is one of the space-separated words in 'list'
+static bool has_word(const char *list, const char *word) {
+  size_t len = strlen(word);
+  for (const char *p = list; p && (p = strstr(p, word)); p += len)
+    if (((p == list) || (p[-1] == ' '))
+	&& ((p[len] == ' ') || (p[len] == '\n') || (p[len] == '\0')))
+      return true;
+  return false;
+}
+
+// Sum of the numbers that follow 'key' (e.g. "rbytes=") wherever it
+// starts a word in 'text', or -1 if 'text' is NULL
+static int64_t sum_of_key(const char *text, const char *key) {
+  if (!text) return -1;
+  int64_t sum = 0;
+  size_t len = strlen(key);
+  for (const char *p = text; (p = strstr(p, key)); p += len)
+    if ((p == text) || (p[-1] == ' ') || (p[-1] == '\n'))
+      sum += strtoll(p + len, NULL, 10);
+  return sum;
+}
+
+static int64_t read_key(const char *dir, const char *file, const char *key) {
+  char *text = read_file(dir, file);
+  int64_t value = sum_of_key(text, key);
+  free(text);
+  return value;
+}
+
+// The first line of a pressure file is for "some" tasks stalled
+static int64_t read_pressure(const char *dir, const char *file) {
+  char *text = read_file(dir, file);
+  if (!text) return -1;
+  char *newline = strchr(text, '\n');
+  if (newline) *newline = '\0';
+  int64_t value = (strncmp(text, "some ", 5) == 0) ? sum_of_key(text, "total=") : -1;
+  free(text);
+  return value;
+}
+
+static int count_lines(const char *text) {
+  int n = 0;
+  for (const char *p = text; p && *p; p++)
+    n += (*p == '\n');
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+// Setting up
+// -----------------------------------------------------------------------------
+
+// The cgroup v2 hierarchy is the mount of type "cgroup2" (in
+// /proc/self/mountinfo, the type follows a lone "-").  On systems that
+// also mount v1 hierarchies, it is often /sys/fs/cgroup/unified.
+static char *mount_point(void) {
+  FILE *f = fopen("/proc/self/mountinfo", "r");
+  if (!f) return NULL;
+  char line[4096], dir[4096];
+  char *found = NULL;
+  while (!found && fgets(line, sizeof(line), f)) {
+    char *sep = strstr(line, " - ");
+    if (sep && (strncmp(sep + 3, "cgroup2 ", 8) == 0)
+	&& (sscanf(line, "%*s %*s %*s %*s %4095s", dir) == 1))
+      found = strdup(dir);
+  }
+  fclose(f);
+  return found;
+}
+
+// In /proc/self/cgroup, the v2 cgroup is on the line for hierarchy 0
+static char *own_cgroup(void) {
+  FILE *f = fopen("/proc/self/cgroup", "r");
+  if (!f) return NULL;
+  char line[4096];
+  char *found = NULL;
+  while (!found && fgets(line, sizeof(line), f))
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      found = strdup(line + 3);
+    }
+  fclose(f);
+  return found;
+}
+
+const char *cgroup_init(void) {
+  if (base) return NULL;
+  char *mnt = mount_point();
+  char *own = own_cgroup();
+  if (!mnt || !own) {
+    free(mnt);
+    free(own);
+    return "No cgroup v2 hierarchy is available";
+  }
+  ASPRINTF(&base, "%s%s", mnt, (strcmp(own, "/") == 0) ? "" : own);
+  free(mnt);
+  free(own);
+
+  ASPRINTF(&harness, "%s/bestguess-%d", base, (int) getpid());
+  char pid[24];
+  snprintf(pid, sizeof(pid), "%d", (int) getpid());
+  if ((mkdir(harness, 0755) && (errno != EEXIST))
+      || !write_file(harness, "cgroup.procs", pid)) {
+    snprintf(message, sizeof(message),
+	     "Cannot create a cgroup in %s (%s).  Try running under"
+	     " 'systemd-run --user --scope -p Delegate=yes'",
+	     base, strerror(errno));
+    rmdir(harness);
+    free(harness);
+    free(base);
+    harness = base = NULL;
+    return message;
+  }
+
+  // Controllers are enabled one at a time, so that one that is not
+  // delegated to us does not stop the others
+  const char *wanted[] = {"cpu", "memory", "io"};
+  char *have = read_file(base, "cgroup.controllers");
+  char *on = read_file(base, "cgroup.subtree_control");
+  for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+    char change[16];
+    snprintf(change, sizeof(change), "+%s", wanted[i]);
+    bool already = has_word(on, wanted[i]);
+    if (already
+	|| (has_word(have, wanted[i]) && write_file(base, "cgroup.subtree_control", change))) {
+      if (!already) {
+	strcat(enabled, *enabled ? " " : "");
+	strcat(enabled, wanted[i]);
+      }
+      strcat(available, *available ? " " : "");
+      strcat(available, wanted[i]);
+    }
+  }
+  free(have);
+  free(on);
+  atexit(cgroup_cleanup);
+  return NULL;
+}
+
+const char *cgroup_controllers(void) {
+  return available;
+}
+
+// To remove our leaf, we must move back to where we started, which
+// is allowed once the controllers we enabled there are disabled.
+void cgroup_cleanup(void) {
+  if (!base) return;
+  char *words = strdup(enabled);
+  if (!words) PANIC_OOM();
+  for (char *w = strtok(words, " "); w; w = strtok(NULL, " ")) {
+    char change[16];
+    snprintf(change, sizeof(change), "-%s", w);
+    write_file(base, "cgroup.subtree_control", change);
+  }
+  free(words);
+  char pid[24];
+  snprintf(pid, sizeof(pid), "%d", (int) getpid());
+  if (write_file(base, "cgroup.procs", pid)) rmdir(harness);
+  free(harness);
+  free(base);
+  harness = base = NULL;
+  *enabled = *available = '\0';
+}
+
+const char *cgroup_set_limits(const CgroupLimits *new_limits) {
+  if (!new_limits) PANIC_NULL();
+  if (!base) PANIC("Cgroups are not set up (see cgroup_init)");
+  const char *missing = NULL;
+  if ((new_limits->cpu_quota_us > 0) && !has_word(available, "cpu"))
+    missing = "cpu";
+  else if (((new_limits->memory_high > 0) || (new_limits->memory_max > 0))
+	   && !has_word(available, "memory"))
+    missing = "memory";
+  else if (new_limits->io_max && !has_word(available, "io"))
+    missing = "io";
+  if (missing) {
+    snprintf(message, sizeof(message),
+	     "Cannot limit runs because the %s controller is not available"
+	     " in %s (only: %s)", missing, base, *available ? available : "none");
+    return message;
+  }
+  limits = *new_limits;
+  return NULL;
+}
+
+static bool write_limits(const char *dir) {
+  char text[64];
+  if (limits.cpu_quota_us > 0) {
+    snprintf(text, sizeof(text), INT64FMT " " INT64FMT,
+	     limits.cpu_quota_us, limits.cpu_period_us);
+    if (!write_file(dir, "cpu.max", text)) return false;
+  }
+  if (limits.memory_high > 0) {
+    snprintf(text, sizeof(text), INT64FMT, limits.memory_high);
+    if (!write_file(dir, "memory.high", text)) return false;
+  }
+  if (limits.memory_max > 0) {
+    snprintf(text, sizeof(text), INT64FMT, limits.memory_max);
+    if (!write_file(dir, "memory.max", text)) return false;
+  }
+  if (limits.io_max && !write_file(dir, "io.max", limits.io_max))
+    return false;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// A leaf for each run
+// -----------------------------------------------------------------------------
+
+bool cgroup_run_create(CgroupRun *run) {
+  if (!run) PANIC_NULL();
+  if (!base) PANIC("Cgroups are not set up (see cgroup_init)");
+  int n = __atomic_fetch_add(&leaves, 1, __ATOMIC_RELAXED);
+  ASPRINTF(&run->path, "%s/bestguess-%d-%d", base, (int) getpid(), n);
+  run->dir = -1;
+  run->procs = -1;
+  run->join_ns = 0;
+  if (mkdir(run->path, 0755) == 0) {
+    if (write_limits(run->path)) {
+      char *procs;
+      ASPRINTF(&procs, "%s/cgroup.procs", run->path);
+      run->procs = open(procs, O_WRONLY | O_CLOEXEC);
+      free(procs);
+      run->dir = open(run->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if ((run->procs >= 0) && (run->dir >= 0)) return true;
+    }
+    int err = errno;
+    if (run->procs >= 0) close(run->procs);
+    if (run->dir >= 0) close(run->dir);
+    run->procs = run->dir = -1;
+    rmdir(run->path);
+    errno = err;
+  }
+  free(run->path);
+  run->path = NULL;
+  return false;
+}
+
+void cgroup_run_read(const CgroupRun *run, CgroupStats *stats) {
+  if (!run || !run->path || !stats) PANIC_NULL();
+  stats->cpu_us = read_key(run->path, "cpu.stat", "usage_usec ");
+  char *peak = read_file(run->path, "memory.peak");
+  stats->mem_peak = peak ? strtoll(peak, NULL, 10) : -1;
+  free(peak);
+  stats->read_bytes = read_key(run->path, "io.stat", "rbytes=");
+  stats->write_bytes = read_key(run->path, "io.stat", "wbytes=");
+  stats->cpu_pressure_us = read_pressure(run->path, "cpu.pressure");
+  stats->mem_pressure_us = read_pressure(run->path, "memory.pressure");
+  stats->io_pressure_us = read_pressure(run->path, "io.pressure");
+  // Without the cpu controller, cpu.stat has no throttling counts
+  bool cpu = has_word(available, "cpu");
+  stats->nr_throttled = cpu ? read_key(run->path, "cpu.stat", "nr_throttled ") : -1;
+  stats->throttled_us = cpu ? read_key(run->path, "cpu.stat", "throttled_usec ") : -1;
+  stats->mem_high_events = read_key(run->path, "memory.events", "high ");
+  stats->mem_max_events = read_key(run->path, "memory.events", "max ");
+  stats->oom_kills = read_key(run->path, "memory.events", "oom_kill ");
+}
+
+// Writing to cgroup.kill (Linux 5.14) kills every process in the leaf.
+// Before that, we kill the ones we find, which misses any that are
+// forked meanwhile, so we keep at it until the leaf is empty.
+int cgroup_run_remove(CgroupRun *run) {
+  if (!run || !run->path) PANIC_NULL();
+  if (run->procs >= 0) close(run->procs);
+  if (run->dir >= 0) close(run->dir);
+  char *procs = read_file(run->path, "cgroup.procs");
+  int leftovers = count_lines(procs);
+  int64_t start = monotonic_ns();
+  while (procs && *procs && (monotonic_ns() - start < EMPTY_WAIT_NS)) {
+    if (!write_file(run->path, "cgroup.kill", "1")) {
+      char *save;
+      for (char *p = strtok_r(procs, "\n", &save); p; p = strtok_r(NULL, "\n", &save))
+	kill((pid_t) strtol(p, NULL, 10), SIGKILL);
+    }
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000};
+    nanosleep(&pause, NULL);
+    free(procs);
+    procs = read_file(run->path, "cgroup.procs");
+  }
+  free(procs);
+  rmdir(run->path);
+  free(run->path);
+  run->path = NULL;
+  run->dir = -1;
+  run->procs = -1;
+  return leftovers;
+}
@@ -0,0 +1,99 @@
+//  -*- Mode: C; -*-
+//
+//  cgroup.h  Accounting for whole process trees with cgroup v2
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef cgroup_h
+#define cgroup_h
+
+#include "bestguess.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// The resource usage that wait4() reports covers the child and the
+// descendants it waited for, and its max RSS is that of the largest
+// single process.  A command that starts background processes, or
+// many short-lived ones, escapes that accounting.  With --cgroup, each
+// run gets a fresh cgroup of its own (a leaf), which the child starts
+// in (or joins before exec), so that the kernel accounts for every
+// process the run starts.  When the run is done, we read the leaf's totals and remove
+// it, killing anything still running in it.
+//
+// No privileges are needed, only a delegated cgroup v2 subtree, such
+// as the one systemd creates with:
+//
+//   systemd-run --user --scope -p Delegate=yes bestguess ...
+//
+// We move ourselves into a leaf of our own, so that the cgroup we
+// started in has no processes, and enable the memory and io
+// controllers for its children.  If another process shares that
+// cgroup, the controllers cannot be enabled, and only the CPU time
+// and pressure (which need no controller) are available.
+
+// Returns NULL, or an explanation of why cgroups cannot be used.  On
+// success, cgroup_cleanup() is registered with atexit().
+const char *cgroup_init(void);
+void        cgroup_cleanup(void);
+
+// Names of the controllers enabled for the leaves, e.g. "cpu memory
+// io", which may be empty
+const char *cgroup_controllers(void);
+
+// Limits written to each leaf when it is made.  The CPU quota is
+// cpu.max, a quota of time per period (e.g. 50000 of 100000 us for
+// half a CPU).  Above memory.high, the kernel reclaims and throttles;
+// at memory.max, it runs the OOM killer.  io.max takes a line such
+// as "8:0 rbps=1048576 wiops=100", for one device.
+#define CGROUP_CPU_PERIOD_US 100000	// The kernel's default
+
+typedef struct CgroupLimits {
+  int64_t     cpu_quota_us;	// Or -1 for none
+  int64_t     cpu_period_us;
+  int64_t     memory_high;	// Bytes, or -1 for none
+  int64_t     memory_max;	// Bytes, or -1 for none
+  const char *io_max;		// Or NULL
+} CgroupLimits;
+
+// Returns NULL, or an explanation of why the limits cannot be set
+// (the controller they need is not available).  Call after
+// cgroup_init().
+const char *cgroup_set_limits(const CgroupLimits *limits);
+
+typedef struct CgroupRun {
+  char   *path;
+  int     dir;			// Open on the leaf, for launch_into()
+  int     procs;		// Open on cgroup.procs, for launch_into()
+  int64_t join_ns;		// Set by launch_into()
+} CgroupRun;
+
+// Returns false with errno set if the leaf cannot be made, or the
+// limits cannot be written to it
+bool cgroup_run_create(CgroupRun *run);
+
+// Kills whatever is left in the leaf, waits (briefly) for it to be
+// empty, and removes it.  Returns the number of processes that were
+// still there.
+int cgroup_run_remove(CgroupRun *run);
+
+// Totals for the leaf.  Each field is -1 when not available.  The
+// pressure stall times are those during which some (not all) of the
+// leaf's tasks were stalled on a resource.
+typedef struct CgroupStats {
+  int64_t cpu_us;		// cpu.stat usage_usec
+  int64_t mem_peak;		// memory.peak, in bytes
+  int64_t read_bytes;		// io.stat, summed over devices
+  int64_t write_bytes;
+  int64_t cpu_pressure_us;	// cpu.pressure, "some" total
+  int64_t mem_pressure_us;
+  int64_t io_pressure_us;
+  int64_t nr_throttled;		// cpu.stat, periods the quota ran out
+  int64_t throttled_us;		// cpu.stat, time spent throttled
+  int64_t mem_high_events;	// memory.events, times above memory.high
+  int64_t mem_max_events;	// memory.events, times at memory.max
+  int64_t oom_kills;		// memory.events, processes killed
+} CgroupStats;
+
+void cgroup_run_read(const CgroupRun *run, CgroupStats *stats);
+
+#endif
@@ -9,6 +9,10 @@
 #include "utils.h"
 #include "reports.h"
 #include "optable.h"
+#include "launch.h"
+#include "jobs.h"
+#include "pagecache.h"
+#include "exec.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -284,28 +288,119 @@ void process_common_options(int argc, char **argv) {
 // ACTION 'run' (execute experiments)
 // -----------------------------------------------------------------------------
 
+// Metrics that an adaptive run count can watch for convergence
+static int target_metric_from_name(const char *name) {
+  if (strcmp(name, "total") == 0) return F_TOTAL;
+  if (strcmp(name, "user") == 0) return F_USER;
+  if (strcmp(name, "system") == 0) return F_SYSTEM;
+  if (strcmp(name, "wall") == 0) return F_WALLNS;
+  return -1;
+}
+
 #define HELP_WARMUP "Number of warmup runs"
 #define HELP_RUNS "Number of timed runs"
+#define HELP_JOBS "Do <N> runs at once, each pinned to its own core [1]"
+#define HELP_MINRUNS "Adaptive: do at least <N> timed runs [10]"
+#define HELP_MAXRUNS "Adaptive: do at most <N> timed runs [1000]"
+#define HELP_TARGETCI "Adaptive: stop when median CI is within ±<PCT>% [1]"
+#define HELP_TARGETMETRIC "Adaptive: total, user, system, or wall [total]"
+#define HELP_RACE "Run commands in rounds, dropping any that are clearly slower"
+#define HELP_ORDER "Order of runs: sequential, interleaved, random [sequential]"
+#define HELP_SEED "Seed for random order, to repeat an earlier experiment"
+#define HELP_TIMEOUT "Kill any run that takes longer than <SECS> (wall clock)"
+#define HELP_CPULIMIT "Limit each run to <SECS> of CPU time"
+#define HELP_MEMLIMIT "Limit each run to <MB> of address space"
+#define HELP_FILESLIMIT "Limit each run to <N> open files"
+#define HELP_CALIBRATE "Measure harness overhead and report results net of it"
+#define HELP_FORKSERVER "Fork each run from a started copy of the command (Linux)"
+#define HELP_REPEAT "Execute the command <K> times per run, or 'auto' [1]"
+#define HELP_CPUSTATE "Record CPU frequency and temperature around each run (Linux)"
+#define HELP_CPUS "Pin each run to the CPUs in <LIST>, e.g. 2-3,6 (Linux)"
+#define HELP_HARNESSCPU "Pin bestguess itself to CPU <N>, which runs will not use"
+#define HELP_NOSMT "Keep runs off SMT siblings of the cores in use (Linux)"
+#define HELP_NICE "Run each command at nice level <N> (-20..19)"
+#define HELP_SCHED "Scheduling policy for runs: other, batch, fifo (Linux)"
+#define HELP_QUIET "Before each run, wait until other CPU use is below <PCT>%"
+#define HELP_INTERFERENCE "Re-run any run during which other CPU use was over <PCT>%"
+#define HELP_MAXRERUNS "Re-run at most <N> runs of each command [10]"
+#define HELP_CACHE "Before each run, evict (cold) or preload (warm) the command's files"
+#define HELP_CACHEFILE "With --cache, also evict or preload <FILE> (repeatable)"
+#define HELP_RATE "Start <N> runs per second on a schedule, not one after another"
+#define HELP_ARRIVALS "With --rate, space starts evenly (constant) or randomly (poisson) [constant]"
+#define HELP_MAXINFLIGHT "With --rate, have at most <N> runs in flight at once [64]"
+#define HELP_SWEEP "Run 1, 2, 4, ... copies at once, up to <N> or 'auto' (cores)"
+#define HELP_CGROUP "Run each run in its own cgroup, to account for all its processes (Linux)"
+#define HELP_CPUQUOTA "Limit each run to <CPUS> CPUs of time, e.g. 0.5 (cgroup cpu.max)"
+#define HELP_MEMORYHIGH "Throttle each run above <MB> of memory (cgroup memory.high)"
+#define HELP_MEMORYMAX "Limit each run to <MB> of memory (cgroup memory.max)"
+#define HELP_IOMAX "Limit each run's I/O, e.g. \"8:0 rbps=1048576\" (cgroup io.max)"
+#define HELP_DESCENDANTS "Wait for processes a run leaves behind, and count their usage (Linux)"
+#define HELP_INCLUDEINTERFERED "Include runs flagged for interference in the statistics"
 #define HELP_NAME "Name (per-command) to use in reports instead of full command"
-#define HELP_OUTPUT "Write timing data to CSV <FILE> (use - for stdout)"
+#define HELP_OUTPUT "Write timing data to CSV <FILE> (use - for stdout); see --metadata"
+#define HELP_METADATA "With -o, record settings in '# key=value' lines before the CSV header"
 #define HELP_CMDFILE "Read commands from <FILE>"
 #define HELP_SHOWOUTPUT "Show output of commands as they run"
+#define HELP_CAPTURE "Read and discard output, timing the first byte"
 #define HELP_IGNORE "Ignore non-zero exit codes"
 #define HELP_SHELL "Use <SHELL> (e.g. \"/bin/bash -c\") to run commands"
 #define HELP_CSV "Write statistical summary to CSV <FILE>"
 #define HELP_HFCSV "Write Hyperfine-style summary to CSV <FILE>"
 #define HELP_PREPARE "Execute <COMMAND> before each benchmarked command"
+#define HELP_LAUNCHER "Start commands using fork, vfork, or spawn [vfork]"
+#define HELP_LAUNCHREPORT "Report the launch overhead of each launcher"
 
 static void init_exec_options(void) {
   optable_add(OPT_WARMUP,     "w",  "warmup",         1, HELP_WARMUP);
   optable_add(OPT_RUNS,       "r",  "runs",           1, HELP_RUNS);
+  optable_add(OPT_JOBS,       "j",  "jobs",           1, HELP_JOBS);
+  optable_add(OPT_MINRUNS,    NULL, "min-runs",       1, HELP_MINRUNS);
+  optable_add(OPT_MAXRUNS,    NULL, "max-runs",       1, HELP_MAXRUNS);
+  optable_add(OPT_TARGETCI,   NULL, "target-ci",      1, HELP_TARGETCI);
+  optable_add(OPT_TARGETMETRIC, NULL, "target-metric", 1, HELP_TARGETMETRIC);
+  optable_add(OPT_RACE,       NULL, "race",           0, HELP_RACE);
+  optable_add(OPT_ORDER,      NULL, "order",          1, HELP_ORDER);
+  optable_add(OPT_SEED,       NULL, "seed",           1, HELP_SEED);
+  optable_add(OPT_TIMEOUT,    NULL, "timeout",        1, HELP_TIMEOUT);
+  optable_add(OPT_CPULIMIT,   NULL, "cpu-limit",      1, HELP_CPULIMIT);
+  optable_add(OPT_MEMLIMIT,   NULL, "mem-limit",      1, HELP_MEMLIMIT);
+  optable_add(OPT_FILESLIMIT, NULL, "files-limit",    1, HELP_FILESLIMIT);
+  optable_add(OPT_CALIBRATE,  NULL, "calibrate",      0, HELP_CALIBRATE);
+  optable_add(OPT_FORKSERVER, NULL, "fork-server",    0, HELP_FORKSERVER);
+  optable_add(OPT_REPEAT,     NULL, "repeat",         1, HELP_REPEAT);
+  optable_add(OPT_CPUSTATE,   NULL, "cpu-state",      0, HELP_CPUSTATE);
+  optable_add(OPT_CPUS,       NULL, "cpus",           1, HELP_CPUS);
+  optable_add(OPT_HARNESSCPU, NULL, "harness-cpu",    1, HELP_HARNESSCPU);
+  optable_add(OPT_NOSMT,      NULL, "no-smt",         0, HELP_NOSMT);
+  optable_add(OPT_NICE,       NULL, "nice",           1, HELP_NICE);
+  optable_add(OPT_SCHED,      NULL, "sched",          1, HELP_SCHED);
+  optable_add(OPT_QUIET,      NULL, "quiet",          1, HELP_QUIET);
+  optable_add(OPT_INTERFERENCE, NULL, "interference", 1, HELP_INTERFERENCE);
+  optable_add(OPT_MAXRERUNS,  NULL, "max-reruns",     1, HELP_MAXRERUNS);
+  optable_add(OPT_INCLUDEINTERFERED, NULL, "include-interfered", 0, HELP_INCLUDEINTERFERED);
+  optable_add(OPT_CACHE,      NULL, "cache",          1, HELP_CACHE);
+  optable_add(OPT_CACHEFILE,  NULL, "cache-file",     1, HELP_CACHEFILE);
+  optable_add(OPT_RATE,       NULL, "rate",           1, HELP_RATE);
+  optable_add(OPT_ARRIVALS,   NULL, "arrivals",       1, HELP_ARRIVALS);
+  optable_add(OPT_MAXINFLIGHT, NULL, "max-inflight",  1, HELP_MAXINFLIGHT);
+  optable_add(OPT_SWEEP,      NULL, "sweep",          1, HELP_SWEEP);
+  optable_add(OPT_CGROUP,     NULL, "cgroup",         0, HELP_CGROUP);
+  optable_add(OPT_CPUQUOTA,   NULL, "cpu-quota",      1, HELP_CPUQUOTA);
+  optable_add(OPT_MEMORYHIGH, NULL, "memory-high",    1, HELP_MEMORYHIGH);
+  optable_add(OPT_MEMORYMAX,  NULL, "memory-max",     1, HELP_MEMORYMAX);
+  optable_add(OPT_IOMAX,      NULL, "io-max",         1, HELP_IOMAX);
+  optable_add(OPT_DESCENDANTS, NULL, "wait-descendants", 0, HELP_DESCENDANTS);
   optable_add(OPT_PREP,       "p",  "prepare",        1, HELP_PREPARE);
   optable_add(OPT_OUTPUT,     "o",  "output",         1, HELP_OUTPUT);
+  optable_add(OPT_METADATA,   NULL, "metadata",       0, HELP_METADATA);
   optable_add(OPT_FILE,       "f",  "file",           1, HELP_CMDFILE);
   optable_add(OPT_NAME,       "n",  "name",           1, HELP_NAME);
   optable_add(OPT_SHOWOUTPUT, NULL, "show-output",    0, HELP_SHOWOUTPUT);
+  optable_add(OPT_CAPTURE,    NULL, "capture-output", 0, HELP_CAPTURE);
   optable_add(OPT_IGNORE,     "i",  "ignore-failure", 0, HELP_IGNORE);
   optable_add(OPT_SHELL,      "s",  "shell",          1, HELP_SHELL);
+  optable_add(OPT_LAUNCHER,   NULL, "launcher",       1, HELP_LAUNCHER);
+  optable_add(OPT_LAUNCHREPORT, NULL, "launcher-report", 0, HELP_LAUNCHREPORT);
   optable_add(OPT_CSV,        NULL, "export-csv",     1, HELP_CSV);
   optable_add(OPT_HFCSV,      NULL, "hyperfine-csv",  1, HELP_HFCSV);
   optable_add(OPT_NOSTATS,    "N",  "no-stats",       0, HELP_NOSTATS);
@@ -376,10 +471,245 @@ void process_exec_options(int argc, char **argv) {
 	if ((option.runs < 0) || (option.runs > MAXRUNS))
 	  USAGE("Number of timed runs is out of range 0..%d", MAXRUNS);
 	break;
+      case OPT_JOBS:
+	check_option_value(val, n);
+	option.jobs = strtoint64(val);
+	if ((option.jobs < 1) || (option.jobs > MAXJOBS))
+	  USAGE("Number of jobs is out of range 1..%d", MAXJOBS);
+	break;
+      case OPT_MINRUNS:
+	check_option_value(val, n);
+	option.adaptive = true;
+	option.min_runs = strtoint64(val);
+	if ((option.min_runs < 1) || (option.min_runs > MAXRUNS))
+	  USAGE("Minimum number of runs is out of range 1..%d", MAXRUNS);
+	break;
+      case OPT_MAXRUNS:
+	check_option_value(val, n);
+	option.adaptive = true;
+	option.max_runs = strtoint64(val);
+	if ((option.max_runs < 1) || (option.max_runs > MAXRUNS))
+	  USAGE("Maximum number of runs is out of range 1..%d", MAXRUNS);
+	break;
+      case OPT_TARGETCI:
+	check_option_value(val, n);
+	option.adaptive = true;
+	option.target_ci = strtodouble(val) / 100.0;
+	if ((option.target_ci <= 0) || (option.target_ci >= 1))
+	  USAGE("Target confidence interval is out of range (0, 100) percent");
+	break;
+      case OPT_TARGETMETRIC:
+	check_option_value(val, n);
+	option.adaptive = true;
+	option.target_metric = target_metric_from_name(val);
+	if (option.target_metric < 0)
+	  USAGE("Invalid target metric '%s' (valid metrics are total, user, system, wall)", val);
+	break;
+      case OPT_RACE:
+	check_option_value(val, n);
+	option.race = true;
+	break;
+      case OPT_ORDER:
+	check_option_value(val, n);
+	option.order = run_order_from_name(val);
+	if (option.order < 0)
+	  USAGE("Invalid order '%s' (valid orders are sequential, interleaved, random)", val);
+	break;
+      case OPT_SEED:
+	check_option_value(val, n);
+	option.seed = strtoint64(val);
+	if (option.seed < 0)
+	  USAGE("Seed must be a non-negative integer");
+	break;
+      case OPT_TIMEOUT: {
+	check_option_value(val, n);
+	double secs = strtodouble(val);
+	if ((secs <= 0) || (secs > (double) INT32_MAX))
+	  USAGE("Timeout must be a positive number of seconds");
+	option.timeout = (int64_t) (secs * NANOSECS);
+	break;
+      }
+      case OPT_CPULIMIT:
+	check_option_value(val, n);
+	option.cpu_limit = strtoint64(val);
+	if (option.cpu_limit < 1)
+	  USAGE("CPU time limit must be a positive number of seconds");
+	break;
+      case OPT_MEMLIMIT:
+	check_option_value(val, n);
+	option.mem_limit = strtoint64(val);
+	if ((option.mem_limit < 1) || (option.mem_limit > INT64_MAX / MEGA))
+	  USAGE("Memory limit must be a positive number of megabytes");
+	option.mem_limit *= MEGA;
+	break;
+      case OPT_FILESLIMIT:
+	check_option_value(val, n);
+	option.files_limit = strtoint64(val);
+	if (option.files_limit < 1)
+	  USAGE("Open files limit must be a positive number");
+	break;
+      case OPT_CALIBRATE:
+	check_option_value(val, n);
+	option.calibrate = true;
+	break;
+      case OPT_FORKSERVER:
+	check_option_value(val, n);
+	option.fork_server = true;
+	break;
+      case OPT_CPUSTATE:
+	check_option_value(val, n);
+	option.cpu_state = true;
+	break;
+      case OPT_CPUS:
+	check_option_value(val, n);
+	option.cpus = strdup(val);
+	break;
+      case OPT_HARNESSCPU:
+	check_option_value(val, n);
+	option.harness_cpu = (int) strtoint64(val);
+	if (option.harness_cpu < 0)
+	  USAGE("Harness CPU must be a CPU number");
+	break;
+      case OPT_NOSMT:
+	check_option_value(val, n);
+	option.no_smt = true;
+	break;
+      case OPT_NICE: {
+	check_option_value(val, n);
+	int64_t nice = strtoint64(val);
+	if ((nice < -20) || (nice > 19))
+	  USAGE("Nice level must be a number from -20 to 19");
+	option.nice = (int) nice;
+	break;
+      }
+      case OPT_QUIET: {
+	check_option_value(val, n);
+	int64_t pct = strtoint64(val);
+	if ((pct < 1) || (pct > 100))
+	  USAGE("Quiet threshold must be a percentage from 1 to 100");
+	option.quiet = (int) pct;
+	break;
+      }
+      case OPT_INTERFERENCE: {
+	check_option_value(val, n);
+	int64_t pct = strtoint64(val);
+	if ((pct < 1) || (pct > 100))
+	  USAGE("Interference threshold must be a percentage from 1 to 100");
+	option.interference = (int) pct;
+	break;
+      }
+      case OPT_MAXRERUNS:
+	check_option_value(val, n);
+	option.max_reruns = (int) strtoint64(val);
+	if (option.max_reruns < 0)
+	  USAGE("Maximum re-runs must be a non-negative number");
+	break;
+      case OPT_INCLUDEINTERFERED:
+	check_option_value(val, n);
+	option.include_interfered = true;
+	break;
+      case OPT_CACHE:
+	check_option_value(val, n);
+	option.cache = cache_mode_from_name(val);
+	if (option.cache < 0)
+	  USAGE("Invalid cache mode '%s' (valid modes are cold, warm)", val);
+	break;
+      case OPT_CACHEFILE:
+	check_option_value(val, n);
+	if (option.n_cache_files == MAXCACHEARGS)
+	  USAGE("Too many cache files (maximum is %d)", MAXCACHEARGS);
+	option.cache_files[option.n_cache_files++] = val;
+	break;
+      case OPT_RATE:
+	check_option_value(val, n);
+	option.rate = strtodouble(val);
+	if ((option.rate <= 0) || (option.rate > 1e6))
+	  USAGE("Rate must be a positive number of runs per second (at most 1000000)");
+	break;
+      case OPT_ARRIVALS:
+	check_option_value(val, n);
+	option.arrivals = arrivals_from_name(val);
+	if (option.arrivals < 0)
+	  USAGE("Invalid arrivals '%s' (valid arrivals are constant, poisson)", val);
+	break;
+      case OPT_MAXINFLIGHT:
+	check_option_value(val, n);
+	option.max_inflight = (int) strtoint64(val);
+	if ((option.max_inflight < 1) || (option.max_inflight > MAXINFLIGHT))
+	  USAGE("Maximum in flight is out of range 1..%d", MAXINFLIGHT);
+	break;
+      case OPT_SWEEP:
+	check_option_value(val, n);
+	if (strcmp(val, "auto") == 0) {
+	  option.sweep = SWEEP_AUTO;
+	} else {
+	  int64_t k = strtoint64(val);
+	  if ((k < 1) || (k > MAXJOBS))
+	    USAGE("Sweep limit must be 'auto' or a number from 1 to %d", MAXJOBS);
+	  option.sweep = (int) k;
+	}
+	break;
+      case OPT_CGROUP:
+	check_option_value(val, n);
+	option.cgroup = true;
+	break;
+      case OPT_CPUQUOTA:
+	check_option_value(val, n);
+	option.cpu_quota = strtodouble(val);
+	if ((option.cpu_quota < 0.01) || (option.cpu_quota > MAXJOBS))
+	  USAGE("CPU quota must be a number of CPUs from 0.01 to %d", MAXJOBS);
+	option.cgroup = true;
+	break;
+      case OPT_MEMORYHIGH:
+      case OPT_MEMORYMAX: {
+	check_option_value(val, n);
+	int64_t mb = strtoint64(val);
+	if ((mb < 1) || (mb > INT64_MAX / MEGA))
+	  USAGE("Memory limit must be a positive number of megabytes");
+	if (n == OPT_MEMORYHIGH)
+	  option.memory_high = mb * MEGA;
+	else
+	  option.memory_max = mb * MEGA;
+	option.cgroup = true;
+	break;
+      }
+      case OPT_IOMAX:
+	check_option_value(val, n);
+	if (!strchr(val, ':') || !strchr(val, '='))
+	  USAGE("I/O limit must be like \"MAJ:MIN rbps=N\" (see io.max)");
+	option.io_max = val;
+	option.cgroup = true;
+	break;
+      case OPT_DESCENDANTS:
+	check_option_value(val, n);
+	option.wait_descendants = true;
+	break;
+      case OPT_SCHED:
+	check_option_value(val, n);
+	option.sched_policy = sched_policy_from_name(val);
+	if (option.sched_policy < 0)
+	  USAGE("Invalid scheduling policy '%s' (valid policies on Linux"
+		" are other, batch, fifo)", val);
+	break;
+      case OPT_REPEAT:
+	check_option_value(val, n);
+	if (strcmp(val, "auto") == 0) {
+	  option.repeat = REPEAT_AUTO;
+	} else {
+	  int64_t k = strtoint64(val);
+	  if ((k < 1) || (k > MAXREPEAT))
+	    USAGE("Repeat count must be 'auto' or a number from 1 to %d", MAXREPEAT);
+	  option.repeat = (int) k;
+	}
+	break;
       case OPT_OUTPUT:
 	check_option_value(val, n);
 	option.output_filename = strdup(val);
 	break;
+      case OPT_METADATA:
+	check_option_value(val, n);
+	option.metadata = true;
+	break;
       case OPT_FILE:
 	check_option_value(val, n);
 	option.input_filename = strdup(val);
@@ -388,6 +718,10 @@ void process_exec_options(int argc, char **argv) {
 	check_option_value(val, n);
 	option.show_output = true;
 	break;
+      case OPT_CAPTURE:
+	check_option_value(val, n);
+	option.capture_output = true;
+	break;
       case OPT_IGNORE:
 	check_option_value(val, n);
 	option.ignore_failure = true;
@@ -396,6 +730,16 @@ void process_exec_options(int argc, char **argv) {
 	check_option_value(val, n);
 	option.shell = val;
 	break;
+      case OPT_LAUNCHER:
+	check_option_value(val, n);
+	option.launcher = launcher_from_name(val);
+	if (option.launcher < 0)
+	  USAGE("Invalid launcher '%s' (valid launchers are fork, vfork, spawn)", val);
+	break;
+      case OPT_LAUNCHREPORT:
+	check_option_value(val, n);
+	option.launcher_report = true;
+	break;
       case OPT_HFCSV:
 	check_option_value(val, n);
 	option.hf_filename = strdup(val);
@@ -420,6 +764,7 @@ void process_exec_options(int argc, char **argv) {
 
 static void init_report_options(void) {
   optable_add(OPT_CSV,        NULL, "export-csv",     1, HELP_CSV);
+  optable_add(OPT_INCLUDEINTERFERED, NULL, "include-interfered", 0, HELP_INCLUDEINTERFERED);
   optable_add(OPT_HFCSV,      NULL, "hyperfine-csv",  1, HELP_HFCSV);
   optable_add(OPT_NOSTATS,    "N",  "no-stats",       0, HELP_NOSTATS);
   optable_add(OPT_MINISTATS,  "M",  "mini-stats",     0, HELP_MINISTATS);
@@ -471,6 +816,10 @@ void process_report_options(int argc, char **argv) {
 	check_option_value(val, n);
 	option.csv_filename = strdup(val);
 	break;
+      case OPT_INCLUDEINTERFERED:
+	check_option_value(val, n);
+	option.include_interfered = true;
+	break;
       default:
 	break;
     }
@@ -12,12 +12,53 @@
 enum Options { 
   OPT_WARMUP,
   OPT_RUNS,
+  OPT_JOBS,			// Parallel runs on pinned cores
+  OPT_MINRUNS,			// Adaptive number of runs
+  OPT_MAXRUNS,
+  OPT_TARGETCI,
+  OPT_TARGETMETRIC,
+  OPT_RACE,			// Eliminate slower commands early
+  OPT_ORDER,			// Sequential, interleaved, random
+  OPT_SEED,			// For random order
+  OPT_TIMEOUT,			// Per-run limits
+  OPT_CPULIMIT,
+  OPT_MEMLIMIT,
+  OPT_FILESLIMIT,
+  OPT_CALIBRATE,		// Measure harness overhead
+  OPT_FORKSERVER,		// Fork runs from a preloaded server
+  OPT_REPEAT,			// Executions per timed run
+  OPT_CPUSTATE,			// Sample CPU frequency, temperature
+  OPT_CPUS,			// Pinning and scheduling
+  OPT_HARNESSCPU,
+  OPT_NOSMT,
+  OPT_NICE,
+  OPT_SCHED,
+  OPT_QUIET,			// Wait for a quiet system
+  OPT_INTERFERENCE,		// Re-run runs spoiled by other processes
+  OPT_MAXRERUNS,
+  OPT_INCLUDEINTERFERED,
+  OPT_CACHE,			// Cold or warm page cache
+  OPT_CACHEFILE,
+  OPT_RATE,			// Open loop: start runs on a schedule
+  OPT_ARRIVALS,
+  OPT_MAXINFLIGHT,
+  OPT_SWEEP,			// Throughput at rising concurrency
+  OPT_CGROUP,			// Account for whole process trees
+  OPT_CPUQUOTA,			// Cgroup limits (imply --cgroup)
+  OPT_MEMORYHIGH,
+  OPT_MEMORYMAX,
+  OPT_IOMAX,
+  OPT_DESCENDANTS,		// Wait for orphaned descendants
   OPT_PREP,
   OPT_IGNORE,
   OPT_SHOWOUTPUT,
+  OPT_CAPTURE,			// Time to first byte of output
   OPT_SHELL,
+  OPT_LAUNCHER,			// How to start child processes
+  OPT_LAUNCHREPORT,		// Compare launcher overheads
   OPT_NAME,
   OPT_OUTPUT,			// Raw data output
+  OPT_METADATA,			// Settings ahead of the raw data header
   OPT_CSV,			// BestGuess-format summary CSV
   OPT_HFCSV,			// Hyperfine-format summary CSV
   OPT_FILE,			// Input file of commands
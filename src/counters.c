@@ -0,0 +1,150 @@
+//  -*- Mode: C; -*-
+//
+//  counters.c  Hardware and software performance counters
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "counters.h"
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define FIELD(fc, type, config) fc,
+static const FieldCode CounterField[] = {XCounters(FIELD)};
+#undef FIELD
+
+void counters_skip(Usage *usage, int idx) {
+  for (int i = 0; i < NCOUNTERS; i++)
+    set_int64(usage, idx, CounterField[i], -1);
+}
+
+#ifdef __linux__
+
+#define TYPE(fc, type, config) type,
+static const uint32_t CounterType[] = {XCounters(TYPE)};
+#undef TYPE
+#define CONFIG(fc, type, config) config,
+static const uint64_t CounterConfig[] = {XCounters(CONFIG)};
+#undef CONFIG
+
+// Layout of a read() given PERF_FORMAT_TOTAL_TIME_ENABLED and
+// PERF_FORMAT_TOTAL_TIME_RUNNING
+typedef struct Reading {
+  uint64_t value;
+  uint64_t enabled;
+  uint64_t running;
+} Reading;
+
+// Set by counters_init() and read-only afterwards
+static bool unavailable[NCOUNTERS];
+static bool exclude_kernel[NCOUNTERS];
+
+static int open_counter(int i) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = CounterType[i];
+  attr.config = CounterConfig[i];
+  attr.read_format = (PERF_FORMAT_TOTAL_TIME_ENABLED |
+		      PERF_FORMAT_TOTAL_TIME_RUNNING);
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.enable_on_exec = 1;
+  attr.exclude_kernel = exclude_kernel[i];
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// When perf_event_paranoid forbids counting kernel events, we fall
+// back to counting user space only, as 'perf stat' does.  A counter
+// that fails to open here is not tried again.
+void counters_init(void) {
+  for (int i = 0; i < NCOUNTERS; i++) {
+    int fd = open_counter(i);
+    if ((fd < 0) && ((errno == EACCES) || (errno == EPERM))) {
+      exclude_kernel[i] = true;
+      fd = open_counter(i);
+    }
+    if (fd < 0) {
+      unavailable[i] = true;
+      if (DEBUG)
+	fprintf(stderr, "Counter for '%s' not available: %s\n",
+		Header[CounterField[i]], strerror(errno));
+    } else {
+      close(fd);
+    }
+  }
+}
+
+// The counters are opened fresh for each run, because (at least on
+// Linux 6.x) an inherited counter stops being enabled on exec after
+// the first few children.  The counters count events in the calling
+// thread's children only.
+void counters_start(Counters *c) {
+  for (int i = 0; i < NCOUNTERS; i++)
+    c->fds[i] = unavailable[i] ? -1 : open_counter(i);
+}
+
+// If the kernel had to multiplex the counters, the count covers only
+// part of the time the child ran, so we scale it up.
+static void read_counters(Counters *c, int64_t *values) {
+  Reading r;
+  for (int i = 0; i < NCOUNTERS; i++) {
+    int64_t value = -1;
+    int fd = c->fds[i];
+    if ((fd >= 0) && (read(fd, &r, sizeof(r)) == sizeof(r))) {
+      if (r.running == r.enabled)
+	value = (int64_t) r.value;
+      else if (r.running > 0)
+	value = (int64_t) ((double) r.value * ((double) r.enabled / (double) r.running));
+    }
+    if (fd >= 0) close(fd);
+    c->fds[i] = -1;
+    values[i] = value;
+  }
+}
+
+void counters_stop(Counters *c, Usage *usage, int idx) {
+  int64_t values[NCOUNTERS];
+  read_counters(c, values);
+  for (int i = 0; i < NCOUNTERS; i++)
+    set_int64(usage, idx, CounterField[i], values[i]);
+}
+
+// A count that is missing for any execution is missing for the run
+void counters_stop_add(Counters *c, Usage *usage, int idx) {
+  int64_t values[NCOUNTERS];
+  read_counters(c, values);
+  for (int i = 0; i < NCOUNTERS; i++) {
+    int64_t sum = get_int64(usage, idx, CounterField[i]);
+    if ((sum >= 0) && (values[i] >= 0))
+      set_int64(usage, idx, CounterField[i], sum + values[i]);
+    else
+      set_int64(usage, idx, CounterField[i], -1);
+  }
+}
+
+#else  // Not Linux
+
+void counters_init(void) {
+}
+
+void counters_start(Counters *c) {
+  (void) c;
+}
+
+void counters_stop(Counters *c, Usage *usage, int idx) {
+  (void) c;
+  counters_skip(usage, idx);
+}
+
+void counters_stop_add(Counters *c, Usage *usage, int idx) {
+  (void) c;
+  counters_skip(usage, idx);
+}
+
+#endif
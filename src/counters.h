@@ -0,0 +1,57 @@
+//  -*- Mode: C; -*-
+//
+//  counters.h  Hardware and software performance counters
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef counters_h
+#define counters_h
+
+#include "bestguess.h"
+#include "utils.h"
+
+// On Linux, we count events for each child process using
+// perf_event_open().  Before each launch, the counters are opened on
+// Bestguess itself with 'inherit' set, so that the child (and its
+// children) are counted, and with 'enable_on_exec' so that counting
+// starts only when the child execs the command.  They are never
+// enabled for Bestguess itself.  The kernel adds the counts of the
+// child into our counters when it exits, so we read them after the
+// child is reaped.
+//
+// A counter that cannot be opened (no PMU in a VM, a restrictive
+// perf_event_paranoid setting, or not Linux) produces the value -1,
+// which is written to the raw data file as an empty field.
+
+#define XCounters(X)							\
+  X(F_CYCLES,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES)		\
+  X(F_INSTR,      PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS)	\
+  X(F_CACHEREFS,  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES)	\
+  X(F_CACHEMISS,  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES)	\
+  X(F_BRANCHMISS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES)	\
+  X(F_MIGRATIONS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS)	\
+  X(F_TASKCLOCK,  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK)
+
+#define COUNTER_PLUS_ONE(fc, type, config) + 1
+#define NCOUNTERS (0 XCounters(COUNTER_PLUS_ONE))
+
+// Counters are per thread, so each thread that launches children
+// needs its own
+typedef struct Counters {
+  int fds[NCOUNTERS];
+} Counters;
+
+// Call once, before any thread calls counters_start()
+void counters_init(void);
+// Call immediately before launching a child
+void counters_start(Counters *c);
+// Call after the child is reaped to store the counts for this run
+void counters_stop(Counters *c, Usage *usage, int idx);
+// Like counters_stop(), but adds the counts to those already stored,
+// for a run that executes the command more than once
+void counters_stop_add(Counters *c, Usage *usage, int idx);
+// Store 'not available' for a run that was not counted, e.g. the
+// child of a fork server, which never calls exec
+void counters_skip(Usage *usage, int idx);
+
+#endif
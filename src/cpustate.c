@@ -0,0 +1,158 @@
+//  -*- Mode: C; -*-
+//
+//  cpustate.c  CPU frequency, temperature, and core type
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "cpustate.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAXZONES 64
+
+static int ncpus = 0;
+static int8_t core_type[MAXCPUSTATE];
+static bool has_core_types = false;
+
+#ifdef __linux__
+
+static int freq_fd[MAXCPUSTATE];
+static int nzones = 0;
+static int zone_fd[MAXZONES];
+
+// Sysfs attributes are regenerated by each read at offset 0, so an
+// open file can be read again with pread().  Returns -1 on failure.
+static int64_t read_value(int fd) {
+  char buf[32];
+  if (fd < 0) return -1;
+  ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) return -1;
+  buf[len] = '\0';
+  char *end;
+  long long value = strtoll(buf, &end, 10);
+  return (end == buf) ? -1 : value;
+}
+
+static int64_t read_file(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  int64_t value = read_value(fd);
+  if (fd >= 0) close(fd);
+  return value;
+}
+
+// Mark each CPU in a list like "0-7,16,18-19" with 'type'.  Returns
+// false if the file cannot be read.
+static bool mark_cpu_list(const char *path, int8_t type) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  int lo, hi;
+  char sep;
+  while (fscanf(f, "%d", &lo) == 1) {
+    hi = lo;
+    sep = (char) fgetc(f);
+    if ((sep == '-') && (fscanf(f, "%d", &hi) == 1))
+      sep = (char) fgetc(f);
+    for (int cpu = lo; (cpu <= hi) && (cpu < ncpus); cpu++)
+      if (cpu >= 0) core_type[cpu] = type;
+    if (sep != ',') break;
+  }
+  fclose(f);
+  return true;
+}
+
+// Intel hybrid CPUs have a separate PMU for each core type, which
+// lists its CPUs.  Elsewhere (e.g. ARM big.LITTLE), the cores with
+// the largest capacity are the performance cores, but only when not
+// all cores have the same capacity.
+static void find_core_types(void) {
+  char path[96];
+  int64_t capacity[MAXCPUSTATE];
+  int64_t most = -1;
+  bool hybrid = false;
+  for (int cpu = 0; cpu < ncpus; cpu++) core_type[cpu] = -1;
+  if (mark_cpu_list("/sys/devices/cpu_core/cpus", CORE_PERFORMANCE)
+      && mark_cpu_list("/sys/devices/cpu_atom/cpus", CORE_EFFICIENCY))
+    return;
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    snprintf(path, sizeof(path),
+	     "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+    capacity[cpu] = read_file(path);
+    if ((cpu > 0) && (capacity[cpu] != capacity[0])) hybrid = true;
+    if (capacity[cpu] > most) most = capacity[cpu];
+  }
+  if (!hybrid) return;
+  for (int cpu = 0; cpu < ncpus; cpu++)
+    if (capacity[cpu] >= 0)
+      core_type[cpu] = (capacity[cpu] == most) ? CORE_PERFORMANCE : CORE_EFFICIENCY;
+}
+
+void cpustate_init(bool sampling) {
+  char path[96];
+  long n = sysconf(_SC_NPROCESSORS_CONF);
+  ncpus = (n < 1) ? 1 : ((n > MAXCPUSTATE) ? MAXCPUSTATE : (int) n);
+  find_core_types();
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    if (core_type[cpu] > 0) has_core_types = true;
+    freq_fd[cpu] = -1;
+    if (!sampling) continue;
+    snprintf(path, sizeof(path),
+	     "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    freq_fd[cpu] = open(path, O_RDONLY | O_CLOEXEC);
+  }
+  // Thermal zones are numbered consecutively
+  while (sampling && (nzones < MAXZONES)) {
+    snprintf(path, sizeof(path),
+	     "/sys/class/thermal/thermal_zone%d/temp", nzones);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) break;
+    zone_fd[nzones++] = fd;
+  }
+}
+
+int64_t cpustate_freq(int64_t cpu) {
+  if ((cpu < 0) || (cpu >= ncpus)) return -1;
+  return read_value(freq_fd[cpu]);
+}
+
+int64_t cpustate_temp(void) {
+  int64_t hottest = -1;
+  for (int z = 0; z < nzones; z++) {
+    int64_t temp = read_value(zone_fd[z]);
+    if (temp > hottest) hottest = temp;
+  }
+  return hottest;
+}
+
+#else
+
+void cpustate_init(bool sampling) {
+  (void) sampling;
+}
+
+int64_t cpustate_freq(int64_t cpu) {
+  (void) cpu;
+  return -1;
+}
+
+int64_t cpustate_temp(void) {
+  return -1;
+}
+
+#endif
+
+void cpustate_sample(CPUSample *s) {
+  s->temp_mc = cpustate_temp();
+  for (int cpu = 0; cpu < MAXCPUSTATE; cpu++)
+    s->freq_khz[cpu] = (cpu < ncpus) ? cpustate_freq(cpu) : -1;
+}
+
+bool cpustate_hybrid(void) {
+  return has_core_types;
+}
+
+int64_t cpustate_core_type(int64_t cpu) {
+  if ((cpu < 0) || (cpu >= ncpus)) return -1;
+  return core_type[cpu];
+}
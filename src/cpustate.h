@@ -0,0 +1,55 @@
+//  -*- Mode: C; -*-
+//
+//  cpustate.h  CPU frequency, temperature, and core type
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef cpustate_h
+#define cpustate_h
+
+#include "bestguess.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// On Linux, the current frequency of each CPU and the temperature of
+// each thermal zone are in sysfs.  With --cpu-state, we sample them
+// before and after each run, so that a run that was slowed by
+// frequency scaling or thermal throttling can be recognized.  On a
+// hybrid system, cores of different types run the same code at
+// different speeds, so we also record the type of the core where the
+// run started (with --cpu-state) and where it ended.
+//
+// Anything that cannot be read (not Linux, no cpufreq driver, as in
+// many VMs, or no thermal zones) produces the value -1, which is
+// written to the raw data file as an empty field.
+
+// CPUs beyond this are not sampled
+#define MAXCPUSTATE 1024
+
+typedef enum CoreType {
+  CORE_PERFORMANCE = 1,
+  CORE_EFFICIENCY  = 2,
+} CoreType;
+
+typedef struct CPUSample {
+  int64_t temp_mc;		    // Hottest zone, millidegrees Celsius
+  int64_t freq_khz[MAXCPUSTATE];    // Per CPU
+} CPUSample;
+
+// Call once, before any thread calls the functions below.  The
+// frequency and temperature files are opened only when 'sampling'.
+void cpustate_init(bool sampling);
+
+// Read the frequency of every CPU, and the temperature
+void cpustate_sample(CPUSample *s);
+// Read the frequency of one CPU
+int64_t cpustate_freq(int64_t cpu);
+// Read the temperature of the hottest thermal zone
+int64_t cpustate_temp(void);
+
+// Whether the CPUs have different core types
+bool    cpustate_hybrid(void);
+// CORE_PERFORMANCE or CORE_EFFICIENCY on a hybrid system, else -1
+int64_t cpustate_core_type(int64_t cpu);
+
+#endif
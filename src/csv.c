@@ -158,6 +158,64 @@ void csv_error(char *input,
     fputc(((fc) == (lastfc - 1)) ? '\n' : ',', f);	\
   } while (0)
 
+void write_metadata(FILE *f, const char *key, const char *value) {
+  if (!key || !value) PANIC_NULL();
+  fprintf(f, "# %s=%s\n", key, value);
+}
+
+#define MAXMETADATA 1024
+
+// Lines are "# key=value".  Lines without '=', and the remainder of
+// overlong lines, are ignored.
+int read_metadata(FILE *f, MetadataFn fn, void *context) {
+  char line[MAXMETADATA];
+  int c, lines = 0;
+  while ((c = getc(f)) == '#') {
+    int len = 0;
+    while (((c = getc(f)) != '\n') && (c != EOF))
+      if (len < MAXMETADATA - 1) line[len++] = (char) c;
+    line[len] = '\0';
+    lines++;
+    char *key = line;
+    while (*key == ' ') key++;
+    char *eq = strchr(key, '=');
+    if (fn && eq) {
+      *eq = '\0';
+      fn(key, eq + 1, context);
+    }
+  }
+  if (c != EOF) ungetc(c, f);
+  return lines;
+}
+
+#define OVERHEAD_FMT(m)						\
+  (m).min, (m).Q1, (m).median, (m).Q3, (m).max, (m).median_ci
+
+void write_overhead(FILE *f, const char *key, const Overhead *o) {
+  if (!key || !o) PANIC_NULL();
+  fprintf(f, "# %s=%d,"
+	  INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT ","
+	  INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT "," INT64FMT "\n",
+	  key, o->runs, OVERHEAD_FMT(o->total), OVERHEAD_FMT(o->wall));
+}
+
+#define OVERHEAD_SCAN(m)					\
+  &(m).min, &(m).Q1, &(m).median, &(m).Q3, &(m).max, &(m).median_ci
+
+bool parse_overhead(const char *value, Overhead *o) {
+  if (!value || !o) PANIC_NULL();
+  memset(o, 0, sizeof(Overhead));
+  int count = sscanf(value, "%d,"
+		     "%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ","
+		     "%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64,
+		     &o->runs, OVERHEAD_SCAN(o->total), OVERHEAD_SCAN(o->wall));
+  if ((count != 13) || (o->runs < 1)) {
+    o->runs = 0;
+    return false;
+  }
+  return true;
+}
+
 void write_header(FILE *f) {
   for (FieldCode fc = 0; fc < F_LAST; fc++)
     WRITEHEADER(fc, Header[fc], F_LAST);
@@ -179,7 +237,10 @@ void write_line(FILE *f, Usage *usage, int idx) {
   WRITEFIELD(F_NAME, "\"%s\"", cmd_name ?: "", F_LAST);
   WRITEFIELD(F_BATCH, "%d", usage->data[idx].batch, F_LAST);
   for (FieldCode fc = F_STARTDATA; fc < F_ENDDATA; fc++) {
-    WRITEFIELD(fc, INT64FMT, GETFIELD(fc), F_ENDDATA);
+    if (FOPTIONAL(fc) && (GETFIELD(fc) < 0))
+      WRITEFIELD(fc, "%s", "", F_ENDDATA);
+    else
+      WRITEFIELD(fc, INT64FMT, GETFIELD(fc), F_ENDDATA);
   }
   
   // User time in microseconds
@@ -203,6 +264,8 @@ void write_line(FILE *f, Usage *usage, int idx) {
   //   priority process becoming runnable or because the current process
   //   exceeded its time slice.
   // Elapsed wall clock time in microseconds
+  // Performance counters (see counters.h), empty if not available
+  // Elapsed wall clock time in nanoseconds, from a monotonic clock
 
   fflush(f);
   free(escaped_cmd);
@@ -285,6 +348,9 @@ void write_line(FILE *f, Usage *usage, int idx) {
   X(S_WALLMAX, "Wall max (μs)")			\
   X(S_NAME,    "Name")				\
   X(S_BATCH,   "Batch")				\
+  X(S_TIMEOUT, "Timed out (ct)")		\
+  X(S_LIMIT,   "Over limit (ct)")		\
+  X(S_INTERFERED, "Interfered (ct)")		\
   X(S_LAST,    "SENTINEL")
 
 #define FIRST(a, b) a,
@@ -382,6 +448,9 @@ void write_summary_line(FILE *f, Summary *s) {
   WRITEFIELD(S_WALLMAX, INT64FMT, s->wall.max, S_LAST);
   WRITEFIELD(S_NAME, "%s", cmd_name ?: "", S_LAST);
   WRITEFIELD(S_BATCH, "%d", s->batch, S_LAST);
+  WRITEFIELD(S_TIMEOUT, "%d", s->timeout_count, S_LAST);
+  WRITEFIELD(S_LIMIT, "%d", s->limit_count, S_LAST);
+  WRITEFIELD(S_INTERFERED, "%d", s->interfered_count, S_LAST);
   fflush(f);
   free(escaped_cmd);
   free(shell_cmd);
@@ -408,8 +477,10 @@ void write_hf_header(FILE *f) {
   fflush(f);
 }
 
+// Hyperfine has no way to say that no run completed, so a command
+// without statistics is left out
 void write_hf_line(FILE *f, Summary *s) {
-  if (!f) return;
+  if (!f || (s->runs == 0)) return;
   const int N = 8;
   const double million = MICROSECS;
   int i = 0;
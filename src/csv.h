@@ -32,6 +32,21 @@ void csv_error(char *input, int lineno, const char *desc, int fc, char *buf, siz
 
 // Output file (raw data, per timed run)
 
+// Metadata lines like "# seed=42" may come before the header.  The
+// reader calls 'fn' (if not NULL) for each one, and returns how many
+// lines it read.
+typedef void (MetadataFn)(const char *key, const char *value, void *context);
+void write_metadata(FILE *f, const char *key, const char *value);
+int  read_metadata(FILE *f, MetadataFn fn, void *context);
+
+// Harness overhead is stored as metadata: the number of runs, then
+// the min, Q1, median, Q3, max, and median CI half-width of total
+// time, and then the same for wall clock time (all in μs)
+#define OVERHEAD_KEY "overhead"
+#define SHELL_OVERHEAD_KEY "shell-overhead"
+void write_overhead(FILE *f, const char *key, const Overhead *o);
+bool parse_overhead(const char *value, Overhead *o);
+
 void write_header(FILE *f);
 void write_line(FILE *f, Usage *usage, int idx);
 
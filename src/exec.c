@@ -5,13 +5,23 @@
 //  Copyright (C) Jamie A. Jennings, 2024
 
 #include "exec.h"
+#include "launch.h"
+#include "forkserver.h"
+#include "counters.h"
+#include "cpustate.h"
+#include "sysload.h"
+#include "jobs.h"
+#include "pagecache.h"
+#include "cgroup.h"
 #include "cli.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h> 
 #include <assert.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <math.h>
 
 #include "csv.h"
 #include "stats.h"
@@ -19,6 +29,28 @@
 #include "optable.h"
 #include "utils.h"
 
+#define SECOND(a, b, c) b,
+const char *RunOrderName[] = {XOrders(SECOND)};
+#undef SECOND
+
+int run_order_from_name(const char *name) {
+  if (!name) PANIC_NULL();
+  for (RunOrder i = 0; i < orderLast; i++)
+    if (strcmp(name, RunOrderName[i]) == 0) return i;
+  return -1;
+}
+
+#define SECOND(a, b, c) b,
+const char *ArrivalsName[] = {XArrivals(SECOND)};
+#undef SECOND
+
+int arrivals_from_name(const char *name) {
+  if (!name) PANIC_NULL();
+  for (Arrivals i = 0; i < arrivalsLast; i++)
+    if (strcmp(name, ArrivalsName[i]) == 0) return i;
+  return -1;
+}
+
 static bool spacetab(char c) {
   return (c == ' ') || (c == '\t');
 }
@@ -70,50 +102,23 @@ static const char *have_name_option(char *line) {
   }
 }
 
-static void run_prep_command(void) {
-  if (!option.prep_command) return;
-  
-  // TODO: Factor out commonality with run()
+static void run_prep_command(const LaunchPlan *prep) {
+  if (!prep) return;
 
-  FILE *f;
-  pid_t pid;
   int use_shell = *option.shell;
-  arglist *args = new_arglist(MAXARGS);
 
-  if (use_shell) {
-    split_unescape(option.shell, args);
-    add_arg(args, strdup(option.prep_command));
-  } else {
-    split_unescape(option.prep_command, args);
-  }
-
-  if (DEBUG) {
-    printf("Prepare command arguments:\n");
-    print_arglist(args);
-    fflush(NULL);
-  }
+  // What the prepare command leaves running is not part of the run
+  // that follows, so it must not become ours to wait for
+  if (option.wait_descendants) set_subreaper(false);
 
   // Goin' for a ride!
-  pid = fork();
-
-  if (pid == 0) {
-    f = freopen("/dev/null", "r", stdin);
-    if (!f) PANIC("freopen failed on stdin");
-    f = freopen("/dev/null", "w", stderr);
-    if (!f) PANIC("freopen failed on stderr");
-    f = freopen("/dev/null", "w", stdout);
-    if (!f) PANIC("freopen failed on stdout");
-
-    execvp(args->args[0], args->args);
-    // The exec() functions return only if an error occurs, i.e. it
-    // could not launch args[0] (a command or the shell to run it)
-    PANIC("Exec failed");
-  }
+  pid_t pid = launch(option.launcher, prep);
 
-  int status;
-  pid_t err = wait4(pid, &status, 0, NULL);
+  int status = 0;
+  pid_t err = (pid < 0) ? -1 : wait4(pid, &status, 0, NULL);
+  if (option.wait_descendants) set_subreaper(true);
 
-  // Check to see if cmd/shell aborted or was killed
+  // Check to see if cmd/shell could not be launched, aborted, or was killed
   if ((err == -1) || !WIFEXITED(status) || WIFSIGNALED(status)) {
     PANIC("Error trying to execute %s '%s'.\n",
 	  use_shell ? "shell" : "command",
@@ -123,89 +128,361 @@ static void run_prep_command(void) {
   if (!option.ignore_failure && WEXITSTATUS(status)) {
     if (use_shell) 
       PANIC("Prepare command under %s produced non-zero exit code %d\n",
-	    args->args[0], WEXITSTATUS(status));
+	    prep->args->args[0], WEXITSTATUS(status));
     else
       PANIC("Prepare command produced non-zero exit code %d\n",
 	      WEXITSTATUS(status));
   }
 }
 
-static int run(int num, Usage *usage, int idx, int64_t batch) {
-  FILE *f;
-  pid_t pid;
-  int status;
-  int64_t start, stop;
+// The plan for the warmup and timed runs of 'cmd'.  A timeout needs
+// the child to lead its own process group, so that we can kill any
+// processes it started, too.  With parallel runs, each child inherits
+// the CPU of its worker instead of being pinned by the plan.
+static LaunchPlan *new_run_plan(const char *shell, const char *cmd) {
+  LaunchPlan *plan = new_launch_plan(shell, cmd, !option.show_output);
+  if (option.timeout > 0)
+    launch_plan_group(plan);
+  if (option.cpu_limit > 0)
+    launch_plan_limit(plan, RLIMIT_CPU, (rlim_t) option.cpu_limit);
+  if (option.mem_limit > 0)
+    launch_plan_limit(plan, RLIMIT_AS, (rlim_t) option.mem_limit);
+  if (option.files_limit > 0)
+    launch_plan_limit(plan, RLIMIT_NOFILE, (rlim_t) option.files_limit);
+  int cpus[MAXJOBS];
+  int ncpus = restricted_cpus(cpus);
+  if ((ncpus > 0) && (option.jobs == 1) && (option.sweep < 0))
+    launch_plan_affinity(plan, cpus, ncpus);
+  launch_plan_priority(plan, option.nice, option.sched_policy);
+  return plan;
+}
 
-  const char *cmd = option.commands[num];
-  const char *name = option.names[num];
+// Everything that a run needs, other than globals, that must not be
+// shared between threads.  There is one Runner per worker thread in
+// parallel mode (--jobs), and just one otherwise.
+typedef struct Runner {
+  int      core;		// Core this runner is pinned to, or -1
+  Counters counters;
+  ForkServer *server;		// With --fork-server, else NULL
+  CPUSample before;		// With --cpu-state
+} Runner;
 
-  int show_output = option.show_output;
-  int use_shell = *option.shell;
+// One execution of the command, which is the whole run unless the
+// run repeats the command (--repeat)
+typedef struct Execution {
+  pid_t         err;		// As returned by wait4()
+  int           status;
+  int           launch_errno;
+  bool          timed_out;
+  int64_t       wall_ns;
+  struct rusage ru;
+  ChildAcct     acct;
+  int64_t       first_cpu;	// With --cpu-state on a hybrid system, else -1
+  int64_t       ttfb_ns;	// With --capture-output, else -1
+  ChildOutput   output;
+  CgroupStats   cg;		// With --cgroup
+  int           leftovers;	// Processes left in the cgroup
+  Descendants   orphans;	// With --wait-descendants
+} Execution;
 
-  struct timeval wall_clock_start, wall_clock_stop;
+static void add_rusage(struct rusage *sum, const struct rusage *ru);
 
-  run_prep_command();
+// With --wait-descendants and no --timeout, how long stragglers may
+// run after the command exits
+#define DESCENDANT_GRACE_NS (10 * (int64_t) NANOSECS)
 
-  arglist *args = new_arglist(MAXARGS);
+// The 'deadline' (per monotonic_ns, or -1 for none) is that of the
+// whole run, which may execute the command several times
+static void execute_once(Runner *runner, const LaunchPlan *plan,
+			 int64_t deadline, Execution *e) {
+  int64_t start, stop;
+  memset(e, 0, sizeof(Execution));
+  e->err = -1;
+  e->acct = (ChildAcct) {-1, -1, -1, -1, -1, -1, -1, -1, -1};
+  e->first_cpu = -1;
+  e->ttfb_ns = -1;
+  e->cg = (CgroupStats) {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+  e->leftovers = 0;
+  e->orphans.last_exit_ns = -1;
 
-  if (use_shell) {
-    split_unescape(option.shell, args);
-    add_arg(args, strdup(cmd));
-  } else {
-    split_unescape(cmd, args);
+  if (runner->server) {
+    // The server times the run, from fork until the child exits, but
+    // we have no /proc accounting for the child
+    start = monotonic_ns();
+    if (fork_server_run(runner->server, &e->status, &e->ru, &e->wall_ns)) {
+      e->err = runner->server->pid;
+    } else {
+      e->launch_errno = errno;
+      e->wall_ns = monotonic_ns() - start;
+    }
+    return;
   }
 
-  if (DEBUG) {
-    printf("Arguments to pass to exec:\n");
-    print_arglist(args);
-    fflush(NULL);
-  }
+  int out[2] = {-1, -1};
+  if (option.capture_output && !open_output_pipe(out))
+    PANIC("Failed to create a pipe for the output of the command");
+  CgroupRun leaf = {.path = NULL, .dir = -1, .procs = -1, .join_ns = 0};
+  if (option.cgroup && !cgroup_run_create(&leaf))
+    PANIC("Failed to create a cgroup for the run: %s", strerror(errno));
 
-  if (gettimeofday(&wall_clock_start, NULL)) {
-    perror("could not get wall clock time");
-    PANIC("Exiting...");
-  }
+  start = monotonic_ns();
 
   // Goin' for a ride!
-  pid = fork();
-
-  if (pid == 0) {
-    if (!show_output) {
-      f = freopen("/dev/null", "r", stdin);
-      if (!f) PANIC("freopen failed on stdin");
-      f = freopen("/dev/null", "w", stderr);
-      if (!f) PANIC("freopen failed on stderr");
-      f = freopen("/dev/null", "w", stdout);
-      if (!f) PANIC("freopen failed on stdout");
-    }
-    execvp(args->args[0], args->args);
-    // The exec() functions return only if an error occurs, i.e. it
-    // could not launch args[0] (a command or the shell to run it)
-    PANIC("Exec failed");
+  pid_t pid = launch_into(option.launcher, plan, out[1], leaf.path ? &leaf : NULL);
+  if (pid < 0) e->launch_errno = errno;
+  // A child that had to move itself into its cgroup did so after
+  // 'start', and that is not part of the run
+  start += leaf.join_ns;
+  if (out[1] >= 0) close(out[1]);
+  // The child has called exec by now.  Where it is running tells us
+  // whether it moved to another type of core by the time it exits.
+  // Reading it costs a few μs of the wall clock time, so we do it
+  // only when asked (--cpu-state) and when there are two core types.
+  if ((pid > 0) && option.cpu_state && cpustate_hybrid())
+    e->first_cpu = child_cpu(pid);
+
+  if (pid > 0) {
+    // The output is drained until the child exits, which we may see
+    // before wait_for_exit() does
+    if (out[0] >= 0) drain_output(pid, out[0], deadline, &e->output);
+    e->err = wait_for_exit(pid, deadline, &e->status, &e->ru, &e->acct,
+			   &stop, &e->timed_out);
+    if ((out[0] >= 0) && (e->output.exit_ns >= 0) && (e->output.exit_ns < stop))
+      stop = e->output.exit_ns;
+  } else {
+    stop = monotonic_ns();
   }
-  
-  struct rusage from_os;
-  pid_t err = wait4(pid, &status, 0, &from_os);
+  if (out[0] >= 0) {
+    close(out[0]);
+    if (pid > 0)
+      e->ttfb_ns = (e->output.first_ns < 0) ? -1 : e->output.first_ns - start;
+  }
+  e->wall_ns = stop - start;
+  // The descendants' usage counts as the command's, but the wall
+  // clock time is still that of the command itself.  Stragglers that
+  // must be killed (at the deadline, or after a grace period) cut the
+  // run short, as a timeout does.
+  if (option.wait_descendants && (pid > 0)) {
+    if (deadline < 0) deadline = stop + DESCENDANT_GRACE_NS;
+    wait_for_descendants(pid, deadline, &e->orphans);
+    add_rusage(&e->ru, &e->orphans.ru);
+    e->orphans.last_exit_ns = (e->orphans.last_exit_ns < 0)
+      ? e->wall_ns : e->orphans.last_exit_ns - start;
+    if (e->orphans.killed) e->timed_out = true;
+  }
+  if (leaf.path) {
+    cgroup_run_read(&leaf, &e->cg);
+    e->leftovers = cgroup_run_remove(&leaf);
+  }
+}
 
-  if (gettimeofday(&wall_clock_stop, NULL)) {
-    perror("could not get wall clock time");
-    PANIC("Exiting...");
+// The resource usage of a run that repeats the command is the sum
+// over its executions, except for max RSS, which is the largest
+static void add_timeval(struct timeval *sum, const struct timeval *tv) {
+  sum->tv_sec += tv->tv_sec;
+  sum->tv_usec += tv->tv_usec;
+  if (sum->tv_usec >= MICROSECS) {
+    sum->tv_sec++;
+    sum->tv_usec -= MICROSECS;
   }
+}
 
-  start = wall_clock_start.tv_sec * MICROSECS + wall_clock_start.tv_usec;
-  stop = wall_clock_stop.tv_sec * MICROSECS + wall_clock_stop.tv_usec;
-  set_int64(usage, idx, F_WALL, stop - start);
+static void add_rusage(struct rusage *sum, const struct rusage *ru) {
+  add_timeval(&sum->ru_utime, &ru->ru_utime);
+  add_timeval(&sum->ru_stime, &ru->ru_stime);
+  if (ru->ru_maxrss > sum->ru_maxrss) sum->ru_maxrss = ru->ru_maxrss;
+  sum->ru_minflt += ru->ru_minflt;
+  sum->ru_majflt += ru->ru_majflt;
+  sum->ru_nvcsw += ru->ru_nvcsw;
+  sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+// Each accounting field is the sum over the executions, or -1 if any
+// execution did not have it
+static void add_acct(ChildAcct *sum, const ChildAcct *acct) {
+  int64_t *s[] = {&sum->read_bytes, &sum->write_bytes,
+		  &sum->syscr, &sum->syscw, &sum->blkio_us,
+		  &sum->oncpu_ns, &sum->runq_ns, &sum->slices};
+  const int64_t *v[] = {&acct->read_bytes, &acct->write_bytes,
+			&acct->syscr, &acct->syscw, &acct->blkio_us,
+			&acct->oncpu_ns, &acct->runq_ns, &acct->slices};
+  for (size_t i = 0; i < sizeof(s) / sizeof(s[0]); i++)
+    *s[i] = ((*s[i] >= 0) && (*v[i] >= 0)) ? *s[i] + *v[i] : -1;
+}
+
+// Time to first byte is summed like the rest, but it is -1 if any
+// execution wrote nothing.  (The sum uses 'first_ns' for it.)
+static void add_output(ChildOutput *sum, const Execution *e) {
+  if (e->ttfb_ns < 0) sum->first_ns = -1;
+  if (sum->first_ns >= 0) sum->first_ns += e->ttfb_ns;
+  sum->bytes += e->output.bytes;
+  sum->drain_ns += e->output.drain_ns;
+  sum->full += e->output.full;
+}
+
+// The cgroup totals are summed too, except the memory peak, which is
+// the largest.  As with add_acct(), a field is -1 if any is -1.
+static void add_cgroup(CgroupStats *sum, const Execution *e) {
+  int64_t *s[] = {&sum->cpu_us, &sum->read_bytes, &sum->write_bytes,
+		  &sum->cpu_pressure_us, &sum->mem_pressure_us,
+		  &sum->io_pressure_us, &sum->nr_throttled,
+		  &sum->throttled_us, &sum->mem_high_events,
+		  &sum->mem_max_events, &sum->oom_kills};
+  const int64_t *v[] = {&e->cg.cpu_us, &e->cg.read_bytes, &e->cg.write_bytes,
+			&e->cg.cpu_pressure_us, &e->cg.mem_pressure_us,
+			&e->cg.io_pressure_us, &e->cg.nr_throttled,
+			&e->cg.throttled_us, &e->cg.mem_high_events,
+			&e->cg.mem_max_events, &e->cg.oom_kills};
+  for (size_t i = 0; i < sizeof(s) / sizeof(s[0]); i++)
+    *s[i] = ((*s[i] >= 0) && (*v[i] >= 0)) ? *s[i] + *v[i] : -1;
+  if ((sum->mem_peak < 0) || (e->cg.mem_peak < 0))
+    sum->mem_peak = -1;
+  else if (e->cg.mem_peak > sum->mem_peak)
+    sum->mem_peak = e->cg.mem_peak;
+}
+
+// What a run measured, over all of its executions
+typedef struct RunResult {
+  Execution     last;		// The last execution
+  int64_t       first_cpu;	// Where the first execution started
+  struct rusage ru;		// Summed (see add_rusage)
+  ChildAcct     acct;		// Summed (see add_acct)
+  ChildOutput   output;		// Summed (see add_output)
+  CgroupStats   cg;		// Summed (see add_cgroup)
+  int           leftovers;	// Summed
+  int           reaped;		// Summed
+  int           stragglers;	// Summed
+  int64_t       last_exit_ns;	// The latest
+  int64_t       wall_ns;
+  int           done;		// Number of executions
+  bool          sys_ok;		// Whether sys_before and sys_after were read
+  SysCPU        sys_before;	// With --interference
+  SysCPU        sys_after;
+} RunResult;
+
+static int record_run(Runner *runner, const char *cmd, const char *name,
+		      const LaunchPlan *plan, Usage *usage, int idx,
+		      int64_t batch, const RunResult *r);
+
+// A run executes the command 'repeat' times, back to back, and
+// stores the totals along with the number of executions.  (See
+// usage_per_execution() for how they are normalized.)  The executions
+// stop early if one does not complete or fails.
+static int execute(Runner *runner,
+		   const char *cmd,
+		   const char *name,
+		   const LaunchPlan *plan,
+		   int repeat,
+		   Usage *usage,
+		   int idx,
+		   int64_t batch) {
+  RunResult r = {.last = {.err = -1, .acct = {.cpu = -1}}, .first_cpu = -1,
+		 .acct = {0, 0, 0, 0, 0, 0, 0, 0, -1},
+		 .output = {.first_ns = 0}};
+  Execution *e = &r.last;
+
+  // The frequency of every CPU is read, because we learn which CPU
+  // the command ran on only at the end
+  if (option.cpu_state) cpustate_sample(&runner->before);
+
+  // System-wide CPU use across the run, for --interference
+  r.sys_ok = (option.interference > 0) && sysload_read(&r.sys_before);
+
+  int64_t deadline = (option.timeout > 0) ? monotonic_ns() + option.timeout : -1;
+  while (r.done < repeat) {
+    // Read the counters outside the wall clock interval.  Performance
+    // counters are not available with a fork server, because they
+    // start counting on exec.
+    if (!runner->server) counters_start(&runner->counters);
+    execute_once(runner, plan, deadline, e);
+    if (r.done == 0) r.first_cpu = e->first_cpu;
+    if (runner->server)
+      counters_skip(usage, idx);
+    else if (r.done == 0)
+      counters_stop(&runner->counters, usage, idx);
+    else
+      counters_stop_add(&runner->counters, usage, idx);
+    r.wall_ns += e->wall_ns;
+    r.done++;
+    if (e->err == -1) break;
+    add_rusage(&r.ru, &e->ru);
+    add_acct(&r.acct, &e->acct);
+    add_output(&r.output, e);
+    add_cgroup(&r.cg, e);
+    r.leftovers += e->leftovers;
+    r.reaped += e->orphans.reaped;
+    r.stragglers += e->orphans.stragglers;
+    if (e->orphans.last_exit_ns > r.last_exit_ns)
+      r.last_exit_ns = e->orphans.last_exit_ns;
+    if (!WIFEXITED(e->status) || (WEXITSTATUS(e->status) && !option.ignore_failure)
+	|| e->timed_out)
+      break;
+  }
+
+  if (r.sys_ok) r.sys_ok = sysload_read(&r.sys_after);
+  return record_run(runner, cmd, name, plan, usage, idx, batch, &r);
+}
+
+// Of the resource limits, only the CPU time limit can be told apart
+// from other failures.  The kernel sends SIGXCPU at the soft limit,
+// and SIGKILL at the hard limit (a second later, see child_setup()
+// in launch.c) if SIGXCPU was caught or ignored.  A program over its
+// address space or open files limit usually just fails, like any
+// other failure.
+static bool exceeded_cpu_limit(const Execution *e) {
+  if ((option.cpu_limit <= 0) || !WIFSIGNALED(e->status)) return false;
+  if (WTERMSIG(e->status) == SIGXCPU) return true;
+  int64_t used_us = (e->ru.ru_utime.tv_sec + e->ru.ru_stime.tv_sec) * MICROSECS
+    + e->ru.ru_utime.tv_usec + e->ru.ru_stime.tv_usec;
+  return (WTERMSIG(e->status) == SIGKILL)
+    && (used_us >= option.cpu_limit * MICROSECS);
+}
+
+// Store what a run measured in usage[idx].  Exits if the command
+// could not be executed, or failed (unless --ignore-failure).
+// Returns the exit code of the last execution, or 128+N if it was
+// killed by signal N.
+static int record_run(Runner *runner, const char *cmd, const char *name,
+		      const LaunchPlan *plan, Usage *usage, int idx,
+		      int64_t batch, const RunResult *r) {
+  int use_shell = *option.shell;
+  const Execution *e = &r->last;
+  struct rusage ru = r->ru;
+  struct rusage *from_os = &ru;
+  const ChildAcct *acct = &r->acct;
+  int64_t cpu = e->acct.cpu;
+  int64_t freq_end = option.cpu_state ? cpustate_freq(cpu) : -1;
+  int64_t temp_end = option.cpu_state ? cpustate_temp() : -1;
+
+  int status = e->status;
+  pid_t err = e->err;
+
+  // A run that was killed for taking too long, or for exceeding its
+  // CPU time limit, did not complete.  It is recorded but left out of
+  // the statistics.
+  RunStatus outcome = RUN_COMPLETED;
+  if ((err != -1) && e->timed_out)
+    outcome = RUN_TIMEOUT;
+  else if ((err != -1) && exceeded_cpu_limit(e))
+    outcome = RUN_LIMIT;
+
+  // Wall clock is stored in ns, and in μs for compatibility
+  set_int64(usage, idx, F_WALLNS, r->wall_ns);
+  set_int64(usage, idx, F_WALL, r->wall_ns / 1000);
 
   set_string(usage, idx, F_CMD, cmd);
   set_string(usage, idx, F_SHELL, option.shell);
   set_string(usage, idx, F_NAME, name);
   usage->data[idx].batch = batch;
 
-  // Check to see if cmd/shell aborted or was killed
-  if ((err == -1) || !WIFEXITED(status) || WIFSIGNALED(status)) {
-    fprintf(stderr, "Error: Could not execute %s '%s'.\n",
+  // Check to see if cmd/shell could not be launched, aborted, or was killed
+  if ((err == -1) ||
+      ((outcome == RUN_COMPLETED) && (!WIFEXITED(status) || WIFSIGNALED(status)))) {
+    fprintf(stderr, "Error: Could not execute %s '%s'%s%s.\n",
 	    use_shell ? "shell" : "command",
-	    use_shell ? option.shell : cmd);
+	    use_shell ? option.shell : cmd,
+	    e->launch_errno ? ": " : "",
+	    e->launch_errno ? strerror(e->launch_errno) : "");
 
     if (!*option.shell) {
       fprintf(stderr, "\nHint: No shell option specified.  Use -%s or --%s to specify a shell.\n",
@@ -215,28 +492,103 @@ static int run(int num, Usage *usage, int idx, int64_t batch) {
     exit(ERR_RUNTIME);
   }
 
-  set_int64(usage, idx, F_CODE, WEXITSTATUS(status));
+  // Like the shells, we report death by signal N as exit code 128+N
+  if (outcome == RUN_COMPLETED)
+    set_int64(usage, idx, F_CODE, WEXITSTATUS(status));
+  else
+    set_int64(usage, idx, F_CODE, 128 + WTERMSIG(status));
+  set_int64(usage, idx, F_STATUS, outcome);
   
   // Fill the rest of the usage metrics from what the OS reported
-  set_int64(usage, idx, F_USER, rusertime(&from_os));
-  set_int64(usage, idx, F_SYSTEM, rsystemtime(&from_os));
-  set_int64(usage, idx, F_TOTAL, rusertime(&from_os) + rsystemtime(&from_os));
-  set_int64(usage, idx, F_MAXRSS, rmaxrss(&from_os));
-  set_int64(usage, idx, F_RECLAIMS, rminflt(&from_os));
-  set_int64(usage, idx, F_FAULTS, rmajflt(&from_os));
-  set_int64(usage, idx, F_VCSW, rvcsw(&from_os));
-  set_int64(usage, idx, F_ICSW, ricsw(&from_os));
-  set_int64(usage, idx, F_TCSW, rvcsw(&from_os) + ricsw(&from_os)); 
-
-  // If we get here, the child process exited normally, though the
-  // exit code might not be zero (and zero indicates success)
-  if (!option.ignore_failure && WEXITSTATUS(status)) {
+  set_int64(usage, idx, F_USER, rusertime(from_os));
+  set_int64(usage, idx, F_SYSTEM, rsystemtime(from_os));
+  set_int64(usage, idx, F_TOTAL, rusertime(from_os) + rsystemtime(from_os));
+  set_int64(usage, idx, F_MAXRSS, rmaxrss(from_os));
+  set_int64(usage, idx, F_RECLAIMS, rminflt(from_os));
+  set_int64(usage, idx, F_FAULTS, rmajflt(from_os));
+  set_int64(usage, idx, F_VCSW, rvcsw(from_os));
+  set_int64(usage, idx, F_ICSW, ricsw(from_os));
+  set_int64(usage, idx, F_TCSW, rvcsw(from_os) + ricsw(from_os)); 
+
+  set_int64(usage, idx, F_READBYTES, acct->read_bytes);
+  set_int64(usage, idx, F_WRITEBYTES, acct->write_bytes);
+  set_int64(usage, idx, F_SYSCR, acct->syscr);
+  set_int64(usage, idx, F_SYSCW, acct->syscw);
+  set_int64(usage, idx, F_BLKIO, acct->blkio_us);
+  set_int64(usage, idx, F_ONCPU, acct->oncpu_ns);
+  set_int64(usage, idx, F_RUNQ, acct->runq_ns);
+  set_int64(usage, idx, F_SLICES, acct->slices);
+
+  set_int64(usage, idx, F_LASTCPU, cpu);
+  set_int64(usage, idx, F_CORETYPE, cpustate_core_type(cpu));
+  set_int64(usage, idx, F_STARTTYPE, cpustate_core_type(r->first_cpu));
+  if (option.cpu_state && (cpu >= 0) && (cpu < MAXCPUSTATE))
+    set_int64(usage, idx, F_FREQSTART, runner->before.freq_khz[cpu]);
+  else
+    set_int64(usage, idx, F_FREQSTART, -1);
+  set_int64(usage, idx, F_FREQEND, freq_end);
+  set_int64(usage, idx, F_TEMPSTART, option.cpu_state ? runner->before.temp_mc : -1);
+  set_int64(usage, idx, F_TEMPEND, temp_end);
+
+  set_int64(usage, idx, F_QUIETWAIT, -1);
+  set_int64(usage, idx, F_BUSY, -1);
+  set_int64(usage, idx, F_LOADAVG, -1);
+  set_int64(usage, idx, F_CACHE, -1);
+  set_int64(usage, idx, F_CACHED, -1);
+  bool captured = option.capture_output && !runner->server;
+  set_int64(usage, idx, F_TTFB, captured ? r->output.first_ns : -1);
+  set_int64(usage, idx, F_OUTBYTES, captured ? r->output.bytes : -1);
+  set_int64(usage, idx, F_DRAINCPU, captured ? r->output.drain_ns : -1);
+  set_int64(usage, idx, F_PIPEFULL, captured ? r->output.full : -1);
+  set_outrate(usage, idx);
+  set_int64(usage, idx, F_SCHEDULED, -1);
+  set_int64(usage, idx, F_LAG, -1);
+  set_int64(usage, idx, F_INFLIGHT, -1);
+  set_int64(usage, idx, F_LATENCY, -1);
+  set_int64(usage, idx, F_CONCURRENCY, -1);
+  bool cg = option.cgroup && (err != -1);
+  set_int64(usage, idx, F_CGCPU, cg ? r->cg.cpu_us : -1);
+  set_int64(usage, idx, F_CGMEMPEAK, cg ? r->cg.mem_peak : -1);
+  set_int64(usage, idx, F_CGREAD, cg ? r->cg.read_bytes : -1);
+  set_int64(usage, idx, F_CGWRITE, cg ? r->cg.write_bytes : -1);
+  set_int64(usage, idx, F_PSICPU, cg ? r->cg.cpu_pressure_us : -1);
+  set_int64(usage, idx, F_PSIMEM, cg ? r->cg.mem_pressure_us : -1);
+  set_int64(usage, idx, F_PSIIO, cg ? r->cg.io_pressure_us : -1);
+  set_int64(usage, idx, F_CGLEFT, cg ? r->leftovers : -1);
+  set_int64(usage, idx, F_THROTTLED, cg ? r->cg.nr_throttled : -1);
+  set_int64(usage, idx, F_THROTTLEDUS, cg ? r->cg.throttled_us : -1);
+  set_int64(usage, idx, F_MEMHIGH, cg ? r->cg.mem_high_events : -1);
+  set_int64(usage, idx, F_MEMMAX, cg ? r->cg.mem_max_events : -1);
+  set_int64(usage, idx, F_OOMKILL, cg ? r->cg.oom_kills : -1);
+  bool orphans = option.wait_descendants && (err != -1);
+  set_int64(usage, idx, F_REAPED, orphans ? r->reaped : -1);
+  set_int64(usage, idx, F_STRAGGLERS, orphans ? r->stragglers : -1);
+  set_int64(usage, idx, F_LASTEXIT, orphans ? r->last_exit_ns : -1);
+  if (r->sys_ok) {
+    int64_t child_ns = (rusertime(from_os) + rsystemtime(from_os)) * 1000;
+    double others = sysload_interference(&r->sys_before, &r->sys_after, child_ns);
+    set_int64(usage, idx, F_INTERFERENCE, (int64_t) (others + 0.5));
+  } else {
+    set_int64(usage, idx, F_INTERFERENCE, -1);
+  }
+  set_offcpu(usage, idx);
+
+  set_int64(usage, idx, F_FORKED, runner->server ? 1 : 0);
+  set_int64(usage, idx, F_REPEAT, r->done);
+  set_int64(usage, idx, F_CORE, runner->core);
+  set_int64(usage, idx, F_STOP, -1);
+  set_ipc(usage, idx);
+
+  // If we get here, the child process exited normally (or was killed
+  // by us or a resource limit), though the exit code might not be
+  // zero (and zero indicates success)
+  if ((outcome == RUN_COMPLETED) && !option.ignore_failure && WEXITSTATUS(status)) {
 
     if (use_shell) 
       fprintf(stderr,
 	      "\nExecuting command under %s produced"
 	      " non-zero exit code %d.\n",
-	      args->args[0], WEXITSTATUS(status));
+	      plan->args->args[0], WEXITSTATUS(status));
     else
       fprintf(stderr,
 	      "\nExecuting command produced non-zero"
@@ -255,11 +607,223 @@ static int run(int num, Usage *usage, int idx, int64_t batch) {
     exit(ERR_RUNTIME);
   }
 
-  free_arglist(args);
-  return WEXITSTATUS(status);
+  return (outcome == RUN_COMPLETED) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
 }
 
-static Usage *run_command(Usage *usage, int num, FILE *output) {
+// -----------------------------------------------------------------------------
+// Repeated executions (--repeat)
+// -----------------------------------------------------------------------------
+
+// When a command takes only tens of microseconds, the granularity of
+// the CPU times reported by the OS swamps what we want to measure.
+// Each run can instead execute the command several times in a row.
+// Choosing automatically, we repeat the command enough times that a
+// run spans many clock ticks, judging by a few pilot executions.
+
+#define REPEAT_PILOTS 3
+#define REPEAT_TICKS 100
+#define REPEAT_MIN_NS (1000 * 1000)
+
+// Executions per run of each command
+static int repeats[MAXCMDS];
+
+static void choose_repeat(Runner *runner, int num, const LaunchPlan *plan) {
+  if (option.repeat != REPEAT_AUTO) {
+    repeats[num] = option.repeat;
+    return;
+  }
+  int64_t target = REPEAT_TICKS * rusage_resolution_us() * 1000;
+  if (target < REPEAT_MIN_NS) target = REPEAT_MIN_NS;
+
+  Usage *pilot = new_usage_array(REPEAT_PILOTS);
+  int64_t X[REPEAT_PILOTS];
+  for (int i = 0; i < REPEAT_PILOTS; i++) {
+    int idx = usage_next(pilot);
+    execute(runner, option.commands[num], option.names[num],
+	    plan, 1, pilot, idx, 0);
+    X[i] = get_int64(pilot, idx, F_WALLNS);
+  }
+  free_usage_array(pilot);
+  qsort(X, REPEAT_PILOTS, sizeof(int64_t), compare_int64);
+  int64_t each = (X[REPEAT_PILOTS / 2] > 0) ? X[REPEAT_PILOTS / 2] : 1;
+  int64_t k = (target + each - 1) / each;
+  repeats[num] = (int) ((k > MAXREPEAT) ? MAXREPEAT : k);
+}
+
+// -----------------------------------------------------------------------------
+// Page cache (--cache)
+// -----------------------------------------------------------------------------
+
+// The files of each command are found before its first run: the
+// executable (or the shell), the libraries they need, and the files
+// named with --cache-file.  Under a shell, the first word of the
+// command is taken to be its executable, if one can be found.
+static CacheFiles *cache_files[MAXCMDS];
+
+static CacheFiles *command_files(int num, const LaunchPlan *plan) {
+  if (cache_files[num]) return cache_files[num];
+  CacheFiles *cf = new_cache_files();
+  cache_files_add_executable(cf, plan->path);
+  if (*option.shell) {
+    LaunchPlan *direct = new_launch_plan("", option.commands[num], true);
+    cache_files_add_executable(cf, direct->path);
+    free_launch_plan(direct);
+  }
+  for (int i = 0; i < option.n_cache_files; i++)
+    cache_files_add(cf, option.cache_files[i]);
+  cache_files[num] = cf;
+  return cf;
+}
+
+// -----------------------------------------------------------------------------
+
+// A run of a command (warmup or timed) follows its prepare command,
+// and with --quiet, waits for a quiet system.  Other processes keep
+// running, so the system may be busy again by the time the command
+// starts, but rarely as busy as it was.  With --cache, the page cache
+// is made cold or warm last, just before the command starts.
+static int run(Runner *runner,
+	       int num,
+	       const LaunchPlan *plan,
+	       const LaunchPlan *prep,
+	       Usage *usage,
+	       int idx,
+	       int64_t batch) {
+  run_prep_command(prep);
+  int64_t quiet_ns = -1;
+  double busy = -1;
+  if (option.quiet > 0) quiet_ns = wait_for_quiet(option.quiet, &busy);
+  int64_t loadavg = (option.quiet > 0) ? sysload_loadavg() : -1;
+  int64_t cached = -1;
+  if (option.cache > 0) {
+    CacheFiles *cf = command_files(num, plan);
+    if (option.cache == CACHE_COLD)
+      cache_evict(cf);
+    else
+      cache_preload(cf);
+    cached = cache_resident_pct(cf);
+  }
+  int code = execute(runner, option.commands[num], option.names[num],
+		     plan, repeats[num], usage, idx, batch);
+  if (quiet_ns >= 0) {
+    set_int64(usage, idx, F_QUIETWAIT, quiet_ns / 1000);
+    set_int64(usage, idx, F_BUSY, (busy < 0) ? -1 : (int64_t) (busy + 0.5));
+    set_int64(usage, idx, F_LOADAVG, loadavg);
+  }
+  if (option.cache > 0) {
+    set_int64(usage, idx, F_CACHE, option.cache);
+    set_int64(usage, idx, F_CACHED, cached);
+  }
+  return code;
+}
+
+// -----------------------------------------------------------------------------
+// Interference (--interference)
+// -----------------------------------------------------------------------------
+
+// Even on a quiet system, another process can wake up in the middle
+// of a run.  With --interference, we measure how much CPU time other
+// processes used during each timed run, and a run that completed
+// while they were too busy is flagged and done again, up to a limit
+// per command.  The flagged runs stay in the raw data, which is
+// written as they finish.  Returns the index of the last run.
+
+// Re-runs of each command so far
+static int reruns[MAXCMDS];
+
+static int timed_run(Runner *runner,
+		     int num,
+		     const LaunchPlan *plan,
+		     const LaunchPlan *prep,
+		     Usage *usage,
+		     int64_t batch,
+		     FILE *output) {
+  int idx = usage_next(usage);
+  run(runner, num, plan, prep, usage, idx, batch);
+  while ((option.interference > 0)
+	 && (get_int64(usage, idx, F_STATUS) == RUN_COMPLETED)
+	 && (get_int64(usage, idx, F_INTERFERENCE) > option.interference)) {
+    set_int64(usage, idx, F_STATUS, RUN_INTERFERED);
+    if (reruns[num] >= option.max_reruns) break;
+    reruns[num]++;
+    if (output) write_line(output, usage, idx);
+    idx = usage_next(usage);
+    run(runner, num, plan, prep, usage, idx, batch);
+  }
+  return idx;
+}
+
+// -----------------------------------------------------------------------------
+// Harness overhead (--calibrate)
+// -----------------------------------------------------------------------------
+
+// Every measurement includes the cost of launching the command and
+// waiting for it, and (with a shell) of starting the shell.  We
+// measure that cost by timing a null command, so that it can be
+// subtracted from the results.  The calibration runs are not part of
+// the raw data, but their summary is recorded in its metadata.
+
+#define CALIBRATION_WARMUPS 5
+#define CALIBRATION_RUNS 100
+#define NULL_COMMAND "true"
+
+static Calibration calibration;
+
+static void measure_overhead(const char *shell, const char *cmd, Overhead *o) {
+  static Runner runner = {.core = -1};
+  LaunchPlan *plan = new_run_plan(shell, cmd);
+  Usage *usage = new_usage_array(CALIBRATION_WARMUPS);
+  for (int i = 0; i < CALIBRATION_WARMUPS; i++)
+    execute(&runner, cmd, cmd, plan, 1, usage, usage_next(usage), 0);
+  free_usage_array(usage);
+  usage = new_usage_array(CALIBRATION_RUNS);
+  for (int i = 0; i < CALIBRATION_RUNS; i++)
+    execute(&runner, cmd, cmd, plan, 1, usage, usage_next(usage), 0);
+  Summary *s = summarize(usage, 0, usage->next);
+  if (!s) PANIC("Failed to summarize calibration runs");
+  o->runs = s->runs;
+  o->total = s->total;
+  o->wall = s->wall;
+  free_summary(s);
+  free_usage_array(usage);
+  free_launch_plan(plan);
+}
+
+// The shell measurement runs an empty command, like the one that
+// bestguess suggests for measuring shell startup.
+static void calibrate(void) {
+  measure_overhead("", NULL_COMMAND, &calibration.plain);
+  if (*option.shell)
+    measure_overhead(option.shell, "", &calibration.shell);
+  if (any_per_command_output())
+    print_overhead(&calibration);
+}
+
+// -----------------------------------------------------------------------------
+// Fork server (--fork-server)
+// -----------------------------------------------------------------------------
+
+static ForkServer *start_server(const char *cmd, const LaunchPlan *plan) {
+  if (!plan->path)
+    ERROR("Command '%s' not found", cmd);
+  char *lib = fork_server_lib();
+  if (!lib)
+    ERROR("Fork server library %s not found (it is installed with %s)",
+	  FORKSERVER_LIB, progname);
+  ForkServer *fs = start_fork_server(option.launcher, plan, lib);
+  free(lib);
+  if (!fs)
+    ERROR("Command '%s' did not start a fork server"
+	  " (it must be a dynamically linked program that uses glibc)", cmd);
+  return fs;
+}
+
+// -----------------------------------------------------------------------------
+
+static Usage *run_command(Usage *usage, int num,
+			  const LaunchPlan *prep, FILE *output) {
+
+  static Runner runner = {.core = -1};
 
   const char *cmd = option.commands[num];
   const char *name = option.names[num];
@@ -268,27 +832,777 @@ static Usage *run_command(Usage *usage, int num, FILE *output) {
   if (any_per_command_output())
     announce_command(name, cmd, num);
 
+  // One plan serves all the warmups and timed runs of this command
+  LaunchPlan *plan = new_run_plan(option.shell, cmd);
+  if (option.fork_server)
+    runner.server = start_server(cmd, plan);
+  choose_repeat(&runner, num, plan);
+
   Usage *dummy = new_usage_array(option.warmups);
   int idx;
   for (int i = 0; i < option.warmups; i++) {
     idx = usage_next(dummy);
-    run(num, dummy, idx, batch);
+    run(&runner, num, plan, prep, dummy, idx, batch);
   }
   free_usage_array(dummy);
 
-  for (int i = 0; i < option.runs; i++) {
-    idx = usage_next(usage);
-    run(num, usage, idx, batch);
+  // With an adaptive run count, we keep the target metric in order
+  // as the runs finish, and stop once the confidence interval for
+  // its median is narrow enough.
+  int runs = option.adaptive ? option.max_runs : option.runs;
+  OrderedSample *sample = NULL;
+  if (option.adaptive)
+    sample = new_ordered_sample(option.min_runs, config.alpha);
+
+  StopReason reason = option.adaptive ? STOP_MAXRUNS : STOP_FIXED;
+  for (int i = 0; i < runs; i++) {
+    idx = timed_run(&runner, num, plan, prep, usage, batch, output);
+    bool last = (i == runs - 1);
+    if (sample && COMPLETED(usage, idx)) {
+      ordered_sample_add(sample, get_int64(usage, idx, option.target_metric)
+			 / usage_repeats(usage, idx));
+      if (sample->n >= option.min_runs) {
+	double ci = median_ci_relative(sample);
+	if ((ci >= 0) && (ci <= option.target_ci)) {
+	  reason = STOP_CONVERGED;
+	  last = true;
+	}
+      }
+    }
+    if (last) set_int64(usage, idx, F_STOP, reason);
     if (output) write_line(output, usage, idx);
+    if (last) break;
   }
 
+  free_ordered_sample(sample);
+  stop_fork_server(runner.server);
+  runner.server = NULL;
+  free_launch_plan(plan);
+
   return usage;
 }
 
+// -----------------------------------------------------------------------------
+// Interleaved and random order (--order)
+// -----------------------------------------------------------------------------
+
+// When all the runs of one command are done before the next command
+// starts, slow drift in the system (thermal throttling, frequency
+// scaling, background load) favors whichever command ran at the
+// better time.  Doing the commands in rounds spreads that drift over
+// all of them, and shuffling each round also removes any bias from
+// one command always following another.
+
+// SplitMix64 is small, fast, and gives the same sequence on every
+// platform, so that a seed reproduces the same order anywhere.
+static uint64_t random_state;
+
+static uint64_t next_random(void) {
+  uint64_t z = (random_state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Fill 'order' with the command numbers in the order they will run
+// in the next round
+static void next_round(int *order, int n) {
+  for (int k = 0; k < n; k++) order[k] = k;
+  if (option.order != orderRandom) return;
+  for (int k = n - 1; k > 0; k--) {
+    int j = (int) (next_random() % (uint64_t) (k + 1));
+    int tmp = order[k];
+    order[k] = order[j];
+    order[j] = tmp;
+  }
+}
+
+// Usage must be empty.  Runs are written to 'output' as they finish.
+// On return, the runs in 'usage' are grouped by command, in command
+// order.
+static void run_interleaved(Usage *usage, const LaunchPlan *prep,
+			    FILE *output) {
+  static Runner runner = {.core = -1};
+
+  int n = option.n_commands;
+  LaunchPlan **plans = malloc(n * sizeof(LaunchPlan *));
+  int64_t *batches = malloc(n * sizeof(int64_t));
+  int *order = malloc(n * sizeof(int));
+  if (!plans || !batches || !order) PANIC_OOM();
+  for (int k = 0; k < n; k++) {
+    plans[k] = new_run_plan(option.shell, option.commands[k]);
+    batches[k] = next_batch_number();
+    choose_repeat(&runner, k, plans[k]);
+  }
+
+  Usage *dummy = new_usage_array(n * option.warmups);
+  for (int i = 0; i < option.warmups; i++) {
+    next_round(order, n);
+    for (int j = 0; j < n; j++)
+      run(&runner, order[j], plans[order[j]], prep,
+	  dummy, usage_next(dummy), batches[order[j]]);
+  }
+  free_usage_array(dummy);
+
+  for (int i = 0; i < option.runs; i++) {
+    next_round(order, n);
+    for (int j = 0; j < n; j++) {
+      int k = order[j];
+      int idx = timed_run(&runner, k, plans[k], prep, usage, batches[k], output);
+      if (i == option.runs - 1) set_int64(usage, idx, F_STOP, STOP_FIXED);
+      if (output) write_line(output, usage, idx);
+    }
+  }
+  group_by_batch(usage, 0, usage->next);
+
+  for (int k = 0; k < n; k++) free_launch_plan(plans[k]);
+  free(plans);
+  free(batches);
+  free(order);
+}
+
+// -----------------------------------------------------------------------------
+// Open loop (--rate)
+// -----------------------------------------------------------------------------
+
+// Normally each run starts when the previous one ends (a closed
+// loop).  A slow run then delays the runs after it, so it is measured
+// once when it should have been felt by every run it held up.  This
+// is "coordinated omission".  With --rate, runs start on a schedule
+// that does not depend on how long they take, several may be in
+// flight at once, and each is reaped when it exits.  The latency of a
+// run is measured from its scheduled start, so any time it spent
+// waiting to be launched (e.g. because --max-inflight runs were
+// already in flight) counts against it.  The wall clock time of a run
+// is from its actual start, which is its service time.
+
+typedef struct InFlight {
+  int     idx;			// Row in the usage array
+  int64_t scheduled_ns;
+  int64_t start_ns;
+  int     others;		// Runs in flight when this one started
+} InFlight;
+
+// Start times are offsets from 'first'.  Evenly spaced starts are
+// computed from 'first' so that rounding does not accumulate.
+static int64_t next_arrival(int64_t first, int64_t prev, int k) {
+  if (option.arrivals == arrivalsConstant)
+    return first + (int64_t) ((double) k * NANOSECS / option.rate);
+  // Uniform on (0, 1], from the top 53 bits
+  double u = ((double) (next_random() >> 11) + 1.0) / 9007199254740992.0;
+  return prev + (int64_t) (-log(u) * NANOSECS / option.rate);
+}
+
+static void reap_in_flight(Runner *runner, int num, const LaunchPlan *plan,
+			   Usage *usage, int64_t batch, int64_t first,
+			   pid_t pid, const InFlight *f) {
+  RunResult r = {.output = {.first_ns = -1}, .done = 1};
+  Execution *e = &r.last;
+  e->acct = (ChildAcct) {-1, -1, -1, -1, -1, -1, -1, -1, -1};
+  e->ttfb_ns = -1;
+  int64_t exit_ns;
+  e->err = wait_for_exit(pid, -1, &e->status, &e->ru, &e->acct,
+			 &exit_ns, &e->timed_out);
+  e->wall_ns = exit_ns - f->start_ns;
+  r.ru = e->ru;
+  r.acct = e->acct;
+  r.wall_ns = e->wall_ns;
+  counters_skip(usage, f->idx);
+  record_run(runner, option.commands[num], option.names[num],
+	     plan, usage, f->idx, batch, &r);
+  set_int64(usage, f->idx, F_SCHEDULED, f->scheduled_ns - first);
+  set_int64(usage, f->idx, F_LAG, f->start_ns - f->scheduled_ns);
+  set_int64(usage, f->idx, F_INFLIGHT, f->others);
+  set_int64(usage, f->idx, F_LATENCY, exit_ns - f->scheduled_ns);
+}
+
+// Warmups run in a closed loop.  The timed runs are written to
+// 'output' in the order they started, once all have finished.
+static Usage *run_open_loop(Usage *usage, int num, FILE *output) {
+  static Runner runner = {.core = -1};
+
+  const char *cmd = option.commands[num];
+  int64_t batch = next_batch_number();
+
+  if (any_per_command_output())
+    announce_command(option.names[num], cmd, num);
+
+  LaunchPlan *plan = new_run_plan(option.shell, cmd);
+  choose_repeat(&runner, num, plan);
+
+  Usage *dummy = new_usage_array(option.warmups);
+  for (int i = 0; i < option.warmups; i++)
+    run(&runner, num, plan, NULL, dummy, usage_next(dummy), batch);
+  free_usage_array(dummy);
+
+  pid_t pids[MAXINFLIGHT];
+  int pidfds[MAXINFLIGHT];
+  InFlight flights[MAXINFLIGHT];
+  int inflight = 0, launched = 0;
+  int start = usage->next;
+  int64_t first = monotonic_ns();
+  int64_t due = first;
+
+  while ((launched < option.runs) || (inflight > 0)) {
+    while ((launched < option.runs) && (inflight < option.max_inflight)
+	   && (monotonic_ns() >= due)) {
+      InFlight *f = &flights[inflight];
+      f->idx = usage_next(usage);
+      f->scheduled_ns = due;
+      f->others = inflight;
+      f->start_ns = monotonic_ns();
+      pid_t pid = launch(option.launcher, plan);
+      if (pid < 0) {
+	// Reports the error and exits
+	RunResult r = {.last = {.err = -1, .launch_errno = errno}};
+	record_run(&runner, cmd, option.names[num], plan, usage, f->idx, batch, &r);
+      }
+      pids[inflight] = pid;
+      pidfds[inflight] = open_pidfd(pid);
+      inflight++;
+      launched++;
+      due = next_arrival(first, due, launched);
+    }
+    // Sleep until the next start is due, unless we are at the limit
+    bool can_launch = (launched < option.runs) && (inflight < option.max_inflight);
+    int i = wait_for_any(pids, pidfds, inflight, can_launch ? due : -1);
+    if (i < 0) continue;
+    reap_in_flight(&runner, num, plan, usage, batch, first, pids[i], &flights[i]);
+    if (pidfds[i] >= 0) close(pidfds[i]);
+    inflight--;
+    pids[i] = pids[inflight];
+    pidfds[i] = pidfds[inflight];
+    flights[i] = flights[inflight];
+  }
+
+  if (usage->next > start)
+    set_int64(usage, usage->next - 1, F_STOP, STOP_FIXED);
+  if (output)
+    for (int idx = start; idx < usage->next; idx++)
+      write_line(output, usage, idx);
+
+  free_launch_plan(plan);
+  return usage;
+}
+
+// -----------------------------------------------------------------------------
+// Parallel mode (--jobs N)
+// -----------------------------------------------------------------------------
+
+// Each warmup and each timed run is a task, numbered so that the
+// tasks for command 0 come first.  All of the warmups are done
+// before any timed run starts, so that no command's warmups overlap
+// (or follow) another command's timed runs.  Every slot in the usage
+// arrays is allocated before the workers start, and each task writes
+// only to its own slot, so the results are in the same order as a
+// serial experiment.
+
+typedef struct Experiment {
+  LaunchPlan       **plans;	// One per command
+  const LaunchPlan  *prep;	// Can be NULL
+  int64_t           *batches;	// One per command
+  Usage             *usage;	// option.runs slots per command
+  Usage             *warmups;	// option.warmups slots per command
+  Runner            *runners;	// One per worker
+} Experiment;
+
+static void run_warmup_task(int task, int worker, void *context) {
+  Experiment *e = context;
+  int num = task / option.warmups;
+  run(&e->runners[worker], num, e->plans[num], e->prep,
+      e->warmups, task, e->batches[num]);
+}
+
+static void run_timed_task(int task, int worker, void *context) {
+  Experiment *e = context;
+  int num = task / option.runs;
+  run(&e->runners[worker], num, e->plans[num], e->prep,
+      e->usage, task, e->batches[num]);
+}
+
+// Usage must be empty.  On return, it holds option.runs results for
+// each command, in command order.
+static void run_parallel(Usage *usage, const LaunchPlan *prep) {
+  int cores[MAXJOBS];
+  if (!select_cores(option.jobs, cores))
+    USAGE("Cannot run %d jobs at once: not enough cores available%s",
+	  option.jobs,
+#ifdef __linux__
+	  ""
+#else
+	  " (pinning to cores is supported only on Linux)"
+#endif
+	  );
+
+  int n = option.n_commands;
+  Experiment e = {.prep = prep};
+  e.plans = malloc(n * sizeof(LaunchPlan *));
+  e.batches = malloc(n * sizeof(int64_t));
+  e.runners = malloc(option.jobs * sizeof(Runner));
+  if (!e.plans || !e.batches || !e.runners) PANIC_OOM();
+  Runner pilot = {.core = -1};
+  for (int k = 0; k < n; k++) {
+    e.plans[k] = new_run_plan(option.shell, option.commands[k]);
+    e.batches[k] = next_batch_number();
+    choose_repeat(&pilot, k, e.plans[k]);
+  }
+  for (int w = 0; w < option.jobs; w++)
+    e.runners[w] = (Runner){.core = cores[w]};
+
+  e.usage = usage;
+  for (int i = 0; i < n * option.runs; i++) usage_next(usage);
+  e.warmups = new_usage_array(n * option.warmups);
+  for (int i = 0; i < n * option.warmups; i++) usage_next(e.warmups);
+
+  if (option.warmups > 0)
+    run_jobs(option.jobs, cores, n * option.warmups, run_warmup_task, &e);
+  run_jobs(option.jobs, cores, n * option.runs, run_timed_task, &e);
+  for (int k = 0; k < n; k++)
+    set_int64(usage, (k + 1) * option.runs - 1, F_STOP, STOP_FIXED);
+
+  for (int k = 0; k < n; k++) free_launch_plan(e.plans[k]);
+  free(e.plans);
+  free(e.batches);
+  free(e.runners);
+  free_usage_array(e.warmups);
+}
+
+// -----------------------------------------------------------------------------
+// Concurrency sweep (--sweep)
+// -----------------------------------------------------------------------------
+
+// How a command scales when several copies run at once depends on
+// what they share: locks, caches, memory bandwidth, the disk.  A
+// sweep runs each command at concurrency 1, 2, 4, and so on, up to
+// the number of cores that runs may use (or --sweep N).  At each
+// level, that many workers, each pinned to its own core, do
+// option.runs runs apiece, back to back.  Each level is a batch of
+// its own, named for its concurrency, so it is summarized (and
+// ranked) like a separate command.  See report_sweep().
+
+static void report_command(Usage *usage, int start, int end,
+			   FILE *csv_output, FILE *hf_output);
+
+typedef struct Level {
+  int               num;	// Command number
+  const LaunchPlan *plan;
+  const LaunchPlan *prep;	// Can be NULL
+  int64_t           batch;
+  int               concurrency;
+  int               base;	// First slot in 'usage'
+  Usage            *usage;
+  Runner           *runners;	// One per worker
+} Level;
+
+static void sweep_task(int task, int worker, void *context) {
+  Level *l = context;
+  int idx = l->base + task;
+  run(&l->runners[worker], l->num, l->plan, l->prep, l->usage, idx, l->batch);
+  set_int64(l->usage, idx, F_CONCURRENCY, l->concurrency);
+}
+
+static int sweep_limit(void) {
+  if (option.sweep != SWEEP_AUTO) return option.sweep;
+  int cpus[MAXJOBS];
+  int n = restricted_cpus(cpus);
+  if (n == 0) n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  return (n < 1) ? 1 : ((n > MAXJOBS) ? MAXJOBS : n);
+}
+
+// Warmups are done first, one at a time.  The runs of each level are
+// written to 'output' and reported as the level finishes, and the
+// sweep as a whole is reported at the end.
+static void run_sweep(Usage *usage, int num, const LaunchPlan *prep,
+		      FILE *output, FILE *csv_output, FILE *hf_output) {
+  static Runner pilot = {.core = -1};
+
+  int limit = sweep_limit();
+  int cores[MAXJOBS];
+  if (!select_cores(limit, cores))
+    USAGE("Cannot sweep up to %d runs at once: not enough cores available%s",
+	  limit,
+#ifdef __linux__
+	  ""
+#else
+	  " (pinning to cores is supported only on Linux)"
+#endif
+	  );
+
+  const char *cmd = option.commands[num];
+  const char *name = option.names[num];
+  LaunchPlan *plan = new_run_plan(option.shell, cmd);
+  choose_repeat(&pilot, num, plan);
+
+  Usage *dummy = new_usage_array(option.warmups);
+  for (int i = 0; i < option.warmups; i++)
+    run(&pilot, num, plan, prep, dummy, usage_next(dummy), 0);
+  free_usage_array(dummy);
+
+  Runner *runners = malloc(limit * sizeof(Runner));
+  if (!runners) PANIC_OOM();
+  for (int w = 0; w < limit; w++)
+    runners[w] = (Runner){.core = cores[w]};
+
+  int start = usage->next;
+  int concurrency = 1;
+  while (true) {
+    // The runs of this level are recorded under its own name
+    char *level_name;
+    ASPRINTF(&level_name, "%s (x%d)", name ?: cmd, concurrency);
+    option.names[num] = level_name;
+    Level l = {.num = num, .plan = plan, .prep = prep,
+	       .batch = next_batch_number(), .concurrency = concurrency,
+	       .base = usage->next, .usage = usage, .runners = runners};
+    int nruns = concurrency * option.runs;
+    for (int i = 0; i < nruns; i++) usage_next(usage);
+    run_jobs(concurrency, cores, nruns, sweep_task, &l);
+    set_int64(usage, l.base + nruns - 1, F_STOP, STOP_FIXED);
+    if (output)
+      for (int i = l.base; i < l.base + nruns; i++)
+	write_line(output, usage, i);
+    if (any_per_command_output())
+      announce_command(level_name, cmd, num);
+    report_command(usage, l.base, l.base + nruns, csv_output, hf_output);
+    option.names[num] = name;
+    free(level_name);
+    if (concurrency == limit) break;
+    concurrency = (2 * concurrency < limit) ? 2 * concurrency : limit;
+  }
+  report_sweep(usage, start, usage->next);
+
+  free(runners);
+  free_launch_plan(plan);
+}
+
+// -----------------------------------------------------------------------------
+// Racing mode (--race)
+// -----------------------------------------------------------------------------
+
+// The commands take turns, one run each per round (in random order
+// if requested).  At checkpoints
+// after INFERENCE_N_THRESHOLD, 2x, 4x, ... rounds, each remaining
+// command is compared to the one with the lowest median total time,
+// and eliminated if it is significantly slower, using the same test
+// as the final ranking.  Testing repeatedly as the data accumulates
+// would inflate the false elimination rate, so the alpha value is
+// split evenly across the checkpoints (Bonferroni), which bounds the
+// chance of wrongly eliminating a command by alpha overall.
+
+typedef struct Racer {
+  LaunchPlan *plan;
+  int64_t     batch;
+  Usage      *usage;		// This command's timed runs
+  bool        eliminated;
+} Racer;
+
+// Returns INT64_MAX if no run completed
+static int64_t racer_median(Racer *r) {
+  int64_t *X = malloc(r->usage->next * sizeof(int64_t));
+  if (!X) PANIC_OOM();
+  int n = 0;
+  for (int i = 0; i < r->usage->next; i++)
+    if (COMPLETED(r->usage, i))
+      X[n++] = get_int64(r->usage, i, F_TOTAL) / usage_repeats(r->usage, i);
+  qsort(X, n, sizeof(int64_t), compare_int64);
+  int64_t median = n ? X[n / 2] : INT64_MAX;
+  free(X);
+  return median;
+}
+
+static bool racer_is_slower(Racer *best, Racer *r, double alpha) {
+  Usage *sample = new_usage_array(best->usage->next + r->usage->next);
+  for (int i = 0; i < best->usage->next; i++)
+    usage_copy(sample, best->usage, i);
+  for (int i = 0; i < r->usage->next; i++)
+    usage_copy(sample, r->usage, i);
+  usage_per_execution(sample, 0, sample->next);
+  Inference *infer = compare_samples(sample, alpha,
+				     0, best->usage->next,
+				     best->usage->next, sample->next);
+  bool slower = infer && (infer->indistinct == 0);
+  free(infer);
+  free_usage_array(sample);
+  return slower;
+}
+
+static void eliminate_slower(Racer *racers, int n, double alpha) {
+  int best = -1;
+  int64_t best_median = 0;
+  for (int k = 0; k < n; k++) {
+    if (racers[k].eliminated) continue;
+    int64_t median = racer_median(&racers[k]);
+    if ((best < 0) || (median < best_median)) {
+      best = k;
+      best_median = median;
+    }
+  }
+  for (int k = 0; k < n; k++) {
+    if ((k == best) || racers[k].eliminated) continue;
+    if (racer_is_slower(&racers[best], &racers[k], alpha)) {
+      racers[k].eliminated = true;
+      Usage *u = racers[k].usage;
+      set_int64(u, u->next - 1, F_STOP, STOP_ELIMINATED);
+    }
+  }
+}
+
+// Usage must be empty.  On return, it holds the results for each
+// command, in command order.  Eliminated commands have fewer runs.
+static void run_race(Usage *usage, const LaunchPlan *prep) {
+  static Runner runner = {.core = -1};
+
+  int n = option.n_commands;
+  Racer *racers = malloc(n * sizeof(Racer));
+  if (!racers) PANIC_OOM();
+  for (int k = 0; k < n; k++)
+    racers[k] = (Racer){
+      .plan = new_run_plan(option.shell, option.commands[k]),
+      .batch = next_batch_number(),
+      .usage = new_usage_array(option.runs),
+      .eliminated = false,
+    };
+  for (int k = 0; k < n; k++)
+    choose_repeat(&runner, k, racers[k].plan);
+
+  int checkpoints = 0;
+  for (int c = INFERENCE_N_THRESHOLD; c < option.runs; c *= 2)
+    checkpoints++;
+  double alpha = config.alpha / (checkpoints ? checkpoints : 1);
+
+  int *order = malloc(n * sizeof(int));
+  if (!order) PANIC_OOM();
+
+  Usage *dummy = new_usage_array(option.warmups * n);
+  for (int i = 0; i < option.warmups; i++) {
+    next_round(order, n);
+    for (int j = 0; j < n; j++)
+      run(&runner, order[j], racers[order[j]].plan, prep,
+	  dummy, usage_next(dummy), racers[order[j]].batch);
+  }
+  free_usage_array(dummy);
+
+  int checkpoint = INFERENCE_N_THRESHOLD;
+  for (int i = 0; i < option.runs; i++) {
+    next_round(order, n);
+    for (int j = 0; j < n; j++) {
+      int k = order[j];
+      if (racers[k].eliminated) continue;
+      Usage *u = racers[k].usage;
+      int idx = timed_run(&runner, k, racers[k].plan, prep, u, racers[k].batch, NULL);
+      if (i == option.runs - 1) set_int64(u, idx, F_STOP, STOP_FIXED);
+    }
+    if (i + 1 == checkpoint) {
+      if (checkpoint < option.runs) eliminate_slower(racers, n, alpha);
+      checkpoint *= 2;
+    }
+  }
+
+  for (int k = 0; k < n; k++) {
+    for (int i = 0; i < racers[k].usage->next; i++)
+      usage_copy(usage, racers[k].usage, i);
+    free_usage_array(racers[k].usage);
+    free_launch_plan(racers[k].plan);
+  }
+  free(racers);
+  free(order);
+}
+
+// -----------------------------------------------------------------------------
+
+static void report_command(Usage *usage, int start, int end,
+			   FILE *csv_output, FILE *hf_output) {
+  usage_per_execution(usage, start, end);
+  Summary *s = summarize(usage, start, end);
+  assert((option.runs <= 0) || s);
+  write_summary_line(csv_output, s);
+  write_hf_line(hf_output, s);
+  per_command_output(s, usage, start, end);
+  report_core_interference(usage, start, end);
+  report_stop_reason(usage, start, end);
+  report_fork_server(usage, start, end);
+  report_repeat(usage, start, end);
+  report_cpu_state(usage, start, end);
+  report_quiet(usage, start, end);
+  report_cache(usage, start, end);
+  report_capture(usage, start, end);
+  report_open_loop(usage, start, end);
+  report_cgroup(usage, start, end);
+  report_descendants(usage, start, end);
+  report_net_of_overhead(s, &calibration);
+  free_summary(s);
+}
+
 Ranking *run_all_commands(void) {
 
-  if (option.runs <= 0) 
+  if (option.adaptive) {
+    if (option.min_runs < 0)
+      option.min_runs = (option.max_runs < 10) ? option.max_runs : 10;
+    if (option.min_runs > option.max_runs)
+      USAGE("Minimum number of runs (%d) exceeds maximum (%d)",
+	    option.min_runs, option.max_runs);
+    if (option.jobs > 1)
+      USAGE("An adaptive number of runs cannot be combined with parallel runs");
+    if (option.race)
+      USAGE("An adaptive number of runs cannot be combined with racing");
+    if (option.target_metric < 0) option.target_metric = F_TOTAL;
+  } else if (option.runs <= 0) {
     USAGE("Number of runs is 0, nothing to do");
+  }
+  if (option.race && (option.jobs > 1))
+    USAGE("Racing cannot be combined with parallel runs");
+  if ((option.order != orderSequential) && (option.jobs > 1))
+    USAGE("Option --%s cannot be combined with parallel runs",
+	  optable_longname(OPT_ORDER));
+  if ((option.order != orderSequential) && option.adaptive)
+    USAGE("Option --%s cannot be combined with an adaptive number of runs",
+	  optable_longname(OPT_ORDER));
+  if ((option.cpu_limit > 0) || (option.mem_limit > 0) || (option.files_limit > 0))
+    if (option.launcher == launcherSpawn)
+      USAGE("Resource limits require the fork or vfork launcher");
+  if (option.fork_server) {
+#ifndef __linux__
+    USAGE("Option --%s is supported only on Linux",
+	  optable_longname(OPT_FORKSERVER));
+#endif
+    if (*option.shell)
+      USAGE("Option --%s cannot be used with a shell, because it"
+	    " needs the program itself", optable_longname(OPT_FORKSERVER));
+    if ((option.jobs > 1) || option.race || (option.order != orderSequential))
+      USAGE("Option --%s requires sequential runs of each command"
+	    " (no --jobs, --race, or --order)", optable_longname(OPT_FORKSERVER));
+    if (option.timeout > 0)
+      USAGE("Option --%s cannot be combined with a timeout",
+	    optable_longname(OPT_FORKSERVER));
+  }
+  bool pinning = option.cpus || (option.harness_cpu >= 0) || option.no_smt;
+  if ((pinning || (option.nice != NICE_INHERIT) || (option.sched_policy >= 0))
+      && (option.launcher == launcherSpawn))
+    USAGE("Pinning and scheduling options require the fork or vfork launcher");
+  if (pinning) {
+    const char *err = restrict_cpus(option.cpus, option.harness_cpu, option.no_smt);
+    if (err) USAGE("%s", err);
+  }
+  if (option.quiet > 0) {
+    SysCPU probe;
+    if (!sysload_read(&probe))
+      USAGE("Option --%s needs /proc/stat (Linux)", optable_longname(OPT_QUIET));
+    if (option.jobs > 1)
+      USAGE("Option --%s cannot be combined with parallel runs",
+	    optable_longname(OPT_QUIET));
+  }
+  if (option.interference > 0) {
+    SysCPU probe;
+    if (!sysload_read(&probe))
+      USAGE("Option --%s needs /proc/stat (Linux)",
+	    optable_longname(OPT_INTERFERENCE));
+    if (option.jobs > 1)
+      USAGE("Option --%s cannot be combined with parallel runs",
+	    optable_longname(OPT_INTERFERENCE));
+  }
+  if (option.capture_output && (option.show_output || option.fork_server))
+    USAGE("Option --%s cannot be combined with --%s or --%s",
+	  optable_longname(OPT_CAPTURE), optable_longname(OPT_SHOWOUTPUT),
+	  optable_longname(OPT_FORKSERVER));
+  if (option.cache > 0) {
+    if (option.jobs > 1)
+      USAGE("Option --%s cannot be combined with parallel runs",
+	    optable_longname(OPT_CACHE));
+    if ((option.cache == CACHE_COLD) && (option.fork_server || (option.repeat != 1)))
+      USAGE("A cold cache needs each run to start the command once"
+	    " (no --%s or --%s)", optable_longname(OPT_FORKSERVER),
+	    optable_longname(OPT_REPEAT));
+    struct stat st;
+    for (int i = 0; i < option.n_cache_files; i++)
+      if ((stat(option.cache_files[i], &st) != 0) || !S_ISREG(st.st_mode))
+	USAGE("Cache file '%s' is not a regular file", option.cache_files[i]);
+  } else if (option.n_cache_files) {
+    USAGE("Option --%s requires --%s",
+	  optable_longname(OPT_CACHEFILE), optable_longname(OPT_CACHE));
+  }
+  if (option.metadata && !option.output_filename)
+    USAGE("Option --%s requires --%s",
+	  optable_longname(OPT_METADATA), optable_longname(OPT_OUTPUT));
+  if (option.rate > 0) {
+    if ((option.jobs > 1) || option.race || (option.order != orderSequential)
+	|| option.adaptive)
+      USAGE("Option --%s requires a fixed number of sequential runs"
+	    " (no --jobs, --race, --order, or adaptive runs)",
+	    optable_longname(OPT_RATE));
+    if (option.fork_server || (option.repeat != 1) || option.prep_command
+	|| (option.timeout > 0) || option.cpu_state)
+      USAGE("Option --%s cannot be combined with --%s, --%s, --%s, --%s, or --%s",
+	    optable_longname(OPT_RATE), optable_longname(OPT_FORKSERVER),
+	    optable_longname(OPT_REPEAT), optable_longname(OPT_PREP),
+	    optable_longname(OPT_TIMEOUT), optable_longname(OPT_CPUSTATE));
+    if ((option.quiet > 0) || (option.interference > 0) || (option.cache > 0)
+	|| option.capture_output)
+      USAGE("Option --%s cannot be combined with --%s, --%s, --%s, or --%s",
+	    optable_longname(OPT_RATE), optable_longname(OPT_QUIET),
+	    optable_longname(OPT_INTERFERENCE), optable_longname(OPT_CACHE),
+	    optable_longname(OPT_CAPTURE));
+  } else if ((option.arrivals != arrivalsConstant)
+	     || (option.max_inflight != DEFAULT_MAX_INFLIGHT)) {
+    USAGE("Options --%s and --%s require --%s",
+	  optable_longname(OPT_ARRIVALS), optable_longname(OPT_MAXINFLIGHT),
+	  optable_longname(OPT_RATE));
+  }
+  if (option.sweep >= 0) {
+    if ((option.jobs > 1) || option.race || (option.order != orderSequential)
+	|| option.adaptive || (option.rate > 0))
+      USAGE("Option --%s cannot be combined with --%s, --%s, --%s, --%s,"
+	    " or an adaptive number of runs", optable_longname(OPT_SWEEP),
+	    optable_longname(OPT_JOBS), optable_longname(OPT_RACE),
+	    optable_longname(OPT_ORDER), optable_longname(OPT_RATE));
+    if (option.fork_server || (option.quiet > 0) || (option.interference > 0)
+	|| (option.cache > 0))
+      USAGE("Option --%s cannot be combined with --%s, --%s, --%s, or --%s",
+	    optable_longname(OPT_SWEEP), optable_longname(OPT_FORKSERVER),
+	    optable_longname(OPT_QUIET), optable_longname(OPT_INTERFERENCE),
+	    optable_longname(OPT_CACHE));
+  }
+  if (option.cgroup) {
+    if (option.launcher == launcherSpawn)
+      USAGE("Option --%s requires the fork or vfork launcher",
+	    optable_longname(OPT_CGROUP));
+    if (option.fork_server || (option.rate > 0))
+      USAGE("Option --%s cannot be combined with --%s or --%s",
+	    optable_longname(OPT_CGROUP), optable_longname(OPT_FORKSERVER),
+	    optable_longname(OPT_RATE));
+    const char *err = cgroup_init();
+    if (err) USAGE("%s", err);
+    CgroupLimits limits = {
+      .cpu_quota_us = -1,
+      .cpu_period_us = CGROUP_CPU_PERIOD_US,
+      .memory_high = option.memory_high,
+      .memory_max = option.memory_max,
+      .io_max = option.io_max,
+    };
+    if (option.cpu_quota > 0)
+      limits.cpu_quota_us = (int64_t) (option.cpu_quota * CGROUP_CPU_PERIOD_US + 0.5);
+    err = cgroup_set_limits(&limits);
+    if (err) USAGE("%s", err);
+    if (!strstr(cgroup_controllers(), "memory"))
+      printf("Note: The memory and I/O controllers are not available to runs,"
+	     " so only cgroup CPU time and pressure are recorded\n\n");
+  }
+  // As a subreaper, we wait for any child to exit, so there can be
+  // only the one run (and no fork server) at a time
+  if (option.wait_descendants) {
+    if ((option.jobs > 1) || (option.rate > 0) || (option.sweep >= 0)
+	|| option.fork_server)
+      USAGE("Option --%s cannot be combined with --%s, --%s, --%s, or --%s",
+	    optable_longname(OPT_DESCENDANTS), optable_longname(OPT_JOBS),
+	    optable_longname(OPT_RATE), optable_longname(OPT_SWEEP),
+	    optable_longname(OPT_FORKSERVER));
+    if (!set_subreaper(true))
+      USAGE("Option --%s is not supported on this platform",
+	    optable_longname(OPT_DESCENDANTS));
+  }
+  bool random_arrivals = (option.rate > 0) && (option.arrivals == arrivalsPoisson);
+  if ((option.seed >= 0) && (option.order != orderRandom) && !random_arrivals)
+    USAGE("Option --%s requires --%s random or --%s poisson",
+	  optable_longname(OPT_SEED), optable_longname(OPT_ORDER),
+	  optable_longname(OPT_ARRIVALS));
 
   char *cmd;
   char *buf = malloc(MAXCMDLEN);
@@ -352,31 +1666,130 @@ Ranking *run_all_commands(void) {
   hf_output = maybe_open(option.hf_filename, "w");
   output = maybe_open(option.output_filename, "w");
 
+  if (option.launcher_report)
+    print_launch_report(option.shell, option.commands[0]);
+
+  counters_init();
+  cpustate_init(option.cpu_state);
+
+  LaunchPlan *prep = NULL;
+  if (option.prep_command)
+    prep = new_launch_plan(option.shell, option.prep_command, true);
+
+  // Record the seed, so that a random order (or random arrivals) can
+  // be repeated
+  if ((option.order == orderRandom) || random_arrivals) {
+    if (option.seed < 0)
+      option.seed = (monotonic_ns() ^ getpid()) & INT64_MAX;
+    random_state = (uint64_t) option.seed;
+    printf("%s (use --%s " INT64FMT " to repeat %s)\n\n",
+	   random_arrivals ? "Runs arrive at random" : "Runs are in random order",
+	   optable_longname(OPT_SEED), option.seed,
+	   random_arrivals ? "these arrivals" : "this order");
+    fflush(stdout);
+  }
+
+  if (option.calibrate) calibrate();
+
   if (csv_output) write_summary_header(csv_output);
   if (hf_output) write_hf_header(hf_output);
+  // The metadata lines are not CSV, so they are written only when
+  // asked for.  Readers of plain CSV would take them for the header.
+  if (output && option.metadata) {
+    if (option.calibrate) {
+      write_overhead(output, OVERHEAD_KEY, &calibration.plain);
+      if (*option.shell)
+	write_overhead(output, SHELL_OVERHEAD_KEY, &calibration.shell);
+    }
+    if (option.order != orderSequential) {
+      char seed[24];
+      snprintf(seed, sizeof(seed), INT64FMT, option.seed);
+      write_metadata(output, "order", RunOrderName[option.order]);
+      if (option.order == orderRandom)
+	write_metadata(output, "seed", seed);
+    }
+    if (option.rate > 0) {
+      char rate[32], seed[24];
+      snprintf(rate, sizeof(rate), "%g", option.rate);
+      snprintf(seed, sizeof(seed), INT64FMT, option.seed);
+      write_metadata(output, "rate", rate);
+      write_metadata(output, "arrivals", ArrivalsName[option.arrivals]);
+      if (random_arrivals)
+	write_metadata(output, "seed", seed);
+    }
+    if (option.cpu_quota > 0) {
+      char cpus[32];
+      snprintf(cpus, sizeof(cpus), "%g", option.cpu_quota);
+      write_metadata(output, "cpu_quota", cpus);
+    }
+    if (option.memory_high > 0) {
+      char bytes[24];
+      snprintf(bytes, sizeof(bytes), INT64FMT, option.memory_high);
+      write_metadata(output, "memory_high", bytes);
+    }
+    if (option.memory_max > 0) {
+      char bytes[24];
+      snprintf(bytes, sizeof(bytes), INT64FMT, option.memory_max);
+      write_metadata(output, "memory_max", bytes);
+    }
+    if (option.io_max)
+      write_metadata(output, "io_max", option.io_max);
+  }
   if (output) write_header(output);
 
   int start;
-  Summary *s;
   Usage *usage = NULL;
 
   // Usage array will expand as needed, but this size should be right
   usage = new_usage_array(option.n_commands * option.runs);
 
-  // FUTURE: We compute summaries twice.  Once in the loop below, as
+  // FUTURE: We compute summaries twice.  Once in the loops below, as
   // each command's executions finish, and then again during ranking.
 
-  for (int k = 0; k < option.n_commands; k++) {
-    start = usage->next;
-    run_command(usage, k, output);
-    s = summarize(usage, start, usage->next);
-    assert((option.runs <= 0) || s);
-    write_summary_line(csv_output, s);
-    write_hf_line(hf_output, s);
-    per_command_output(s, usage, start, usage->next);
-    free_summary(s);
+  if ((option.jobs > 1) || option.race || (option.order != orderSequential)) {
+    // All commands run, then we report on each in order.  Interleaved
+    // runs have already been written to the raw data file.
+    FILE *raw = output;
+    if (option.jobs > 1) {
+      run_parallel(usage, prep);
+    } else if (option.race) {
+      run_race(usage, prep);
+    } else {
+      run_interleaved(usage, prep, output);
+      raw = NULL;
+    }
+    int end = 0;
+    for (int k = 0; k < option.n_commands; k++) {
+      start = end;
+      int64_t batch = usage->data[start].batch;
+      while ((end < usage->next) && (usage->data[end].batch == batch)) end++;
+      if (any_per_command_output())
+	announce_command(option.names[k], option.commands[k], k);
+      if (raw)
+	for (int i = start; i < end; i++)
+	  write_line(raw, usage, i);
+      report_command(usage, start, end, csv_output, hf_output);
+    }
+  } else {
+    for (int k = 0; k < option.n_commands; k++) {
+      start = usage->next;
+      if (option.sweep >= 0) {
+	run_sweep(usage, k, prep, output, csv_output, hf_output);
+	continue;
+      }
+      if (option.rate > 0)
+	run_open_loop(usage, k, output);
+      else
+	run_command(usage, k, prep, output);
+      report_command(usage, start, usage->next, csv_output, hf_output);
+    }
   }
 
+  free_launch_plan(prep);
+  for (int k = 0; k < option.n_commands; k++) {
+    free_cache_files(cache_files[k]);
+    cache_files[k] = NULL;
+  }
   if (output) fclose(output);
   if (csv_output) fclose(csv_output);
   if (hf_output) fclose(hf_output);
@@ -12,6 +12,41 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+// The order in which the runs of different commands are done.
+// Sequential does all the runs of one command before the next.
+// Interleaved does one run of each command per round, and random
+// does the same but shuffles the commands in each round.
+#define XOrders(X)							\
+  X(orderSequential,  "sequential",  "All runs of each command in turn")	\
+  X(orderInterleaved, "interleaved", "One run of each command per round")	\
+  X(orderRandom,      "random",      "Each round in a random order")		\
+  X(orderLast,         NULL,         "SENTINEL")
+
+#define FIRST(a, b, c) a,
+typedef enum { XOrders(FIRST) } RunOrder;
+#undef FIRST
+extern const char *RunOrderName[];
+
+// Returns -1 if 'name' is not a run order name
+int run_order_from_name(const char *name);
+
+// With --rate, runs are started on a schedule, not one after another.
+// Constant arrivals are evenly spaced.  Poisson arrivals have gaps
+// drawn from an exponential distribution with the same mean, which is
+// what independent clients would produce.
+#define XArrivals(X)							\
+  X(arrivalsConstant, "constant", "Evenly spaced starts")		\
+  X(arrivalsPoisson,  "poisson",  "Exponentially distributed gaps")	\
+  X(arrivalsLast,      NULL,      "SENTINEL")
+
+#define FIRST(a, b, c) a,
+typedef enum { XArrivals(FIRST) } Arrivals;
+#undef FIRST
+extern const char *ArrivalsName[];
+
+// Returns -1 if 'name' is not an arrival process name
+int arrivals_from_name(const char *name);
+
 Ranking *run_all_commands(void);
 
 #endif
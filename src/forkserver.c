@@ -0,0 +1,118 @@
+//  -*- Mode: C; -*-
+//
+//  forkserver.c  LD_PRELOAD shim that turns a program into a fork server
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+// This file is built as a shared library (FORKSERVER_LIB), not as
+// part of bestguess.  It interposes on __libc_start_main(), which
+// glibc calls with the address of main(), and substitutes its own
+// main().  See forkserver.h for the protocol.
+
+#define _GNU_SOURCE
+#include "forkserver.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef int (MainFn)(int argc, char **argv, char **envp);
+typedef int (StartFn)(MainFn *main, int argc, char **argv,
+		      void (*init)(void), void (*fini)(void),
+		      void (*rtld_fini)(void), void *stack_end);
+
+int __libc_start_main(MainFn *main, int argc, char **argv,
+		      void (*init)(void), void (*fini)(void),
+		      void (*rtld_fini)(void), void *stack_end);
+
+static MainFn *real_main;
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= (size_t) n;
+  }
+  return 0;
+}
+
+// Remove our library from LD_PRELOAD (it is always first), so that
+// programs started by the command under test are not affected
+static void restore_environment(void) {
+  const char *preload = getenv("LD_PRELOAD");
+  const char *rest = preload ? strchr(preload, ':') : NULL;
+  if (rest)
+    setenv("LD_PRELOAD", rest + 1, 1);
+  else
+    unsetenv("LD_PRELOAD");
+  unsetenv(FORKSERVER_ENV);
+}
+
+// Take the timestamp when the child has terminated, before reaping
+// it, as bestguess does for an ordinary run.  Returns 0 in the parent
+// and 1 in the child.
+static int run_once(int report_fd) {
+  ForkServerReport r;
+  memset(&r, 0, sizeof(r));
+  siginfo_t info;
+  int64_t start = now_ns();
+  pid_t pid = fork();
+  if (pid == 0) return 1;
+  if (pid < 0) {
+    r.err = errno;
+  } else {
+    while ((waitid(P_PID, (id_t) pid, &info, WEXITED | WNOWAIT) == -1)
+	   && (errno == EINTR));
+    r.wall_ns = now_ns() - start;
+    if (wait4(pid, &r.status, 0, &r.ru) < 0) r.err = errno;
+  }
+  if (write_all(report_fd, &r, sizeof(r))) _exit(1);
+  return 0;
+}
+
+static int serve(int argc, char **argv, char **envp) {
+  int request_fd, report_fd;
+  const char *fds = getenv(FORKSERVER_ENV);
+  if (!fds || (sscanf(fds, "%d,%d", &request_fd, &report_fd) != 2))
+    return real_main(argc, argv, envp);
+  restore_environment();
+
+  char c = FORKSERVER_READY;
+  if (write_all(report_fd, &c, 1)) _exit(1);
+  for (;;) {
+    ssize_t n = read(request_fd, &c, 1);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n <= 0) _exit(0);
+    if (run_once(report_fd)) break;
+  }
+  // We are the child
+  close(request_fd);
+  close(report_fd);
+  return real_main(argc, argv, environ);
+}
+
+int __libc_start_main(MainFn *main, int argc, char **argv,
+		      void (*init)(void), void (*fini)(void),
+		      void (*rtld_fini)(void), void *stack_end) {
+  StartFn *next = (StartFn *) dlsym(RTLD_NEXT, "__libc_start_main");
+  if (!next) {
+    fprintf(stderr, "%s: __libc_start_main not found\n", FORKSERVER_LIB);
+    _exit(127);
+  }
+  real_main = main;
+  return next(serve, argc, argv, init, fini, rtld_fini, stack_end);
+}
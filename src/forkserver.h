@@ -0,0 +1,45 @@
+//  -*- Mode: C; -*-
+//
+//  forkserver.h  Protocol between bestguess and the fork server shim
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef forkserver_h
+#define forkserver_h
+
+// The shim is a shared library that bestguess loads into the command
+// under test with LD_PRELOAD.  It takes over just before main() is
+// called, when the dynamic loader and all constructors have run, and
+// becomes a fork server: for each request from bestguess, it forks a
+// child that calls the real main(), waits for the child, and reports
+// the result.  A timed run then excludes exec, dynamic linking, and
+// initialization, leaving fork and the program's own work.
+//
+// This header is shared by bestguess and the shim, so it must not
+// depend on anything else in this project.
+
+#include <stdint.h>
+#include <sys/resource.h>
+
+#define FORKSERVER_LIB "libbgforkserver.so"
+
+// The shim becomes a fork server only when this variable is set, to
+// "<request fd>,<report fd>".  Any LD_PRELOAD value that was in
+// effect before ours follows our library, after a colon, and is
+// restored before main() is called.
+#define FORKSERVER_ENV "BESTGUESS_FORKSERVER"
+
+// The shim writes FORKSERVER_READY once it is serving.  After that,
+// each byte that bestguess writes is a request for one run, to which
+// the shim replies with a ForkServerReport.  The shim exits when the
+// request pipe is closed.
+#define FORKSERVER_READY 'R'
+
+typedef struct ForkServerReport {
+  int           err;		// errno, if fork or wait failed
+  int           status;		// From wait4()
+  int64_t       wall_ns;	// From fork() until the child exited
+  struct rusage ru;		// Of the child, from wait4()
+} ForkServerReport;
+
+#endif
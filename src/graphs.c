@@ -24,8 +24,8 @@
 #define BAR "▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭▭"
 
 void print_graph(Summary *s, Usage *usage, int start, int end) {
-  // No data if 's' or 'usage' are NULL
-  if (!s || !usage) return;
+  // No data if 's' or 'usage' are NULL, or no run completed
+  if (!s || !usage || (s->runs == 0)) return;
   // Error if start or end is out of range
   if ((start < 0) || (start >= usage->next) || (end < 0) || (end > usage->next))
     PANIC("Usage data indices out of bounds");
@@ -53,6 +53,32 @@ void maybe_graph(Summary *s, Usage *usage, int start, int end) {
   }
 }
 
+// -----------------------------------------------------------------------------
+// Throughput of a concurrency sweep
+// -----------------------------------------------------------------------------
+
+// One bar per level, scaled to the highest throughput, so that the
+// point where the bars stop growing stands out.  The level at index
+// 'knee' is marked, unless 'knee' is negative.
+void print_sweep_graph(int n, const int *concurrency,
+		       const double *throughput, int knee) {
+  if (!concurrency || !throughput) PANIC_NULL();
+  int bytesperbar = (uint8_t) BAR[0] >> 6; // Assumes UTF-8
+  int maxbars = strlen(BAR) / bytesperbar - 10;
+  double tmax = 0;
+  for (int i = 0; i < n; i++)
+    if (throughput[i] > tmax) tmax = throughput[i];
+  if (tmax <= 0) return;
+  printf("Throughput (runs/s) by runs at once:\n");
+  for (int i = 0; i < n; i++) {
+    int bars = (int) (throughput[i] * maxbars / tmax + 0.5);
+    printf("%5d │%.*s %.1f%s\n", concurrency[i], bars * bytesperbar, BAR,
+	   throughput[i], (i == knee) ? "  ◀ knee" : "");
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
 // -----------------------------------------------------------------------------
 // Box plots
 // -----------------------------------------------------------------------------
@@ -247,10 +273,16 @@ void print_boxplots(Summary *summaries[], int start, int end) {
   int64_t axismin = INT64_MAX;
   int64_t axismax = INT64_MIN;
   for (int i = start; i < end; i++) {
+    if (summaries[i]->runs == 0) continue;
     Measures *m = &(summaries[i]->total);
     axismin = min64(m->min, axismin);
     axismax = max64(m->max, axismax);
   }
+  // A command with no completed runs has no box
+  if (axismin > axismax) {
+    printf("No data for box plot\n");
+    return;
+  }
   int width = config.width;
 
   // Must ensure that axis min/max have some separation
@@ -262,6 +294,7 @@ void print_boxplots(Summary *summaries[], int start, int end) {
 
   print_boxplot_scale(scale_min, scale_max, width, BOXPLOT_LABEL_ABOVE);
   for (int i = start; i < end; i++) {
+    if (summaries[i]->runs == 0) continue;
     print_boxplot(i, &(summaries[i]->total), axismin, axismax, width);
   }
   print_boxplot_scale(scale_min, scale_max, width, BOXPLOT_LABEL_BELOW);
@@ -0,0 +1,247 @@
+//  -*- Mode: C; -*-
+//
+//  jobs.c  Running independent tasks on pinned worker threads
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "jobs.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Each worker owns a queue of task numbers.  The owner takes tasks
+// from the head and thieves take them from the tail.  A lock per
+// queue is plenty: tasks are whole command executions, so contention
+// is negligible compared to the work.
+
+typedef struct Queue {
+  pthread_mutex_t lock;
+  int            *tasks;
+  int             head;
+  int             tail;		// One past the last task
+} Queue;
+
+typedef struct Worker {
+  pthread_t  thread;
+  int        id;
+  int        core;
+  struct Pool *pool;
+} Worker;
+
+typedef struct Pool {
+  int     njobs;
+  Queue  *queues;
+  Worker *workers;
+  TaskFn *fn;
+  void   *context;
+} Pool;
+
+// Returns -1 if the queue is empty
+static int take(Queue *q, bool from_head) {
+  int task = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail)
+    task = from_head ? q->tasks[q->head++] : q->tasks[--q->tail];
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+// Tasks are never added once the workers start, so when a worker
+// finds every queue empty, there is nothing left for it to do.
+static int next_task(Pool *pool, int id) {
+  int task = take(&pool->queues[id], true);
+  for (int i = 1; (task < 0) && (i < pool->njobs); i++)
+    task = take(&pool->queues[(id + i) % pool->njobs], false);
+  return task;
+}
+
+static bool pin_to_core(int core) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void) core;
+  return false;
+#endif
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  Pool *pool = w->pool;
+  if (!pin_to_core(w->core))
+    PANIC("Failed to pin worker %d to core %d", w->id, w->core);
+  int task;
+  while ((task = next_task(pool, w->id)) >= 0)
+    pool->fn(task, w->id, pool->context);
+  return NULL;
+}
+
+#ifdef __linux__
+
+// The CPUs that runs may use, once restrict_cpus() has been called
+static cpu_set_t run_cpus;
+static bool restricted = false;
+
+// A list in the kernel's format (see cpuset(7)), e.g. "0-3,8,10-11",
+// possibly ending in a newline.  Returns false if it is malformed.
+static bool parse_cpu_list(const char *list, cpu_set_t *set) {
+  CPU_ZERO(set);
+  const char *p = list;
+  char *end;
+  while (*p && (*p != '\n')) {
+    long lo = strtol(p, &end, 10);
+    long hi = lo;
+    if ((end == p) || (lo < 0)) return false;
+    p = end;
+    if (*p == '-') {
+      hi = strtol(p + 1, &end, 10);
+      if ((end == p + 1) || (hi < lo)) return false;
+      p = end;
+    }
+    if (hi >= CPU_SETSIZE) return false;
+    for (long cpu = lo; cpu <= hi; cpu++)
+      CPU_SET((int) cpu, set);
+    if (*p == ',') p++;
+    else if (*p && (*p != '\n')) return false;
+  }
+  return (CPU_COUNT(set) > 0);
+}
+
+// The hardware threads that share a core with 'cpu', including 'cpu'
+static bool smt_siblings(int cpu, cpu_set_t *set) {
+  char path[96];
+  char buf[256];
+  snprintf(path, sizeof(path),
+	   "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  bool ok = fgets(buf, sizeof(buf), f) && parse_cpu_list(buf, set);
+  fclose(f);
+  return ok;
+}
+
+// Remove the siblings of 'cpu' (but not 'cpu' itself) from 'set'
+static void remove_siblings(int cpu, cpu_set_t *set) {
+  cpu_set_t siblings;
+  if (!smt_siblings(cpu, &siblings)) return;
+  for (int s = 0; s < CPU_SETSIZE; s++)
+    if ((s != cpu) && CPU_ISSET(s, &siblings)) CPU_CLR(s, set);
+}
+
+const char *restrict_cpus(const char *list, int harness_cpu, bool no_smt) {
+  cpu_set_t allowed, listed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    return "Cannot determine which CPUs are available";
+  run_cpus = allowed;
+  if (list) {
+    if (!parse_cpu_list(list, &listed))
+      return "Invalid CPU list (expected e.g. 2-3,6)";
+    CPU_AND(&run_cpus, &run_cpus, &listed);
+  }
+  if (harness_cpu >= 0) {
+    if ((harness_cpu >= CPU_SETSIZE) || !CPU_ISSET(harness_cpu, &allowed))
+      return "The harness CPU is not available";
+    if (no_smt) remove_siblings(harness_cpu, &run_cpus);
+    CPU_CLR(harness_cpu, &run_cpus);
+    cpu_set_t harness;
+    CPU_ZERO(&harness);
+    CPU_SET(harness_cpu, &harness);
+    if (sched_setaffinity(0, sizeof(harness), &harness))
+      return "Failed to pin to the harness CPU";
+  }
+  // Keep the lowest numbered thread of each core
+  if (no_smt)
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &run_cpus)) remove_siblings(cpu, &run_cpus);
+  if (CPU_COUNT(&run_cpus) == 0)
+    return "No CPUs are left for the runs";
+  restricted = true;
+  return NULL;
+}
+
+int restricted_cpus(int *cpus) {
+  if (!cpus) PANIC_NULL();
+  int n = 0;
+  if (!restricted) return 0;
+  for (int cpu = 0; (cpu < CPU_SETSIZE) && (n < MAXJOBS); cpu++)
+    if (CPU_ISSET(cpu, &run_cpus)) cpus[n++] = cpu;
+  return n;
+}
+
+bool select_cores(int njobs, int *cores) {
+  if (!cores) PANIC_NULL();
+  cpu_set_t allowed;
+  if (restricted)
+    allowed = run_cpus;
+  else if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    return false;
+  int n = 0;
+  for (int cpu = 0; (cpu < CPU_SETSIZE) && (n < njobs); cpu++)
+    if (CPU_ISSET(cpu, &allowed)) cores[n++] = cpu;
+  return (n == njobs);
+}
+
+#else
+
+const char *restrict_cpus(const char *list, int harness_cpu, bool no_smt) {
+  (void) list;
+  (void) harness_cpu;
+  (void) no_smt;
+  return "Pinning to CPUs is supported only on Linux";
+}
+
+int restricted_cpus(int *cpus) {
+  if (!cpus) PANIC_NULL();
+  return 0;
+}
+
+bool select_cores(int njobs, int *cores) {
+  if (!cores) PANIC_NULL();
+  (void) njobs;
+  return false;
+}
+
+#endif
+
+void run_jobs(int njobs, const int *cores, int ntasks,
+	      TaskFn fn, void *context) {
+  if (!cores || !fn) PANIC_NULL();
+  if ((njobs < 1) || (njobs > MAXJOBS))
+    PANIC("Number of jobs (%d) out of range 1..%d", njobs, MAXJOBS);
+
+  Pool pool = {.njobs = njobs, .fn = fn, .context = context};
+  pool.queues = calloc(njobs, sizeof(Queue));
+  pool.workers = calloc(njobs, sizeof(Worker));
+  if (!pool.queues || !pool.workers) PANIC_OOM();
+
+  // Deal the tasks round-robin
+  for (int w = 0; w < njobs; w++) {
+    Queue *q = &pool.queues[w];
+    pthread_mutex_init(&q->lock, NULL);
+    q->tasks = malloc((ntasks / njobs + 1) * sizeof(int));
+    if (!q->tasks) PANIC_OOM();
+    for (int t = w; t < ntasks; t += njobs)
+      q->tasks[q->tail++] = t;
+  }
+
+  for (int w = 0; w < njobs; w++) {
+    pool.workers[w] = (Worker){.id = w, .core = cores[w], .pool = &pool};
+    if (pthread_create(&pool.workers[w].thread, NULL,
+		       worker_main, &pool.workers[w]))
+      PANIC("Failed to start worker thread %d", w);
+  }
+  for (int w = 0; w < njobs; w++)
+    pthread_join(pool.workers[w].thread, NULL);
+
+  for (int w = 0; w < njobs; w++) {
+    pthread_mutex_destroy(&pool.queues[w].lock);
+    free(pool.queues[w].tasks);
+  }
+  free(pool.queues);
+  free(pool.workers);
+}
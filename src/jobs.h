@@ -0,0 +1,51 @@
+//  -*- Mode: C; -*-
+//
+//  jobs.h  Running independent tasks on pinned worker threads
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef jobs_h
+#define jobs_h
+
+#include "bestguess.h"
+
+// Each worker thread is pinned to its own core, and child processes
+// inherit the affinity of the thread that launched them, so every
+// child runs on the core of its worker.  Tasks are numbered
+// 0..ntasks-1 and are dealt round-robin to the workers.  A worker
+// runs its own tasks in increasing order, and when it runs out, it
+// steals from the far end of another worker's queue.
+
+// Upper limit on the number of workers
+#define MAXJOBS 1024
+
+// The task function is given the task number and the worker number
+// (0..njobs-1).  Tasks must be independent of each other.
+typedef void (TaskFn)(int task, int worker, void *context);
+
+// By default, runs may use any CPU that we are allowed to run on.
+// They can be restricted to the CPUs in 'list' (e.g. "2-3,6"), when
+// not NULL.  When 'harness_cpu' is not negative, the calling thread
+// (which launches the runs, unless there are workers) is pinned to
+// it, and runs may not use it.  With 'no_smt', runs use at most one
+// hardware thread of each core, and none that shares a core with the
+// harness CPU, so that nothing competes with a run for its core.
+// SMT siblings are found in sysfs.  Returns NULL, or an explanation
+// of why the CPUs cannot be restricted that way.
+const char *restrict_cpus(const char *list, int harness_cpu, bool no_smt);
+
+// Fill 'cpus' (of size MAXJOBS) with the CPUs that runs may use, and
+// return how many there are, or 0 if restrict_cpus() was not called
+int restricted_cpus(int *cpus);
+
+// Fill 'cores' with 'njobs' distinct cores that runs may use.
+// Returns false if there are not that many, or if pinning is not
+// supported on this platform.
+bool select_cores(int njobs, int *cores);
+
+// Run all the tasks and return when they are done.  Worker 'w' is
+// pinned to cores[w].
+void run_jobs(int njobs, const int *cores, int ntasks,
+	      TaskFn fn, void *context);
+
+#endif
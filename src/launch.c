@@ -0,0 +1,1055 @@
+//  -*- Mode: C; -*-
+//
+//  launch.c  Starting child processes
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "launch.h"
+#include "forkserver.h"
+#include "utils.h"
+#include "printing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <linux/sched.h>		// struct clone_args, for clone3()
+#endif
+
+extern char **environ;
+
+#define SECOND(a, b, c) b,
+const char *LauncherName[] = {XLaunchers(SECOND)};
+#undef SECOND
+#define THIRD(a, b, c) c,
+const char *LauncherDesc[] = {XLaunchers(THIRD)};
+#undef THIRD
+
+int launcher_from_name(const char *name) {
+  if (!name) PANIC_NULL();
+  for (Launcher i = 0; i < launcherLast; i++)
+    if (strcmp(name, LauncherName[i]) == 0) return i;
+  return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Launch plans
+// -----------------------------------------------------------------------------
+
+// Search PATH the way execvp() does, but once per command instead of
+// once per run.  An empty PATH entry means the current directory.
+// Returns a newly allocated path, or NULL if no executable is found,
+// in which case launch() will fail with ENOENT.
+static char *resolve_executable(const char *name) {
+  if (!name || !*name) return NULL;
+  if (strchr(name, '/')) return strdup(name);
+
+  const char *pathvar = getenv("PATH");
+  if (!pathvar) pathvar = "/bin:/usr/bin";
+
+  char candidate[PATH_MAX];
+  struct stat st;
+  const char *p = pathvar;
+  while (true) {
+    const char *end = strchr(p, ':');
+    int len = end ? (int) (end - p) : (int) strlen(p);
+    int n = snprintf(candidate, PATH_MAX, "%.*s/%s",
+		     len ? len : 1, len ? p : ".", name);
+    if ((n > 0) && (n < PATH_MAX)
+	&& (stat(candidate, &st) == 0) && S_ISREG(st.st_mode)
+	&& (access(candidate, X_OK) == 0))
+      return strdup(candidate);
+    if (!end) break;
+    p = end + 1;
+  }
+  return NULL;
+}
+
+LaunchPlan *new_launch_plan(const char *shell, const char *cmd, bool redirect) {
+  if (!cmd) PANIC_NULL();
+  LaunchPlan *plan = malloc(sizeof(LaunchPlan));
+  if (!plan) PANIC_OOM();
+  plan->args = new_arglist(MAXARGS);
+  if (shell && *shell) {
+    split_unescape(shell, plan->args);
+    add_arg(plan->args, strdup(cmd));
+  } else {
+    split_unescape(cmd, plan->args);
+  }
+  plan->path = (plan->args->next > 0) ? resolve_executable(plan->args->args[0]) : NULL;
+  plan->redirect = redirect;
+  plan->own_group = false;
+  plan->nlimits = 0;
+  plan->pinned = false;
+  plan->nice = NICE_INHERIT;
+  plan->policy = -1;
+  if (DEBUG) {
+    printf("Launch plan (executable %s):\n", plan->path ? plan->path : "not found");
+    print_arglist(plan->args);
+    fflush(NULL);
+  }
+  return plan;
+}
+
+void free_launch_plan(LaunchPlan *plan) {
+  if (!plan) return;
+  free_arglist(plan->args);
+  free(plan->path);
+  free(plan);
+}
+
+void launch_plan_group(LaunchPlan *plan) {
+  if (!plan) PANIC_NULL();
+  plan->own_group = true;
+}
+
+void launch_plan_limit(LaunchPlan *plan, int resource, rlim_t limit) {
+  if (!plan) PANIC_NULL();
+  if (plan->nlimits == MAXLIMITS) PANIC("Too many resource limits");
+  plan->resource[plan->nlimits] = resource;
+  plan->limit[plan->nlimits] = limit;
+  plan->nlimits++;
+}
+
+void launch_plan_affinity(LaunchPlan *plan, const int *cpus, int ncpus) {
+  if (!plan || !cpus) PANIC_NULL();
+#ifdef __linux__
+  CPU_ZERO(&plan->cpus);
+  for (int i = 0; i < ncpus; i++)
+    CPU_SET(cpus[i], &plan->cpus);
+  plan->pinned = (ncpus > 0);
+#else
+  (void) ncpus;
+  PANIC("Pinning to CPUs is supported only on Linux");
+#endif
+}
+
+void launch_plan_priority(LaunchPlan *plan, int nice, int policy) {
+  if (!plan) PANIC_NULL();
+  plan->nice = nice;
+  plan->policy = policy;
+}
+
+int sched_policy_from_name(const char *name) {
+  if (!name) PANIC_NULL();
+#ifdef __linux__
+  if (strcmp(name, "other") == 0) return SCHED_OTHER;
+  if (strcmp(name, "batch") == 0) return SCHED_BATCH;
+  if (strcmp(name, "fifo") == 0) return SCHED_FIFO;
+#endif
+  return -1;
+}
+
+// -----------------------------------------------------------------------------
+// Redirection and other child setup
+// -----------------------------------------------------------------------------
+
+// We open /dev/null once, and the child dup2()s it onto its stdio
+// file descriptors.  Opening it once avoids a syscall per launch, and
+// dup2() is safe to call in a child that shares our address space.
+// The posix_spawn launcher does the same via file actions.  Several
+// threads may launch at once (see --jobs), so these are initialized
+// exactly once, and never modified afterwards.
+
+static int null_fd = -1;
+static posix_spawn_file_actions_t to_devnull;
+static posix_spawnattr_t new_group;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_launch(void) {
+  null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+  if (null_fd < 0) PANIC("Failed to open /dev/null");
+  if (posix_spawn_file_actions_init(&to_devnull) ||
+      posix_spawn_file_actions_adddup2(&to_devnull, null_fd, STDIN_FILENO) ||
+      posix_spawn_file_actions_adddup2(&to_devnull, null_fd, STDOUT_FILENO) ||
+      posix_spawn_file_actions_adddup2(&to_devnull, null_fd, STDERR_FILENO))
+    PANIC("Failed to configure posix_spawn file actions");
+  if (posix_spawnattr_init(&new_group) ||
+      posix_spawnattr_setflags(&new_group, POSIX_SPAWN_SETPGROUP) ||
+      posix_spawnattr_setpgroup(&new_group, 0))
+    PANIC("Failed to configure posix_spawn attributes");
+}
+
+static int devnull(void) {
+  return null_fd;
+}
+
+static bool redirect_stdio(int fd) {
+  return ((dup2(fd, STDIN_FILENO) != -1) &&
+	  (dup2(fd, STDOUT_FILENO) != -1) &&
+	  (dup2(fd, STDERR_FILENO) != -1));
+}
+
+// Runs in the child, before exec, so it makes only system calls.  A
+// CPU time limit gets a hard limit one second above the soft limit,
+// so that the child is first sent SIGXCPU, as setrlimit() intends.
+// SCHED_FIFO gets its lowest priority, which is enough to run ahead
+// of every ordinary process.  When 'out_fd' is not negative, stdout
+// and stderr go there instead of wherever the plan sends them.  When
+// 'cgroup_fd' is not negative, it is the cgroup.procs file of a cgroup
+// that the child joins (writing "0" moves the writer), first, so that
+// everything it does is accounted there.  The move is not part of the
+// run, so its duration goes in 'join_ns'.
+static bool child_setup(const LaunchPlan *plan, int out_fd, int cgroup_fd,
+			volatile int64_t *join_ns) {
+  if (cgroup_fd >= 0) {
+    int64_t before = monotonic_ns();
+    if (write(cgroup_fd, "0", 1) != 1) return false;
+    *join_ns = monotonic_ns() - before;
+  }
+  if (plan->own_group && setpgid(0, 0)) return false;
+  for (int i = 0; i < plan->nlimits; i++) {
+    struct rlimit rl = {.rlim_cur = plan->limit[i], .rlim_max = plan->limit[i]};
+    if (plan->resource[i] == RLIMIT_CPU) rl.rlim_max++;
+    if (setrlimit(plan->resource[i], &rl)) return false;
+  }
+#ifdef __linux__
+  if (plan->pinned && sched_setaffinity(0, sizeof(plan->cpus), &plan->cpus))
+    return false;
+  if (plan->policy >= 0) {
+    struct sched_param param = {.sched_priority = 0};
+    if (plan->policy == SCHED_FIFO)
+      param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    if (sched_setscheduler(0, plan->policy, &param)) return false;
+  }
+#endif
+  if ((plan->nice != NICE_INHERIT) && setpriority(PRIO_PROCESS, 0, plan->nice))
+    return false;
+  if (out_fd >= 0)
+    return ((dup2(devnull(), STDIN_FILENO) != -1) &&
+	    (dup2(out_fd, STDOUT_FILENO) != -1) &&
+	    (dup2(out_fd, STDERR_FILENO) != -1));
+  return (!plan->redirect || redirect_stdio(devnull()));
+}
+
+// -----------------------------------------------------------------------------
+// fork() then exec, the original method
+// -----------------------------------------------------------------------------
+
+// Make a pipe whose ends are closed on exec.  With --jobs, several
+// threads launch commands, and one of them may fork between pipe()
+// and fcntl().  Its child would then hold our write end open, and we
+// would wait on it.  On Linux, pipe2() sets the flag atomically.
+static int pipe_cloexec(int fds[2]) {
+#ifdef __linux__
+  return pipe2(fds, O_CLOEXEC);
+#else
+  if (pipe(fds)) return -1;
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return 0;
+#endif
+}
+
+// Where the kernel supports it (Linux 5.7 and later), clone3() starts
+// the child in the cgroup whose directory 'cgroup_dir' is open on, so
+// that joining it costs the run nothing.  Returns -1 with errno set
+// to ENOSYS when it is not supported, which we remember.
+static pid_t fork_into(int cgroup_dir) {
+#if defined(__linux__) && defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+  static int unsupported = 0;
+  if (!__atomic_load_n(&unsupported, __ATOMIC_RELAXED)) {
+    struct clone_args args = {.flags = CLONE_INTO_CGROUP,
+			      .exit_signal = SIGCHLD,
+			      .cgroup = (uint64_t) cgroup_dir};
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if ((pid >= 0) || ((errno != ENOSYS) && (errno != E2BIG) && (errno != EINVAL)))
+      return (pid_t) pid;
+    __atomic_store_n(&unsupported, 1, __ATOMIC_RELAXED);
+  }
+#else
+  (void) cgroup_dir;
+#endif
+  errno = ENOSYS;
+  return -1;
+}
+
+// The child reports an exec failure by writing errno to a pipe that
+// is closed automatically (FD_CLOEXEC) when exec succeeds.  If it has
+// to join the cgroup itself, it first writes how long that took.
+static pid_t launch_fork(const LaunchPlan *plan, int out_fd, CgroupRun *leaf) {
+  int fds[2];
+  int err = 0;
+  int cgroup_fd = -1;
+  int64_t join_ns = 0;
+  if (pipe_cloexec(fds)) return -1;
+
+  pid_t pid = leaf ? fork_into(leaf->dir) : fork();
+  if (leaf && (pid < 0) && (errno == ENOSYS)) {
+    cgroup_fd = leaf->procs;
+    pid = fork();
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    bool ready = child_setup(plan, out_fd, cgroup_fd, &join_ns);
+    if (cgroup_fd >= 0) {
+      ssize_t ignored = write(fds[1], &join_ns, sizeof(join_ns));
+      (void) ignored;
+    }
+    if (ready) execvp(plan->path, plan->args->args);
+    err = errno;
+    ssize_t ignored = write(fds[1], &err, sizeof(err));
+    (void) ignored;
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid > 0) {
+    if ((cgroup_fd >= 0)
+	&& (read(fds[0], &join_ns, sizeof(join_ns)) != sizeof(join_ns)))
+      join_ns = 0;
+    if (leaf) leaf->join_ns = join_ns;
+    if (read(fds[0], &err, sizeof(err)) == sizeof(err)) {
+      waitpid(pid, NULL, 0);
+      errno = err;
+      pid = -1;
+    }
+  }
+  close(fds[0]);
+  return pid;
+}
+
+// -----------------------------------------------------------------------------
+// Shared address space until exec: clone(CLONE_VM|CLONE_VFORK) or vfork()
+// -----------------------------------------------------------------------------
+
+// The child runs on its own stack, but shares our memory, so it must
+// restrict itself to system calls.  It records a failure to exec in
+// 'err', which we can read after the child exits.  (clone3() cannot
+// start a child in a cgroup here: with CLONE_VM, the child would need
+// a stack and entry point of its own, which only clone() provides.
+// So the child joins the cgroup itself, and records how long that
+// took in 'join_ns'.)
+
+typedef struct ChildArgs {
+  const LaunchPlan *plan;
+  int               out_fd;
+  int               cgroup_fd;
+  volatile int      err;
+  volatile int64_t  join_ns;
+} ChildArgs;
+
+static int child_exec(void *arg) {
+  ChildArgs *ca = arg;
+  if (child_setup(ca->plan, ca->out_fd, ca->cgroup_fd, &ca->join_ns))
+    execvp(ca->plan->path, ca->plan->args->args);
+  ca->err = errno;
+  _exit(127);
+}
+
+#define CHILD_STACK_SIZE (128 * 1024)
+
+static pid_t launch_vfork(const LaunchPlan *plan, int out_fd, CgroupRun *leaf) {
+  ChildArgs ca = {.plan = plan, .out_fd = out_fd,
+		  .cgroup_fd = leaf ? leaf->procs : -1, .err = 0, .join_ns = 0};
+#ifdef __linux__
+  // We are suspended until the child execs or exits, so the child can
+  // use part of our stack frame as its stack.  Each thread that
+  // launches children therefore has its own child stack.
+  char child_stack[CHILD_STACK_SIZE] __attribute__((aligned(16)));
+  // Stack grows down on all the architectures we support
+  pid_t pid = clone(child_exec, child_stack + CHILD_STACK_SIZE,
+		    CLONE_VM | CLONE_VFORK | SIGCHLD, &ca);
+#else
+  pid_t pid = vfork();
+  if (pid == 0) child_exec(&ca);
+#endif
+  // We resume here only after the child has called exec or exited
+  if (leaf) leaf->join_ns = ca.join_ns;
+  if ((pid > 0) && ca.err) {
+    waitpid(pid, NULL, 0);
+    errno = ca.err;
+    return -1;
+  }
+  return pid;
+}
+
+// -----------------------------------------------------------------------------
+// posix_spawn()
+// -----------------------------------------------------------------------------
+
+// Capturing the output needs file actions of its own for each launch
+static pid_t launch_spawn(const LaunchPlan *plan, int out_fd) {
+  pid_t pid;
+  if (plan->nlimits) PANIC("Resource limits require the fork or vfork launcher");
+  if (plan->pinned || (plan->nice != NICE_INHERIT) || (plan->policy >= 0))
+    PANIC("Pinning and scheduling require the fork or vfork launcher");
+  posix_spawn_file_actions_t to_pipe;
+  if (out_fd >= 0) {
+    if (posix_spawn_file_actions_init(&to_pipe) ||
+	posix_spawn_file_actions_adddup2(&to_pipe, null_fd, STDIN_FILENO) ||
+	posix_spawn_file_actions_adddup2(&to_pipe, out_fd, STDOUT_FILENO) ||
+	posix_spawn_file_actions_adddup2(&to_pipe, out_fd, STDERR_FILENO))
+      PANIC("Failed to configure posix_spawn file actions");
+  }
+  int err = posix_spawn(&pid, plan->path,
+			(out_fd >= 0) ? &to_pipe
+			: (plan->redirect ? &to_devnull : NULL),
+			plan->own_group ? &new_group : NULL,
+			plan->args->args, environ);
+  if (out_fd >= 0) posix_spawn_file_actions_destroy(&to_pipe);
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return pid;
+}
+
+// The path was resolved when the plan was made, so it contains a
+// slash and execvp() will not search PATH.  (We still use execvp()
+// for its fallback of running a script without a #! line via sh.)
+pid_t launch(Launcher how, const LaunchPlan *plan) {
+  return launch_capture(how, plan, -1);
+}
+
+pid_t launch_capture(Launcher how, const LaunchPlan *plan, int out_fd) {
+  return launch_into(how, plan, out_fd, NULL);
+}
+
+pid_t launch_into(Launcher how, const LaunchPlan *plan, int out_fd, CgroupRun *leaf) {
+  if (!plan || !plan->args) PANIC_NULL();
+  pthread_once(&init_once, init_launch);
+  if (!plan->path) {
+    errno = ENOENT;
+    return -1;
+  }
+  switch (how) {
+    case launcherFork:
+      return launch_fork(plan, out_fd, leaf);
+    case launcherVfork:
+      return launch_vfork(plan, out_fd, leaf);
+    case launcherSpawn:
+      if (leaf) PANIC("A cgroup requires the fork or vfork launcher");
+      return launch_spawn(plan, out_fd);
+    default:
+      PANIC("Invalid launcher (%d)", how);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Waiting for the child
+// -----------------------------------------------------------------------------
+
+// We want the time at which the child exited, not the time at which
+// we finished reaping it.  Waiting with WNOWAIT returns as soon as
+// the child has terminated but leaves it a zombie, so we can take the
+// timestamp before wait4() does the work of reaping it and collecting
+// its resource usage.
+
+// Returns true if the child exited before the deadline.  On Linux, we
+// poll a pidfd, which becomes readable when the child exits.
+// Elsewhere (or on kernels before 5.3), we check every millisecond.
+static bool exits_by(pid_t pid, int64_t deadline) {
+#ifdef SYS_pidfd_open
+  int fd = (int) syscall(SYS_pidfd_open, pid, 0);
+  if (fd >= 0) {
+    struct pollfd p = {.fd = fd, .events = POLLIN};
+    int ready;
+    do {
+      int64_t left = deadline - monotonic_ns();
+      int ms = (left <= 0) ? 0 : (int) ((left + 999999) / 1000000);
+      ready = poll(&p, 1, ms);
+    } while ((ready < 0) ? (errno == EINTR)
+	     : ((ready == 0) && (monotonic_ns() < deadline)));
+    close(fd);
+    return (ready > 0);
+  }
+#endif
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000};
+  siginfo_t info;
+  while (true) {
+    info.si_pid = 0;
+    if ((waitid(P_PID, (id_t) pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+	&& (info.si_pid == pid))
+      return true;
+    if (monotonic_ns() >= deadline) return false;
+    nanosleep(&pause, NULL);
+  }
+}
+
+#ifdef __linux__
+// Delay accounting can be switched off (kernel.task_delayacct, since
+// Linux 5.14), in which case the block I/O delay reads as zero
+static bool delayacct_enabled(void) {
+  static int enabled = -1;
+  if (enabled < 0) {
+    FILE *f = fopen("/proc/sys/kernel/task_delayacct", "r");
+    enabled = 1;
+    if (f) {
+      if (fscanf(f, "%d", &enabled) != 1) enabled = 0;
+      fclose(f);
+    }
+  }
+  return enabled;
+}
+
+// The scheduler statistics are all zero when the kernel is not
+// keeping them, but a child that ran was given a CPU at least once
+static void read_child_schedstat(pid_t pid, ChildAcct *acct) {
+  char path[64];
+  long long oncpu, runq, slices;
+  snprintf(path, sizeof(path), "/proc/%d/schedstat", (int) pid);
+  FILE *f = fopen(path, "r");
+  if (!f) return;
+  if ((fscanf(f, "%lld %lld %lld", &oncpu, &runq, &slices) == 3)
+      && (slices > 0)) {
+    acct->oncpu_ns = oncpu;
+    acct->runq_ns = runq;
+    acct->slices = slices;
+  }
+  fclose(f);
+}
+
+// Fields of /proc/<pid>/stat are counted from 1.  The command name
+// (field 2) may contain spaces, so we count from the closing
+// parenthesis, which precedes field 3, and which is returned (or
+// NULL).  Field N then follows the (N-2)th space after it.
+static char *read_proc_stat(pid_t pid, char *buf, size_t size) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+  FILE *f = fopen(path, "r");
+  if (!f) return NULL;
+  size_t len = fread(buf, 1, size - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+  return strrchr(buf, ')');
+}
+#endif
+
+int64_t child_cpu(pid_t pid) {
+  int64_t cpu = -1;
+#ifdef __linux__
+  char buf[1024];
+  long long value;
+  char *p = read_proc_stat(pid, buf, sizeof(buf));
+  for (int field = 2; p && (field < 39); field++)
+    p = strchr(p + 1, ' ');
+  if (p && (sscanf(p, " %lld", &value) == 1)) cpu = value;
+#else
+  (void) pid;
+#endif
+  return cpu;
+}
+
+static void read_child_acct(pid_t pid, ChildAcct *acct) {
+  *acct = (ChildAcct) {-1, -1, -1, -1, -1, -1, -1, -1, -1};
+#ifdef __linux__
+  char path[64];
+  char buf[1024];
+  long long value;
+  read_child_schedstat(pid, acct);
+  snprintf(path, sizeof(path), "/proc/%d/io", (int) pid);
+  FILE *f = fopen(path, "r");
+  if (f) {
+    while (fscanf(f, "%63[^:]: %lld\n", buf, &value) == 2) {
+      if (strcmp(buf, "read_bytes") == 0) acct->read_bytes = value;
+      else if (strcmp(buf, "write_bytes") == 0) acct->write_bytes = value;
+      else if (strcmp(buf, "syscr") == 0) acct->syscr = value;
+      else if (strcmp(buf, "syscw") == 0) acct->syscw = value;
+    }
+    fclose(f);
+  }
+  // Fields 39 (processor) and 42 (block I/O delay, in clock ticks)
+  // of /proc/<pid>/stat
+  char *p = read_proc_stat(pid, buf, sizeof(buf));
+  for (int field = 2; p && (field < 42); field++) {
+    p = strchr(p + 1, ' ');
+    if (p && (field == 38) && (sscanf(p, " %lld", &value) == 1))
+      acct->cpu = value;
+  }
+  if (p && delayacct_enabled() && (sscanf(p, " %lld", &value) == 1))
+    acct->blkio_us = value * MICROSECS / sysconf(_SC_CLK_TCK);
+#else
+  (void) pid;
+#endif
+}
+
+pid_t wait_for_exit(pid_t pid, int64_t deadline, int *status,
+		    struct rusage *ru, ChildAcct *acct,
+		    int64_t *exit_ns, bool *timed_out) {
+  siginfo_t info;
+  int err;
+  *timed_out = false;
+  if ((deadline >= 0) && !exits_by(pid, deadline)) {
+    *timed_out = true;
+    kill(-pid, SIGKILL);
+  }
+  do {
+    err = waitid(P_PID, (id_t) pid, &info, WEXITED | WNOWAIT);
+  } while ((err == -1) && (errno == EINTR));
+  *exit_ns = monotonic_ns();
+  if (acct) read_child_acct(pid, acct);
+  return wait4(pid, status, 0, ru);
+}
+
+bool set_subreaper(bool on) {
+#ifdef PR_SET_CHILD_SUBREAPER
+  return (prctl(PR_SET_CHILD_SUBREAPER, on ? 1 : 0, 0, 0, 0) == 0);
+#else
+  (void) on;
+  return false;
+#endif
+}
+
+static void add_descendant(Descendants *d, const struct rusage *ru) {
+  d->reaped++;
+  d->ru.ru_utime.tv_sec += ru->ru_utime.tv_sec;
+  d->ru.ru_utime.tv_usec += ru->ru_utime.tv_usec;
+  d->ru.ru_stime.tv_sec += ru->ru_stime.tv_sec;
+  d->ru.ru_stime.tv_usec += ru->ru_stime.tv_usec;
+  d->ru.ru_utime.tv_sec += d->ru.ru_utime.tv_usec / MICROSECS;
+  d->ru.ru_utime.tv_usec %= MICROSECS;
+  d->ru.ru_stime.tv_sec += d->ru.ru_stime.tv_usec / MICROSECS;
+  d->ru.ru_stime.tv_usec %= MICROSECS;
+  if (ru->ru_maxrss > d->ru.ru_maxrss) d->ru.ru_maxrss = ru->ru_maxrss;
+  d->ru.ru_minflt += ru->ru_minflt;
+  d->ru.ru_majflt += ru->ru_majflt;
+  d->ru.ru_nvcsw += ru->ru_nvcsw;
+  d->ru.ru_nivcsw += ru->ru_nivcsw;
+}
+
+// A descendant that started a session of its own (a daemon) has left
+// the process group, so we find our children by their parent pid,
+// which is field 4 of /proc/<pid>/stat
+static void kill_children(void) {
+#ifdef __linux__
+  DIR *proc = opendir("/proc");
+  if (!proc) return;
+  pid_t self = getpid();
+  struct dirent *entry;
+  char path[300], buf[512];
+  while ((entry = readdir(proc))) {
+    if ((*entry->d_name < '0') || (*entry->d_name > '9')) continue;
+    snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+    FILE *f = fopen(path, "r");
+    if (!f) continue;
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    char *p = strrchr(buf, ')');
+    int ppid;
+    if (p && (sscanf(p + 1, " %*c %d", &ppid) == 1) && (ppid == self))
+      kill((pid_t) strtol(entry->d_name, NULL, 10), SIGKILL);
+  }
+  closedir(proc);
+#endif
+}
+
+// Orphans that have already exited when we start are reaped first.
+// We cannot know when they exited, only that it was (all but) before
+// the child did, so they leave 'last_exit_ns' alone.  The others are
+// stragglers.  As in wait_for_exit(), each exit is timestamped while
+// the straggler is still a zombie, before wait4() reaps it.  We check
+// on them every millisecond, which is the resolution of those times.
+void wait_for_descendants(pid_t pgid, int64_t deadline, Descendants *d) {
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000};
+  struct rusage ru;
+  siginfo_t info;
+  int status;
+  pid_t pid;
+  memset(d, 0, sizeof(Descendants));
+  d->last_exit_ns = -1;
+  while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0)
+    add_descendant(d, &ru);
+  if ((pid < 0) && (errno == ECHILD)) return;
+  while (true) {
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+      if (errno == EINTR) continue;
+      return;			// ECHILD: none left
+    }
+    if (info.si_pid != 0) {
+      int64_t exit_ns = monotonic_ns();
+      if (wait4(info.si_pid, &status, 0, &ru) > 0) {
+	add_descendant(d, &ru);
+	d->stragglers++;
+	d->last_exit_ns = exit_ns;
+      }
+      continue;
+    }
+    if (monotonic_ns() >= deadline) {
+      if (!d->killed) kill(-pgid, SIGKILL);
+      d->killed = true;
+      // Children of children we kill become ours in turn
+      kill_children();
+    }
+    nanosleep(&pause, NULL);
+  }
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+  (void) pid;
+  return -1;
+#endif
+}
+
+static bool has_exited(pid_t pid);
+
+// On Linux, ppoll() sleeps to the nanosecond, which matters when runs
+// are scheduled less than a millisecond apart
+int wait_for_any(const pid_t *pids, const int *pidfds, int n, int64_t deadline) {
+  if ((n > 0) && (!pids || !pidfds)) PANIC_NULL();
+  if ((n < 0) || (n > MAXINFLIGHT)) PANIC("Invalid number of children (%d)", n);
+  if ((n == 0) && (deadline < 0)) PANIC("No children to wait for");
+  struct pollfd p[MAXINFLIGHT];
+  bool all_pidfds = true;
+  for (int i = 0; i < n; i++) {
+    p[i] = (struct pollfd) {.fd = pidfds[i], .events = POLLIN};
+    if (pidfds[i] < 0) all_pidfds = false;
+  }
+  while (true) {
+    if (!all_pidfds)
+      for (int i = 0; i < n; i++)
+	if ((pidfds[i] < 0) && has_exited(pids[i])) return i;
+    int64_t left = -1;
+    if (deadline >= 0) {
+      left = deadline - monotonic_ns();
+      if (left <= 0) return -1;
+    }
+    if (!all_pidfds && ((left < 0) || (left > 1000000))) left = 1000000;
+#ifdef __linux__
+    struct timespec ts = {.tv_sec = left / NANOSECS, .tv_nsec = left % NANOSECS};
+    int ready = ppoll(p, n, (left < 0) ? NULL : &ts, NULL);
+#else
+    int ready = poll(p, n, (left < 0) ? -1 : (int) ((left + 999999) / 1000000));
+#endif
+    if ((ready < 0) && (errno != EINTR)) PANIC("poll failed: %s", strerror(errno));
+    if (ready > 0)
+      for (int i = 0; i < n; i++)
+	if (p[i].revents) return i;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Capturing output
+// -----------------------------------------------------------------------------
+
+// A larger pipe lets the child write more before it must wait for us.
+// Unprivileged processes can ask for up to fs.pipe-max-size (1MB by
+// default), and we settle for less if that fails.
+#define OUTPUT_PIPE_SIZE (1024 * 1024)
+
+bool open_output_pipe(int fds[2]) {
+  if (pipe_cloexec(fds)) return false;
+  // Only our end is non-blocking; the child's writes should block
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+  fcntl(fds[0], F_SETPIPE_SZ, OUTPUT_PIPE_SIZE);
+#endif
+  return true;
+}
+
+static int64_t thread_cpu_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) return 0;
+  return (int64_t) ts.tv_sec * NANOSECS + ts.tv_nsec;
+}
+
+// Discard what is in the pipe.  Returns as read() does, with -1 and
+// EAGAIN when the pipe is empty.  On Linux, splice() moves the pages
+// of the pipe to /dev/null without copying them to us.
+static ssize_t discard(int fd) {
+#ifdef SPLICE_F_NONBLOCK
+  ssize_t n = splice(fd, NULL, devnull(), NULL, OUTPUT_PIPE_SIZE,
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if ((n >= 0) || (errno != EINVAL)) return n;
+#endif
+  char buf[65536];
+  return read(fd, buf, sizeof(buf));
+}
+
+// Returns the number of bytes discarded, and sets 'eof'
+static int64_t discard_all(int fd, bool *eof) {
+  int64_t total = 0;
+  ssize_t n;
+  while (((n = discard(fd)) > 0) || ((n < 0) && (errno == EINTR)))
+    if (n > 0) total += n;
+  *eof = (n == 0);
+  return total;
+}
+
+static bool has_exited(pid_t pid) {
+  siginfo_t info;
+  info.si_pid = 0;
+  return ((waitid(P_PID, (id_t) pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+	  && (info.si_pid == pid));
+}
+
+// We stop when every writer has closed the pipe, or when the child
+// exits, because something it started may hold the pipe open.  As in
+// exits_by(), we wait on a pidfd where we can, and otherwise check
+// every millisecond.
+void drain_output(pid_t pid, int fd, int64_t deadline, ChildOutput *out) {
+  if (!out) PANIC_NULL();
+  *out = (ChildOutput) {.first_ns = -1, .bytes = 0, .exit_ns = -1,
+			.drain_ns = 0, .full = 0};
+  int64_t cpu_start = thread_cpu_ns();
+  int capacity = 65536;
+#ifdef F_GETPIPE_SZ
+  capacity = fcntl(fd, F_GETPIPE_SZ);
+#endif
+  struct pollfd p[2] = {{.fd = fd, .events = POLLIN}, {.fd = -1, .events = POLLIN}};
+#ifdef SYS_pidfd_open
+  p[1].fd = (int) syscall(SYS_pidfd_open, pid, 0);
+#endif
+  bool eof = false;
+  while (!eof) {
+    int ms = (p[1].fd < 0) ? 1 : -1;
+    if (deadline >= 0) {
+      int64_t left = deadline - monotonic_ns();
+      if (left <= 0) break;
+      int until = (int) ((left + 999999) / 1000000);
+      if ((ms < 0) || (until < ms)) ms = until;
+    }
+    int ready = poll(p, (p[1].fd < 0) ? 1 : 2, ms);
+    if ((ready < 0) && (errno != EINTR)) break;
+    int64_t now = monotonic_ns();
+    if ((ready > 0) && p[0].revents) {
+      int pending;
+      if ((ioctl(fd, FIONREAD, &pending) == 0) && (pending >= capacity))
+	out->full++;
+      int64_t n = discard_all(fd, &eof);
+      if ((n > 0) && (out->first_ns < 0)) out->first_ns = now;
+      out->bytes += n;
+    }
+    if ((p[1].fd >= 0) ? ((ready > 0) && p[1].revents) : has_exited(pid)) {
+      out->exit_ns = now;
+      int64_t n = discard_all(fd, &eof);
+      if ((n > 0) && (out->first_ns < 0)) out->first_ns = now;
+      out->bytes += n;
+      break;
+    }
+  }
+  if (p[1].fd >= 0) close(p[1].fd);
+  out->drain_ns = thread_cpu_ns() - cpu_start;
+}
+
+// -----------------------------------------------------------------------------
+// Fork server
+// -----------------------------------------------------------------------------
+
+static char *lib_relative_to_exe(const char *exe, const char *reldir) {
+  char *path;
+  const char *slash = strrchr(exe, '/');
+  int dirlen = slash ? (int) (slash - exe) : 0;
+  ASPRINTF(&path, "%.*s%s/%s", dirlen, exe, reldir, FORKSERVER_LIB);
+  if (access(path, R_OK) == 0) return path;
+  free(path);
+  return NULL;
+}
+
+char *fork_server_lib(void) {
+#ifdef __linux__
+  char exe[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len <= 0) return NULL;
+  exe[len] = '\0';
+  char *path = lib_relative_to_exe(exe, "");
+  if (!path) path = lib_relative_to_exe(exe, "/../lib");
+  return path;
+#else
+  return NULL;
+#endif
+}
+
+static bool read_all(int fd, void *buf, size_t len) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t) n;
+  }
+  return true;
+}
+
+// The server inherits one end of each pipe, and learns their numbers
+// from its environment.  Our ends are closed on exec.  The server's
+// ends are too, until just before we launch it.  We set the
+// environment only while launching the server, so that the prepare
+// command, for example, is not affected.
+ForkServer *start_fork_server(Launcher how, const LaunchPlan *plan,
+			      const char *lib) {
+  if (!plan || !lib) PANIC_NULL();
+  int request[2], report[2];
+  if (pipe_cloexec(request) || pipe_cloexec(report))
+    PANIC("Failed to create pipes for fork server");
+
+  char *fds, *preload;
+  const char *old_preload = getenv("LD_PRELOAD");
+  ASPRINTF(&fds, "%d,%d", request[0], report[1]);
+  if (old_preload && *old_preload)
+    ASPRINTF(&preload, "%s:%s", lib, old_preload);
+  else
+    ASPRINTF(&preload, "%s", lib);
+  char *saved_preload = old_preload ? strdup(old_preload) : NULL;
+  if (setenv(FORKSERVER_ENV, fds, 1) || setenv("LD_PRELOAD", preload, 1))
+    PANIC("Failed to set environment for fork server");
+
+  fcntl(request[0], F_SETFD, 0);
+  fcntl(report[1], F_SETFD, 0);
+  pid_t pid = launch(how, plan);
+
+  unsetenv(FORKSERVER_ENV);
+  if (saved_preload) setenv("LD_PRELOAD", saved_preload, 1);
+  else unsetenv("LD_PRELOAD");
+  free(saved_preload);
+  free(preload);
+  free(fds);
+  close(request[0]);
+  close(report[1]);
+
+  char ready = 0;
+  if ((pid < 0) || !read_all(report[0], &ready, 1) || (ready != FORKSERVER_READY)) {
+    close(request[1]);
+    close(report[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    return NULL;
+  }
+  ForkServer *fs = malloc(sizeof(ForkServer));
+  if (!fs) PANIC_OOM();
+  *fs = (ForkServer) {.pid = pid, .request = request[1], .report = report[0]};
+  return fs;
+}
+
+bool fork_server_run(ForkServer *fs, int *status,
+		     struct rusage *ru, int64_t *wall_ns) {
+  if (!fs || !status || !ru || !wall_ns) PANIC_NULL();
+  ForkServerReport r;
+  char c = 0;
+  if ((write(fs->request, &c, 1) != 1) || !read_all(fs->report, &r, sizeof(r))) {
+    errno = EPIPE;
+    return false;
+  }
+  if (r.err) {
+    errno = r.err;
+    return false;
+  }
+  *status = r.status;
+  *ru = r.ru;
+  *wall_ns = r.wall_ns;
+  return true;
+}
+
+void stop_fork_server(ForkServer *fs) {
+  if (!fs) return;
+  close(fs->request);
+  close(fs->report);
+  waitpid(fs->pid, NULL, 0);
+  free(fs);
+}
+
+// -----------------------------------------------------------------------------
+// Launch overhead report
+// -----------------------------------------------------------------------------
+
+// How many launches of the null command we time per launcher
+#define REPORT_LAUNCHES 200
+#define NULL_COMMAND "true"
+
+// Median time (ns) from the start of the launch until the child has
+// successfully called exec, which is when a pipe marked FD_CLOEXEC
+// closes.  This is the launch overhead that lands inside every
+// wall clock measurement.  Returns -1 on error.
+static int64_t median_time_to_exec(Launcher how, const LaunchPlan *plan) {
+  int64_t times[REPORT_LAUNCHES];
+  int fds[2];
+  char c;
+  for (int i = 0; i < REPORT_LAUNCHES; i++) {
+    if (pipe_cloexec(fds)) return -1;
+    int64_t start = monotonic_ns();
+    pid_t pid = launch(how, plan);
+    close(fds[1]);
+    if (pid > 0)
+      while (read(fds[0], &c, 1) > 0);
+    times[i] = monotonic_ns() - start;
+    close(fds[0]);
+    if (pid < 0) return -1;
+    waitpid(pid, NULL, 0);
+  }
+  qsort(times, REPORT_LAUNCHES, sizeof(int64_t), compare_int64);
+  return times[REPORT_LAUNCHES / 2];
+}
+
+// Median time (ns) to compile a launch plan for 'cmd'.  Before
+// plans, this parsing, allocation, and PATH search happened on every
+// run.
+static int64_t median_time_to_plan(const char *shell, const char *cmd) {
+  int64_t times[REPORT_LAUNCHES];
+  for (int i = 0; i < REPORT_LAUNCHES; i++) {
+    int64_t start = monotonic_ns();
+    LaunchPlan *plan = new_launch_plan(shell, cmd, true);
+    times[i] = monotonic_ns() - start;
+    free_launch_plan(plan);
+  }
+  qsort(times, REPORT_LAUNCHES, sizeof(int64_t), compare_int64);
+  return times[REPORT_LAUNCHES / 2];
+}
+
+void print_launch_report(const char *shell, const char *cmd) {
+  int64_t median[launcherLast];
+  LaunchPlan *null_plan = new_launch_plan(NULL, NULL_COMMAND, true);
+  for (Launcher i = 0; i < launcherLast; i++)
+    median[i] = median_time_to_exec(i, null_plan);
+  free_launch_plan(null_plan);
+  int64_t planning = cmd ? median_time_to_plan(shell, cmd) : -1;
+
+  DisplayTable *t = new_display_table(78,
+				      4,
+				      (int []){8,12,12,38,END},
+				      (int []){2,1,1,2,END},
+				      "|lrrl|", true, true);
+  int row = 0;
+  display_table_fullspan(t, row++, 'c', "Launch Overhead (median of %d launches of '%s')",
+			 REPORT_LAUNCHES, NULL_COMMAND);
+  display_table_blankline(t, row++);
+  display_table_set(t, row, 0, "Launcher");
+  display_table_set(t, row, 1, "To exec");
+  display_table_set(t, row, 2, "Saves");
+  display_table_set(t, row, 3, "Method");
+  row++;
+  for (Launcher i = 0; i < launcherLast; i++) {
+    display_table_set(t, row, 0, "%s%s", LauncherName[i],
+		      ((int) i == option.launcher) ? "*" : "");
+    if (median[i] < 0) {
+      display_table_set(t, row, 1, "failed");
+    } else {
+      display_table_set(t, row, 1, "%8.1f μs", (double) median[i] / 1000.0);
+      if ((i != launcherFork) && (median[launcherFork] >= 0))
+	display_table_set(t, row, 2, "%8.1f μs",
+			  (double) (median[launcherFork] - median[i]) / 1000.0);
+    }
+    display_table_set(t, row, 3, "%s", LauncherDesc[i]);
+    row++;
+  }
+  if (planning >= 0) {
+    display_table_blankline(t, row++);
+    display_table_set(t, row, 0, "plan");
+    display_table_set(t, row, 1, "%8.1f μs", (double) planning / 1000.0);
+    display_table_set(t, row, 3, "Parse and resolve once, not per run");
+    row++;
+  }
+  display_table_blankline(t, row++);
+  display_table_span(t, row++, 0, 3, 'l', "* Launcher in use for this experiment");
+  display_table(t, 2);
+  free_display_table(t);
+  printf("\n");
+  fflush(stdout);
+}
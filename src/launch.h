@@ -0,0 +1,233 @@
+//  -*- Mode: C; -*-
+//
+//  launch.h  Starting child processes
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef launch_h
+#define launch_h
+
+#include "bestguess.h"
+#include "utils.h"
+#include "cgroup.h"
+#include <sys/types.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// The launcher is the mechanism used to start each child process.
+// The original method was fork() followed by execvp(), but fork()
+// must copy the page tables of Bestguess, and that cost grows with
+// our RSS (e.g. when the Usage array is large).  The other launchers
+// share the parent address space until the child calls exec.
+
+#define XLaunchers(X)						\
+  X(launcherFork,  "fork",  "fork() then exec (original method)")	\
+  X(launcherVfork, "vfork", "clone(CLONE_VM|CLONE_VFORK) then exec")	\
+  X(launcherSpawn, "spawn", "posix_spawn()")				\
+  X(launcherLast,   NULL,   "SENTINEL")
+
+#define FIRST(a, b, c) a,
+typedef enum { XLaunchers(FIRST) } Launcher;
+#undef FIRST
+extern const char *LauncherName[];
+extern const char *LauncherDesc[];
+
+#define DEFAULT_LAUNCHER launcherVfork
+
+// Returns -1 if 'name' is not a launcher name
+int launcher_from_name(const char *name);
+
+// A launch plan is compiled once per command (and once for the
+// prepare command) and reused for every warmup and timed run, so that
+// no parsing, allocation, or PATH search happens between the
+// timestamps that bracket a run.  Plans are not modified after
+// they are configured (below).
+
+// At most one limit per resource that we support
+#define MAXLIMITS 3
+
+typedef struct LaunchPlan {
+  arglist *args;	// Owns the argv strings; args->args is argv
+  char    *path;	// Resolved executable, or NULL if not found
+  bool     redirect;	// Connect stdin/stdout/stderr to /dev/null
+  bool     own_group;	// Child leads a new process group
+  int      nlimits;
+  int      resource[MAXLIMITS];	// E.g. RLIMIT_CPU
+  rlim_t   limit[MAXLIMITS];
+  bool     pinned;	// Child runs only on 'cpus' (Linux)
+#ifdef __linux__
+  cpu_set_t cpus;
+#endif
+  int      nice;	// Or NICE_INHERIT
+  int      policy;	// E.g. SCHED_BATCH, or -1 to inherit
+} LaunchPlan;
+
+// When 'shell' is non-empty, the plan runs 'cmd' as a single argument
+// to 'shell'.  Otherwise 'cmd' is split into arguments.
+LaunchPlan *new_launch_plan(const char *shell, const char *cmd, bool redirect);
+void        free_launch_plan(LaunchPlan *plan);
+
+// Configuring a plan: The child can be made the leader of its own
+// process group, so that the whole group can be killed on a timeout,
+// and it can have resource limits set (see setrlimit).  Resource
+// limits are not supported by the spawn launcher.
+void launch_plan_group(LaunchPlan *plan);
+void launch_plan_limit(LaunchPlan *plan, int resource, rlim_t limit);
+
+// The child can also be pinned to a set of CPUs, and given a nice
+// value and a scheduling policy.  These too are not supported by the
+// spawn launcher, and pinning and policies need Linux.  Raising the
+// priority usually needs privileges, without which launch() fails
+// with EPERM.
+void launch_plan_affinity(LaunchPlan *plan, const int *cpus, int ncpus);
+void launch_plan_priority(LaunchPlan *plan, int nice, int policy);
+
+// Returns a scheduling policy (other, batch, fifo) for
+// launch_plan_priority(), or -1 if unknown or not supported here
+int sched_policy_from_name(const char *name);
+
+// Start a child process according to 'plan'.  Returns the child pid,
+// or -1 with errno set when the child could not be started or could
+// not exec.
+pid_t launch(Launcher how, const LaunchPlan *plan);
+
+// Like launch(), but when 'out_fd' is not negative, the child's stdout
+// and stderr go to it, and its stdin to /dev/null
+pid_t launch_capture(Launcher how, const LaunchPlan *plan, int out_fd);
+
+// Like launch_capture(), but when 'leaf' is not NULL, the child runs
+// in that cgroup (see cgroup.h).  With the fork launcher, on Linux 5.7
+// and later, the child starts there (clone3 with CLONE_INTO_CGROUP).
+// Otherwise, it moves itself there before exec, and leaf->join_ns is
+// set to how long that took, which the caller should not count as
+// part of the run.  Not supported by the spawn launcher.
+pid_t launch_into(Launcher how, const LaunchPlan *plan, int out_fd, CgroupRun *leaf);
+
+// With --capture-output, the child writes to a pipe, and we discard
+// what it writes as it arrives, noting when the first byte came.
+// Draining costs us some CPU time, and if we fall behind, the pipe
+// fills and the child must wait, so both are recorded.
+typedef struct ChildOutput {
+  int64_t first_ns;		// Arrival of first byte, or -1
+  int64_t bytes;
+  int64_t exit_ns;		// Exit of the child, if seen, or -1
+  int64_t drain_ns;		// Our CPU time spent draining
+  int64_t full;			// Times we found the pipe full
+} ChildOutput;
+
+// Our end (fds[0]) is non-blocking.  Both ends are closed on exec,
+// and the child gets its own copy of fds[1] from launch_capture().
+bool open_output_pipe(int fds[2]);
+
+// Discard the output of 'pid' from 'fd' until the pipe is closed or
+// the child exits, or 'deadline' (if not negative) passes.  Times are
+// per monotonic_ns().
+void drain_output(pid_t pid, int fd, int64_t deadline, ChildOutput *out);
+
+// Accounting for a child, read from /proc after it exits but before
+// it is reaped.  The I/O counts include any children it reaped.  The
+// bytes are those that went to (or came from) the storage layer.
+// The block I/O delay (of the main thread) needs the kernel's delay
+// accounting.  The scheduler statistics, from /proc/<pid>/schedstat,
+// are for the main thread only, as is the CPU it last ran on.  Each
+// field is -1 when not available.
+typedef struct ChildAcct {
+  int64_t read_bytes;
+  int64_t write_bytes;
+  int64_t syscr;		// Read system calls
+  int64_t syscw;		// Write system calls
+  int64_t blkio_us;		// Time spent waiting for block I/O
+  int64_t oncpu_ns;		// Time spent running on a CPU
+  int64_t runq_ns;		// Time spent runnable, waiting for a CPU
+  int64_t slices;		// Number of times it was given a CPU
+  int64_t cpu;			// CPU it last ran on
+} ChildAcct;
+
+// The CPU that 'pid' is running on, or last ran on, or -1 when not
+// available
+int64_t child_cpu(pid_t pid);
+
+// Wait for 'pid' to exit, read its accounting into 'acct', then
+// reap it.  The time of exit, as measured by monotonic_ns(), is
+// stored in 'exit_ns'.  If 'deadline' (also per monotonic_ns) is not
+// negative and passes before the child exits, the child's process
+// group is killed and 'timed_out' is set.  The child must lead its
+// own process group in that case.  Returns as wait4() does.
+pid_t wait_for_exit(pid_t pid, int64_t deadline, int *status,
+		    struct rusage *ru, ChildAcct *acct,
+		    int64_t *exit_ns, bool *timed_out);
+
+// A subreaper inherits the orphans among its descendants, instead of
+// init, so it can wait for them.  Only processes orphaned while we
+// are one are inherited.  Returns false where that is not supported
+// (it is a Linux feature, since 3.4).
+bool set_subreaper(bool on);
+
+// What was left of a run after its child exited: the orphaned
+// descendants we reaped, how many of them were still running when we
+// began (stragglers), when the last straggler exited (per
+// monotonic_ns, or -1 if none), whether any had to be killed, and
+// their resource usage, summed.  As with the child, 'ru' covers the
+// descendants that each of them waited for.
+typedef struct Descendants {
+  int           reaped;
+  int           stragglers;
+  int64_t       last_exit_ns;
+  bool          killed;
+  struct rusage ru;
+} Descendants;
+
+// As a subreaper, after reaping the child, wait for every other child
+// we have, which must all be descendants of it.  When 'deadline' (per
+// monotonic_ns) passes, process group 'pgid' is killed, and so is any
+// child of ours that left that group.
+void wait_for_descendants(pid_t pgid, int64_t deadline, Descendants *d);
+
+// With --rate, many children are in flight at once, and we wait for
+// whichever exits first.  On Linux, a pidfd for each child lets us
+// sleep until then.  Returns -1 where pidfds are not supported.
+int open_pidfd(pid_t pid);
+
+// Wait until one of the 'n' children in 'pids' has exited, or until
+// 'deadline' (per monotonic_ns) passes.  With no deadline (-1), 'n'
+// must be positive.  A child whose pidfd is -1 is checked every
+// millisecond.  Returns the index of a child that has exited but is
+// not yet reaped (see wait_for_exit), or -1 if the deadline passed.
+int wait_for_any(const pid_t *pids, const int *pidfds, int n, int64_t deadline);
+
+// A fork server (see forkserver.h) runs the command in 'plan' once,
+// with our shim library preloaded, and then forks a fresh child of
+// that process for each run.  Supported on Linux (glibc) only.
+typedef struct ForkServer {
+  pid_t pid;
+  int   request;		// We write requests here
+  int   report;			// And read the results here
+} ForkServer;
+
+// Path of the shim library, which is installed next to (or in ../lib
+// relative to) the bestguess executable.  Returns NULL if not found.
+char *fork_server_lib(void);
+
+// Returns NULL, with the server reaped, if the command exited without
+// becoming a fork server (e.g. because it is statically linked).
+ForkServer *start_fork_server(Launcher how, const LaunchPlan *plan,
+			      const char *lib);
+
+// Fork one child of the server and wait for it.  The child's wall
+// clock time is measured by the server, from fork until exit.
+// Returns false with errno set if the server could not do the run.
+bool fork_server_run(ForkServer *fs, int *status,
+		     struct rusage *ru, int64_t *wall_ns);
+
+// Close the request pipe, which tells the server to exit, and reap it
+void stop_fork_server(ForkServer *fs);
+
+// Measure how long each launcher takes to get a child to exec, and
+// how long it takes to compile a plan for 'cmd' (which is work we no
+// longer do on every run).  Print a comparison against the fork
+// launcher.
+void print_launch_report(const char *shell, const char *cmd);
+
+#endif
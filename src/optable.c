@@ -231,9 +231,11 @@ static int match_long_option(const char *arg, const char **value) {
 	(*value)++;
 	return n;
       }
-      return OPTABLE_ERR;
+      // Matched only a prefix, e.g. "foo" when arg is "foo-bar", so
+      // keep looking for an option with a longer name
     }
   } // for each possible option name
+  *value = NULL;
   return OPTABLE_ERR;
 }
 
@@ -0,0 +1,423 @@
+//  -*- Mode: C; -*-
+//
+//  pagecache.c  Cold and warm page cache for the files a command uses
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "pagecache.h"
+#include "utils.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <elf.h>
+#include <glob.h>
+#endif
+
+int cache_mode_from_name(const char *name) {
+  if (strcmp(name, "cold") == 0) return CACHE_COLD;
+  if (strcmp(name, "warm") == 0) return CACHE_WARM;
+  return -1;
+}
+
+CacheFiles *new_cache_files(void) {
+  CacheFiles *cf = calloc(1, sizeof(CacheFiles));
+  if (!cf) PANIC_OOM();
+  return cf;
+}
+
+void free_cache_files(CacheFiles *cf) {
+  if (!cf) return;
+  for (int i = 0; i < cf->n; i++) free(cf->paths[i]);
+  free(cf);
+}
+
+// Files beyond MAXCACHEFILES are ignored
+bool cache_files_add(CacheFiles *cf, const char *path) {
+  if (!cf || !path) PANIC_NULL();
+  char real[PATH_MAX];
+  struct stat st;
+  if (!realpath(path, real) || stat(real, &st) || !S_ISREG(st.st_mode))
+    return false;
+  for (int i = 0; i < cf->n; i++)
+    if (strcmp(cf->paths[i], real) == 0) return true;
+  if (cf->n < MAXCACHEFILES) {
+    cf->paths[cf->n] = strdup(real);
+    if (!cf->paths[cf->n]) PANIC_OOM();
+    cf->n++;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Shared libraries
+// -----------------------------------------------------------------------------
+
+#ifdef __linux__
+
+#define MAXSEGMENTS 64
+#define MAXDYNAMIC 1024
+#define MAXNEEDED 128
+#define MAXSTRTAB (1024 * 1024)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HOST_ELFDATA ELFDATA2LSB
+#else
+#define HOST_ELFDATA ELFDATA2MSB
+#endif
+
+// The parts of an ELF file that we need, for either ELF class
+typedef struct ElfInfo {
+  unsigned char class;
+  uint16_t      machine;
+  char          interp[PATH_MAX];	// Empty if none
+  int           nneeded;
+  const char   *needed[MAXNEEDED];	// Point into 'strtab'
+  const char   *rpath;			// Or NULL
+  const char   *runpath;		// Or NULL
+  char         *strtab;
+} ElfInfo;
+
+typedef struct Segment {
+  uint32_t type;
+  uint64_t offset;
+  uint64_t vaddr;
+  uint64_t filesz;
+} Segment;
+
+static bool read_at(int fd, void *buf, size_t len, uint64_t offset) {
+  return pread(fd, buf, len, (off_t) offset) == (ssize_t) len;
+}
+
+// Reads the ELF header, setting the class and machine, and the
+// program headers.  Returns the number of segments, or -1 if this is
+// not an ELF file that we can read.
+static int read_segments(int fd, ElfInfo *info, Segment *seg) {
+  unsigned char ident[EI_NIDENT];
+  uint64_t phoff;
+  uint16_t phnum, phentsize;
+  if (!read_at(fd, ident, EI_NIDENT, 0)
+      || (memcmp(ident, ELFMAG, SELFMAG) != 0)
+      || (ident[EI_DATA] != HOST_ELFDATA))
+    return -1;
+  info->class = ident[EI_CLASS];
+  if (info->class == ELFCLASS64) {
+    Elf64_Ehdr eh;
+    if (!read_at(fd, &eh, sizeof(eh), 0)) return -1;
+    info->machine = eh.e_machine;
+    phoff = eh.e_phoff;
+    phnum = eh.e_phnum;
+    phentsize = eh.e_phentsize;
+    if (phentsize < sizeof(Elf64_Phdr)) return -1;
+  } else if (info->class == ELFCLASS32) {
+    Elf32_Ehdr eh;
+    if (!read_at(fd, &eh, sizeof(eh), 0)) return -1;
+    info->machine = eh.e_machine;
+    phoff = eh.e_phoff;
+    phnum = eh.e_phnum;
+    phentsize = eh.e_phentsize;
+    if (phentsize < sizeof(Elf32_Phdr)) return -1;
+  } else {
+    return -1;
+  }
+  if (phnum > MAXSEGMENTS) phnum = MAXSEGMENTS;
+  for (int i = 0; i < phnum; i++) {
+    uint64_t at = phoff + (uint64_t) i * phentsize;
+    if (info->class == ELFCLASS64) {
+      Elf64_Phdr ph;
+      if (!read_at(fd, &ph, sizeof(ph), at)) return -1;
+      seg[i] = (Segment){ph.p_type, ph.p_offset, ph.p_vaddr, ph.p_filesz};
+    } else {
+      Elf32_Phdr ph;
+      if (!read_at(fd, &ph, sizeof(ph), at)) return -1;
+      seg[i] = (Segment){ph.p_type, ph.p_offset, ph.p_vaddr, ph.p_filesz};
+    }
+  }
+  return phnum;
+}
+
+// The dynamic section gives the string table by its virtual address
+static bool vaddr_to_offset(const Segment *seg, int nseg,
+			    uint64_t vaddr, uint64_t *offset) {
+  for (int i = 0; i < nseg; i++)
+    if ((seg[i].type == PT_LOAD) && (vaddr >= seg[i].vaddr)
+	&& (vaddr < seg[i].vaddr + seg[i].filesz)) {
+      *offset = vaddr - seg[i].vaddr + seg[i].offset;
+      return true;
+    }
+  return false;
+}
+
+// Read one entry of the dynamic section as (tag, value)
+static bool read_dynamic(int fd, const ElfInfo *info, const Segment *dyn,
+			 int i, int64_t *tag, uint64_t *val) {
+  if (info->class == ELFCLASS64) {
+    Elf64_Dyn d;
+    if (((uint64_t) i + 1) * sizeof(d) > dyn->filesz) return false;
+    if (!read_at(fd, &d, sizeof(d), dyn->offset + (uint64_t) i * sizeof(d)))
+      return false;
+    *tag = d.d_tag;
+    *val = d.d_un.d_val;
+  } else {
+    Elf32_Dyn d;
+    if (((uint64_t) i + 1) * sizeof(d) > dyn->filesz) return false;
+    if (!read_at(fd, &d, sizeof(d), dyn->offset + (uint64_t) i * sizeof(d)))
+      return false;
+    *tag = d.d_tag;
+    *val = d.d_un.d_val;
+  }
+  return true;
+}
+
+static void free_elf_info(ElfInfo *info) {
+  free(info->strtab);
+}
+
+// Returns false if 'path' is not an ELF file that we can read.  When
+// it is, the caller must free_elf_info().
+static bool read_elf(const char *path, ElfInfo *info) {
+  Segment seg[MAXSEGMENTS];
+  memset(info, 0, sizeof(ElfInfo));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  int nseg = read_segments(fd, info, seg);
+  if (nseg < 0) {
+    close(fd);
+    return false;
+  }
+  const Segment *dyn = NULL;
+  for (int i = 0; i < nseg; i++) {
+    if ((seg[i].type == PT_INTERP) && (seg[i].filesz < PATH_MAX)
+	&& read_at(fd, info->interp, seg[i].filesz, seg[i].offset))
+      info->interp[seg[i].filesz] = '\0';
+    if (seg[i].type == PT_DYNAMIC) dyn = &seg[i];
+  }
+
+  // Statically linked executables have no dynamic section
+  uint64_t needed[MAXNEEDED];
+  uint64_t strtab = 0, strsz = 0, offset;
+  int64_t rpath = -1, runpath = -1;
+  int64_t tag;
+  uint64_t val;
+  for (int i = 0; dyn && (i < MAXDYNAMIC); i++) {
+    if (!read_dynamic(fd, info, dyn, i, &tag, &val) || (tag == DT_NULL)) break;
+    if ((tag == DT_NEEDED) && (info->nneeded < MAXNEEDED))
+      needed[info->nneeded++] = val;
+    else if (tag == DT_STRTAB) strtab = val;
+    else if (tag == DT_STRSZ) strsz = val;
+    else if (tag == DT_RPATH) rpath = (int64_t) val;
+    else if (tag == DT_RUNPATH) runpath = (int64_t) val;
+  }
+  if (!strtab || !strsz || (strsz > MAXSTRTAB)
+      || !vaddr_to_offset(seg, nseg, strtab, &offset)) {
+    info->nneeded = 0;
+    close(fd);
+    return true;
+  }
+  info->strtab = malloc(strsz + 1);
+  if (!info->strtab) PANIC_OOM();
+  if (!read_at(fd, info->strtab, strsz, offset)) strsz = 0;
+  info->strtab[strsz] = '\0';
+  close(fd);
+
+  int n = 0;
+  for (int i = 0; i < info->nneeded; i++)
+    if (needed[i] < strsz) info->needed[n++] = info->strtab + needed[i];
+  info->nneeded = n;
+  if ((rpath >= 0) && ((uint64_t) rpath < strsz))
+    info->rpath = info->strtab + rpath;
+  if ((runpath >= 0) && ((uint64_t) runpath < strsz))
+    info->runpath = info->strtab + runpath;
+  return true;
+}
+
+// A library must have the same class and machine as its user, which
+// matters where 32-bit and 64-bit libraries are installed side by side
+static bool elf_matches(const char *path, const ElfInfo *user) {
+  ElfInfo info;
+  Segment seg[MAXSEGMENTS];
+  memset(&info, 0, sizeof(info));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool ok = (read_segments(fd, &info, seg) >= 0);
+  close(fd);
+  return ok && (info.class == user->class) && (info.machine == user->machine);
+}
+
+static void append_dir(char *dirs, size_t size, const char *dir) {
+  size_t len = strlen(dirs);
+  snprintf(dirs + len, size - len, "%s%s", len ? ":" : "", dir);
+}
+
+// Each line of /etc/ld.so.conf is a directory, or 'include' and a
+// glob pattern for more such files
+static void read_ld_so_conf(const char *path, char *dirs, size_t size, int depth) {
+  char line[PATH_MAX];
+  FILE *f = fopen(path, "r");
+  if (!f) return;
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "#\r\n")] = '\0';
+    char *p = line + strspn(line, " \t");
+    char *end = p + strlen(p);
+    while ((end > p) && isspace((unsigned char) end[-1])) *--end = '\0';
+    if ((strncmp(p, "include", 7) == 0) && isspace((unsigned char) p[7])) {
+      glob_t g;
+      const char *pattern = p + 8 + strspn(p + 8, " \t");
+      if ((depth < 4) && (glob(pattern, 0, NULL, &g) == 0)) {
+	for (size_t i = 0; i < g.gl_pathc; i++)
+	  read_ld_so_conf(g.gl_pathv[i], dirs, size, depth + 1);
+	globfree(&g);
+      }
+    } else if (*p == '/') {
+      append_dir(dirs, size, p);
+    }
+  }
+  fclose(f);
+}
+
+static const char *default_dirs(void) {
+  static char dirs[8192] = "";
+  static bool initialized = false;
+  if (!initialized) {
+    read_ld_so_conf("/etc/ld.so.conf", dirs, sizeof(dirs), 0);
+    append_dir(dirs, sizeof(dirs), "/lib64:/usr/lib64:/lib:/usr/lib");
+    initialized = true;
+  }
+  return dirs;
+}
+
+// Search a colon-separated list of directories, which may start with
+// $ORIGIN, the directory of the file that needs the library
+static bool find_library(const char *name, const char *dirs,
+			 const char *origin, const ElfInfo *user,
+			 char *found) {
+  if (!dirs) return false;
+  const char *p = dirs;
+  while (true) {
+    const char *end = strchr(p, ':');
+    int len = end ? (int) (end - p) : (int) strlen(p);
+    const char *prefix = "";
+    if ((len >= 7) && (strncmp(p, "$ORIGIN", 7) == 0)) {
+      prefix = origin;
+      p += 7;
+      len -= 7;
+    } else if ((len >= 9) && (strncmp(p, "${ORIGIN}", 9) == 0)) {
+      prefix = origin;
+      p += 9;
+      len -= 9;
+    }
+    int n = snprintf(found, PATH_MAX, "%s%.*s/%s", prefix, len, p, name);
+    if ((n > 0) && (n < PATH_MAX) && (access(found, R_OK) == 0)
+	&& elf_matches(found, user))
+      return true;
+    if (!end) return false;
+    p = end + 1;
+  }
+}
+
+static void add_libraries(CacheFiles *cf, const char *path) {
+  ElfInfo info;
+  if (!read_elf(path, &info)) return;
+  if (info.interp[0]) cache_files_add(cf, info.interp);
+  char origin[PATH_MAX];
+  snprintf(origin, sizeof(origin), "%s", path);
+  char *slash = strrchr(origin, '/');
+  if (slash) *slash = '\0';
+  char found[PATH_MAX];
+  for (int i = 0; i < info.nneeded; i++) {
+    const char *name = info.needed[i];
+    if (strchr(name, '/'))
+      cache_files_add(cf, name);
+    else if ((!info.runpath && find_library(name, info.rpath, origin, &info, found))
+	     || find_library(name, getenv("LD_LIBRARY_PATH"), origin, &info, found)
+	     || find_library(name, info.runpath, origin, &info, found)
+	     || find_library(name, default_dirs(), origin, &info, found))
+      cache_files_add(cf, found);
+  }
+  free_elf_info(&info);
+}
+
+// Every file added here is an ELF file (or a script), so each one is
+// searched for the libraries it needs, until no new ones are found
+void cache_files_add_executable(CacheFiles *cf, const char *path) {
+  if (!cf) PANIC_NULL();
+  if (!path) return;
+  int start = cf->n;
+  cache_files_add(cf, path);
+  for (int i = start; i < cf->n; i++)
+    add_libraries(cf, cf->paths[i]);
+}
+
+#else
+
+void cache_files_add_executable(CacheFiles *cf, const char *path) {
+  if (!cf) PANIC_NULL();
+  if (path) cache_files_add(cf, path);
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Evicting, preloading, and checking
+// -----------------------------------------------------------------------------
+
+void cache_evict(const CacheFiles *cf) {
+  if (!cf) PANIC_NULL();
+#ifdef POSIX_FADV_DONTNEED
+  for (int i = 0; i < cf->n; i++) {
+    int fd = open(cf->paths[i], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+void cache_preload(const CacheFiles *cf) {
+  if (!cf) PANIC_NULL();
+  char buf[65536];
+  for (int i = 0; i < cf->n; i++) {
+    int fd = open(cf->paths[i], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue;
+    while (read(fd, buf, sizeof(buf)) > 0);
+    close(fd);
+  }
+}
+
+// Mapping a file does not read it, and mincore() reports which of
+// its pages are in memory without faulting any of them in
+int64_t cache_resident_pct(const CacheFiles *cf) {
+  if (!cf) PANIC_NULL();
+#ifdef __linux__
+  int64_t pagesize = sysconf(_SC_PAGESIZE);
+  int64_t pages = 0, resident = 0;
+  struct stat st;
+  for (int i = 0; i < cf->n; i++) {
+    int fd = open(cf->paths[i], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+      size_t len = (size_t) st.st_size;
+      void *addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+      size_t n = (len + pagesize - 1) / pagesize;
+      unsigned char *vec = malloc(n);
+      if (!vec) PANIC_OOM();
+      if ((addr != MAP_FAILED) && (mincore(addr, len, vec) == 0)) {
+	pages += n;
+	for (size_t j = 0; j < n; j++) resident += vec[j] & 1;
+      }
+      if (addr != MAP_FAILED) munmap(addr, len);
+      free(vec);
+    }
+    close(fd);
+  }
+  return pages ? (100 * resident + pages / 2) / pages : -1;
+#else
+  return -1;
+#endif
+}
@@ -0,0 +1,64 @@
+//  -*- Mode: C; -*-
+//
+//  pagecache.h  Cold and warm page cache for the files a command uses
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef pagecache_h
+#define pagecache_h
+
+#include "bestguess.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// How long a command takes to start depends on whether its
+// executable and shared libraries (and its input files) are already
+// in the page cache.  With --cache cold, they are evicted before each
+// run, and with --cache warm, they are read in.  No privileges are
+// needed, because we ask the kernel to drop only the pages of these
+// files (posix_fadvise() with POSIX_FADV_DONTNEED), instead of
+// dropping all caches.  The kernel keeps any page that is mapped by
+// a running process, so libraries that we use ourselves (like the C
+// library) stay partly cached.  The fraction of the pages that are
+// cached just before each run is recorded, so that can be seen.
+
+typedef enum CacheMode {
+  CACHE_COLD = 1,
+  CACHE_WARM = 2,
+} CacheMode;
+
+// Returns -1 if 'name' is not "cold" or "warm"
+int cache_mode_from_name(const char *name);
+
+#define MAXCACHEFILES 256
+
+typedef struct CacheFiles {
+  int   n;
+  char *paths[MAXCACHEFILES];	// Absolute, no symlinks, no repeats
+} CacheFiles;
+
+CacheFiles *new_cache_files(void);
+void        free_cache_files(CacheFiles *cf);
+
+// Add a regular file.  Returns false if it is not one.
+bool cache_files_add(CacheFiles *cf, const char *path);
+
+// Add an executable, its program interpreter (the dynamic linker),
+// and the shared libraries it needs, recursively.  Libraries are
+// found from the DT_NEEDED entries of each ELF file, searching the
+// way the dynamic linker does: DT_RPATH, LD_LIBRARY_PATH, DT_RUNPATH,
+// the directories in /etc/ld.so.conf, and the default directories.
+// Libraries loaded with dlopen() cannot be found this way, but can be
+// listed with --cache-file.
+void cache_files_add_executable(CacheFiles *cf, const char *path);
+
+// Drop the cached pages of each file, or read each file in full.
+// Files that can no longer be opened are skipped.
+void cache_evict(const CacheFiles *cf);
+void cache_preload(const CacheFiles *cf);
+
+// The percentage of the pages of the files that are in the page
+// cache, or -1 if that cannot be determined
+int64_t cache_resident_pct(const CacheFiles *cf);
+
+#endif
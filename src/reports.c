@@ -10,6 +10,8 @@
 #include "csv.h"
 #include "graphs.h"
 #include "printing.h"
+#include "cpustate.h"
+#include "pagecache.h"
 #include "cli.h"		// To print hint on changing config settings
 #include "optable.h"		// To print hint on changing config settings
 #include <assert.h>
@@ -93,8 +95,33 @@ static const char *bar(int side, int line) {
     }								\
   } while (0)
 
+typedef struct CountRow {
+  const char *label;
+  Measures   *m;
+  Units      *units;
+} CountRow;
+
+static void print_count_row(CountRow *row, int line) {
+  char *tmp;
+  Units *units = select_units(row->m->max, row->units);
+  printf(LABEL, row->label);
+  PRINTCOUNT(row->m->mode, units, UNITS);
+  printf(GAP);
+  LEFTBAR(line);
+  PRINTCOUNT(row->m->min, units, NOUNITS);
+  printf(GAP);
+  PRINTCOUNT(row->m->Q1, units, NOUNITS);
+  printf(GAP);
+  PRINTCOUNT(row->m->median, units, NOUNITS);
+  printf(GAP);
+  PRINTCOUNT(row->m->Q3, units, NOUNITS);
+  printf(GAP);
+  PRINTCOUNT(row->m->max, units, NOUNITS);
+  RIGHTBAR(line);
+}
+
 void print_summary(Summary *s, bool briefly) {
-  if (!s) {
+  if (!s || (s->runs == 0)) {
     return;
   }
 
@@ -162,21 +189,37 @@ void print_summary(Summary *s, bool briefly) {
     PRINTTIME(s->maxrss.Q3, units);
     PRINTTIMENL(s->maxrss.max, units, MIDLINE);
 
-    units = select_units(s->tcsw.max, count_units);
-    printf(LABEL, "Context sw");
-    PRINTCOUNT(s->tcsw.mode, units, UNITS);
-    printf(GAP);
-    LEFTBAR(BOTTOMLINE);
-    PRINTCOUNT(s->tcsw.min, units, NOUNITS);
-    printf(GAP);
-    PRINTCOUNT(s->tcsw.Q1, units, NOUNITS);
-    printf(GAP);
-    PRINTCOUNT(s->tcsw.median, units, NOUNITS);
-    printf(GAP);
-    PRINTCOUNT(s->tcsw.Q3, units, NOUNITS);
-    printf(GAP);
-    PRINTCOUNT(s->tcsw.max, units, NOUNITS);
-    RIGHTBAR(BOTTOMLINE);
+    // Performance counters are shown only when available
+    CountRow rows[] = {
+      {"Context sw",    &s->tcsw,         count_units},
+      {"Cycles",        &s->cycles,       count_units},
+      {"Instructions",  &s->instructions, count_units},
+      {"IPC",           &s->ipc,          ratio_units},
+      {"Cache refs",    &s->cacherefs,    count_units},
+      {"Cache misses",  &s->cachemisses,  count_units},
+      {"Branch misses", &s->branchmisses, count_units},
+      {"CPU migrations",&s->migrations,   count_units},
+      {"Task clock",    &s->taskclock,    nanotime_units},
+      {"On-CPU time",   &s->oncpu,        nanotime_units},
+      {"Off-CPU time",  &s->offcpu,       time_units},
+      {"Block I/O wait",&s->blkio,        time_units},
+      {"Run queue wait",&s->runq,         nanotime_units},
+      {"Timeslices",    &s->slices,       count_units},
+      {"Read bytes",    &s->readbytes,    space_units},
+      {"Write bytes",   &s->writebytes,   space_units},
+      {"Read calls",    &s->syscr,        count_units},
+      {"Write calls",   &s->syscw,        count_units},
+      {"First byte",    &s->ttfb,         nanotime_units},
+      {"Output bytes",  &s->outbytes,     space_units},
+      {"Output per sec",&s->outrate,      space_units},
+    };
+    int nrows = sizeof(rows) / sizeof(CountRow);
+    int last = 0;
+    for (int i = 1; i < nrows; i++)
+      if (rows[i].m->max >= 0) last = i;
+    for (int i = 0; i <= last; i++)
+      if ((i == 0) || (rows[i].m->max >= 0))
+	print_count_row(&rows[i], (i == last) ? BOTTOMLINE : MIDLINE);
 
   } // if not brief report
 
@@ -400,7 +443,101 @@ void print_distribution_stats(Summary *s) {
   free_display_table(t);
 }
 
-void print_tail_stats(Summary *s) {
+// These are judgement calls.  When the runs in the tail waited for a
+// CPU at least twice as long as the typical run, and that wait is a
+// noticeable part of their wall clock time, the tail is attributed
+// (at least in part) to an oversubscribed system.
+#define RUNQ_TAIL_RATIO 2.0
+#define RUNQ_TAIL_SHARE 0.05
+
+// Median run queue delay, and median share (to 0.01%) of wall clock
+// time spent in the run queue, over the runs whose total CPU time is
+// at least 'threshold'.  Returns the number of such runs.
+static int runq_of_tail(Summary *s, Usage *usage, int start, int end,
+			int64_t threshold, int64_t *delay, double *share) {
+  // See summarize() for which runs are in the sample
+  bool all = (s->runs == end - start);
+  int64_t *X = malloc((end - start) * sizeof(int64_t));
+  int64_t *Y = malloc((end - start) * sizeof(int64_t));
+  if (!X || !Y) PANIC_OOM();
+  int n = 0;
+  for (int i = start; i < end; i++) {
+    if (!all && !COMPLETED(usage, i)) continue;
+    if (get_int64(usage, i, F_TOTAL) < threshold) continue;
+    int64_t wall = get_int64(usage, i, F_WALLNS);
+    X[n] = get_int64(usage, i, F_RUNQ);
+    Y[n] = (wall > 0) ? X[n] * 10000 / wall : 0;
+    n++;
+  }
+  if (n > 0) {
+    qsort(X, n, sizeof(int64_t), compare_int64);
+    qsort(Y, n, sizeof(int64_t), compare_int64);
+    *delay = X[n / 2];
+    *share = (double) Y[n / 2] / 10000.0;
+  }
+  free(X);
+  free(Y);
+  return n;
+}
+
+// Involuntary context switches tell us that a run was preempted, but
+// not for how long.  The run queue delay of the runs in the tail
+// tells us whether they were slow because of the command or because
+// they were waiting for a CPU.
+static void print_runq_tail(Summary *s, Usage *usage, int start, int end) {
+  if (!usage || (s->runq.max < 0) || (s->total.pct95 < 0)) return;
+
+  const char *labels[] = {"All runs", "At or above 95th", "At or above 99th"};
+  int64_t thresholds[] = {0, s->total.pct95, s->total.pct99};
+  int64_t delay[3];
+  double share[3];
+  int count[3];
+  for (int i = 0; i < 3; i++)
+    count[i] = (thresholds[i] < 0) ? 0
+      : runq_of_tail(s, usage, start, end, thresholds[i], &delay[i], &share[i]);
+
+  printf("\n");
+  Units *units = select_units(s->runq.max, nanotime_units);
+  char *tmp;
+  DisplayTable *t = new_display_table(78,
+				      4,
+				      (int []){20,8,14,14,END},
+				      (int []){2,1,1,1,END},
+				      "|lrrr|", true, true);
+  int row = 0;
+  display_table_fullspan(t, row, 'c', "Run Queue Delay in the Tail");
+  row++;
+  display_table_blankline(t, row);
+  row++;
+  display_table_set(t, row, 0, "Total CPU time");
+  display_table_set(t, row, 1, "Runs ");
+  display_table_set(t, row, 2, "Median (%s) ", units->unitname);
+  display_table_set(t, row, 3, "Share of wall ");
+  for (int i = 0; i < 3; i++) {
+    if (count[i] == 0) continue;
+    row++;
+    display_table_set(t, row, 0, "%s", labels[i]);
+    display_table_set(t, row, 1, "%d ", count[i]);
+    tmp = apply_units(delay[i], units, NOUNITS);
+    display_table_set(t, row, 2, "%s ", tmp);
+    free(tmp);
+    display_table_set(t, row, 3, "%4.1f%% ", share[i] * 100.0);
+  }
+  display_table(t, 2);
+  free_display_table(t);
+
+  if (count[1] == 0) return;
+  bool waited = (share[1] >= RUNQ_TAIL_SHARE)
+    && ((double) delay[1] >= RUNQ_TAIL_RATIO * (double) delay[0]);
+  if (waited)
+    printf("  Runs in the tail spent %.1f%% of their wall clock time waiting "
+	   "for a CPU.\n  The system may have been oversubscribed.\n",
+	   share[1] * 100.0);
+  else
+    printf("  Waiting for a CPU does not explain the tail.\n");
+}
+
+void print_tail_stats(Summary *s, Usage *usage, int start, int end) {
   if (!s || (s->runs == 0)) return; // No data
 
   DisplayTable *t;
@@ -464,6 +601,8 @@ void print_tail_stats(Summary *s) {
 
   display_table(t, 2);
   free_display_table(t);
+
+  print_runq_tail(s, usage, start, end);
 }
 
 // -----------------------------------------------------------------------------
@@ -474,6 +613,26 @@ void print_tail_stats(Summary *s) {
 // the array grows dynamically.
 #define ESTIMATED_DATA_POINTS 500
 
+// The calibration (if any) recorded in each input file, and the last
+// batch number read from that file, so that each command can be
+// matched with the calibration done in the same experiment
+static Calibration file_calibration[MAXDATAFILES];
+static int file_last_batch[MAXDATAFILES];
+
+static void read_calibration(const char *key, const char *value, void *context) {
+  Calibration *c = context;
+  if (strcmp(key, OVERHEAD_KEY) == 0)
+    parse_overhead(value, &c->plain);
+  else if (strcmp(key, SHELL_OVERHEAD_KEY) == 0)
+    parse_overhead(value, &c->shell);
+}
+
+static const Calibration *calibration_for_batch(int batch) {
+  for (int i = option.first; i < MAXDATAFILES; i++)
+    if (batch <= file_last_batch[i]) return &file_calibration[i];
+  return NULL;
+}
+
 // TODO: Write macros/funcs for extracting string fields
 Ranking *read_input_files(int argc, char **argv) {
 
@@ -499,13 +658,12 @@ Ranking *read_input_files(int argc, char **argv) {
     input[i] = (strcmp(argv[i], "-") == 0) ? stdin : maybe_open(argv[i], "r");
     if (!input[i]) PANIC_NULL();
     batchincr = lastbatch;
-    // Skip CSV header
+    // Read metadata, then skip CSV header
+    lineno = read_metadata(input[i], read_calibration, &file_calibration[i]) + 1;
     errfield = read_CSVrow(input[i], &row, buf, buflen);
     free_CSVrow(row);
     if (errfield)
       csv_error(argv[i], lineno, "data", errfield, buf, buflen);
-    // Read all the rows
-    lineno = 1;
 
     while (!(errfield = read_CSVrow(input[i], &row, buf, buflen))) {
 
@@ -540,11 +698,14 @@ Ranking *read_input_files(int argc, char **argv) {
 	usage->data[idx].batch = value + batchincr;
       else
 	csv_error(argv[i], lineno, "integer", F_BATCH+1, buf, buflen);
-      // Set all the numeric fields that are measured directly
+      // Set all the numeric fields that are measured directly.
+      // Optional fields may be absent (older files) or empty.
       for (int fc = F_STARTDATA; fc < F_ENDDATA; fc++) {
 	str = CSVfield(row, fc);
 	if (str && try_strtoint64(str, &value))
 	  set_int64(usage, idx, fc, value);
+	else if (FOPTIONAL(fc) && (!str || !*str))
+	  set_int64(usage, idx, fc, -1);
 	else
 	  csv_error(argv[i], lineno, "integer", fc+1, buf, buflen);
       }
@@ -554,13 +715,24 @@ Ranking *read_input_files(int argc, char **argv) {
 		get_int64(usage, idx, F_USER) + get_int64(usage, idx, F_SYSTEM));
       set_int64(usage, idx, F_TCSW,
 		get_int64(usage, idx, F_ICSW) + get_int64(usage, idx, F_VCSW));
+      set_ipc(usage, idx);
+      set_offcpu(usage, idx);
+      // Older files have wall clock time only in μs
+      if (get_int64(usage, idx, F_WALLNS) < 0)
+	set_int64(usage, idx, F_WALLNS, get_int64(usage, idx, F_WALL) * 1000);
+      set_outrate(usage, idx);
+      usage_per_execution(usage, idx, idx + 1);
       free_CSVrow(row);
-      lastbatch = usage->data[idx].batch;
+      // Runs of different commands may be interleaved, so the
+      // last batch number in the file is not necessarily the highest
+      if (usage->data[idx].batch > lastbatch)
+	lastbatch = usage->data[idx].batch;
 
     }
     // Check for error reading this particular file (EOF is ok)
     if (errfield > 0)
       csv_error(argv[i], lineno + 1, "data", errfield, buf, buflen);
+    file_last_batch[i] = lastbatch;
 
   } // For each input file
   
@@ -616,7 +788,9 @@ static void add_ranking(DisplayTable *t,
   }
 
   Units *units = select_units(s->total.median, time_units);
-  char *median_repr = apply_units(s->total.median, units, UNITS);
+  // A command with no completed runs has no median
+  char *median_repr = (s->runs == 0) ? strdup("--")
+    : apply_units(s->total.median, units, UNITS);
   const int cmd_width = 40;
   char *cmd = command_announcement(s->name, s->cmd, cmd_idx, cmd_fmt, cmd_width);
 
@@ -803,7 +977,8 @@ static void print_ranking(Ranking *rank) {
   int same_count = 1;
   for (int i = 1; i < rank->count; i++) {
     s = rank->summaries[rank->index[i]];
-    if (can_rank && s->infer->indistinct) {
+    // No inference when this command has too few (completed) runs
+    if (can_rank && s->infer && s->infer->indistinct) {
       same[i] = rank->index[i];
       same_count++;
     } else {
@@ -887,10 +1062,28 @@ static void print_ranking(Ranking *rank) {
 
 void per_command_output(Summary *s, Usage *usage, int start, int end) {
   if (!s) PANIC_NULL();
-  if (!option.nostats || option.ministats) {
+  if ((s->runs > 0) && (!option.nostats || option.ministats)) {
     print_summary(s, option.ministats);
     printf("\n");
   }
+  // See summarize() for which runs are left out of the statistics
+  if (s->timeout_count || s->limit_count) {
+    printf("%d runs timed out and %d runs exceeded a resource limit%s\n\n",
+	   s->timeout_count, s->limit_count,
+	   (s->runs > 0) ? " (not included above)" : "");
+  }
+  if (s->interfered_count) {
+    printf("%d runs were flagged for interference from other processes%s\n\n",
+	   s->interfered_count,
+	   option.include_interfered ? " (included above)"
+	   : (s->runs > 0) ? " (not included above)" : "");
+  }
+  // With no completed runs, there is nothing to describe (see
+  // report_stop_reason)
+  if (s->runs == 0) {
+    fflush(stdout);
+    return;
+  }
   if (option.graph) {
     print_graph(s, usage, start, end);
     printf("\n");
@@ -900,12 +1093,703 @@ void per_command_output(Summary *s, Usage *usage, int start, int end) {
     printf("\n");
   }
   if (option.tailstats) {
-    print_tail_stats(s);
+    print_tail_stats(s, usage, start, end);
     printf("\n");
   }
   fflush(stdout);
 }
 
+// In parallel mode (--jobs), the runs of each command are spread
+// across several cores.  Runs on different cores should be samples
+// from the same distribution.  When the runs on one core are
+// significantly slower than those on the fastest core (by the same
+// test we use for ranking commands), the parallel runs are probably
+// interfering with each other, e.g. by contending for a shared cache
+// or memory bandwidth, or because cores differ in speed.
+
+#define MAXREPORTCORES 1024
+
+// Median of 'metric' over the runs where field 'fc' has 'value'
+static int64_t median_where(Usage *usage, int start, int end, FieldCode metric,
+			    FieldCode fc, int64_t value) {
+  int64_t *X = malloc((end - start) * sizeof(int64_t));
+  if (!X) PANIC_OOM();
+  int n = 0;
+  for (int i = start; i < end; i++)
+    if (get_int64(usage, i, fc) == value)
+      X[n++] = get_int64(usage, i, metric);
+  qsort(X, n, sizeof(int64_t), compare_int64);
+  int64_t median = X[n / 2];
+  free(X);
+  return median;
+}
+
+// Copy the runs on 'core' into 'sample', which need only hold
+// numbers.  Interference (waiting on a shared cache, memory bus, or
+// lock) shows up in wall clock time more than in CPU time, so we put
+// the wall clock time (in μs, like the total) where compare_samples()
+// looks for the total time.
+static void add_core_sample(Usage *sample, Usage *usage,
+			    int start, int end, int core) {
+  for (int i = start; i < end; i++)
+    if (get_int64(usage, i, F_CORE) == core) {
+      int idx = usage_next(sample);
+      memcpy(sample->data[idx].metrics, usage->data[i].metrics,
+	     sizeof(usage->data[i].metrics));
+      set_int64(sample, idx, F_TOTAL, get_int64(usage, i, F_WALL));
+    }
+}
+
+void report_core_interference(Usage *usage, int start, int end) {
+  int cores[MAXREPORTCORES];
+  int count[MAXREPORTCORES] = {0};
+  int ncores = 0;
+  for (int i = start; i < end; i++) {
+    int64_t core = get_int64(usage, i, F_CORE);
+    if (core < 0) continue;
+    int c = 0;
+    while ((c < ncores) && (cores[c] != core)) c++;
+    if (c == ncores) {
+      if (ncores == MAXREPORTCORES) return;
+      cores[ncores++] = core;
+    }
+    count[c]++;
+  }
+  if (ncores < 2) return;
+
+  int fastest = 0;
+  int64_t best = median_where(usage, start, end, F_WALL, F_CORE, cores[0]);
+  for (int c = 1; c < ncores; c++) {
+    int64_t median =
+      median_where(usage, start, end, F_WALL, F_CORE, cores[c]);
+    if (median < best) {
+      best = median;
+      fastest = c;
+    }
+  }
+
+  int slower = 0;
+  for (int c = 0; c < ncores; c++) {
+    if (c == fastest) continue;
+    Usage *sample = new_usage_array(count[fastest] + count[c]);
+    add_core_sample(sample, usage, start, end, cores[fastest]);
+    add_core_sample(sample, usage, start, end, cores[c]);
+    Inference *infer = compare_samples(sample, config.alpha,
+				       0, count[fastest],
+				       count[fastest], sample->next);
+    if (infer && (infer->indistinct == 0)) {
+      if (!slower++)
+	printf("Warning: Runs on core %d were faster than runs on core(s)",
+	       cores[fastest]);
+      printf(" %d", cores[c]);
+    }
+    free(infer);
+    free_usage_array(sample);
+  }
+  if (slower) {
+    printf(".\n"
+	   "         Parallel runs may be interfering with each other."
+	   "  Consider fewer jobs.\n\n");
+    fflush(stdout);
+  }
+}
+
+#define SECOND(a, b) b,
+static const char *StopReasonDesc[] = {XStopReasons(SECOND)};
+#undef SECOND
+
+// Only an adaptive run count or racing is worth mentioning, because
+// otherwise the number of runs is what the user asked for, unless no
+// run completed, which is why there are no statistics.  This follows
+// the command announcement, so it needs one too.
+void report_stop_reason(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int completed = 0;
+  for (int i = start; i < end; i++)
+    completed += COMPLETED(usage, i);
+  if (!completed) {
+    printf("No runs completed, so there are no statistics\n\n");
+    fflush(stdout);
+  }
+  int64_t reason = get_int64(usage, end - 1, F_STOP);
+  if ((reason <= STOP_FIXED) || (reason >= STOP_LAST)) return;
+  printf("Stopped after %d runs: %s\n\n",
+	 end - start, StopReasonDesc[reason]);
+  fflush(stdout);
+}
+
+// Runs done with --fork-server are not comparable with ordinary runs,
+// because they exclude exec, dynamic linking, and initialization
+void report_fork_server(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  if (get_int64(usage, start, F_FORKED) <= 0) return;
+  printf("Runs were forked from a fork server "
+	 "(excluding exec, dynamic linking, and initialization)\n\n");
+  fflush(stdout);
+}
+
+// With --repeat, each run executed the command several times, and
+// the statistics above are per execution
+void report_repeat(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t k = usage_repeats(usage, start);
+  if (k <= 1) return;
+  printf("Each run executed the command " INT64FMT
+	 " times (values above are per execution)\n\n", k);
+  fflush(stdout);
+}
+
+// Like apply_units() with unit names, but without the padding that
+// aligns table columns, for use in a sentence.  Caller must free.
+static char *units_in_text(int64_t value, Units *units) {
+  char *str = apply_units(value, units, UNITS);
+  size_t lead = strspn(str, " ");
+  size_t len = strlen(str);
+  while ((len > lead) && (str[len - 1] == ' ')) len--;
+  memmove(str, str + lead, len - lead);
+  str[len - lead] = '\0';
+  return str;
+}
+
+// A frequency that drops during a run (power management or thermal
+// throttling), runs that end on different types of cores (on a
+// hybrid CPU), or runs that move from one type to the other can make
+// a distribution bimodal.  A drop of less than this is not worth
+// mentioning.
+#define FREQ_DROP_PCT 10
+
+void report_cpu_state(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int sampled = 0, dropped = 0, perf = 0, eff = 0, typed = 0, moved = 0;
+  int64_t coolest = -1, hottest = -1;
+  for (int i = start; i < end; i++) {
+    int64_t before = get_int64(usage, i, F_FREQSTART);
+    int64_t after = get_int64(usage, i, F_FREQEND);
+    if ((before > 0) && (after > 0)) {
+      sampled++;
+      if (after * 100 <= before * (100 - FREQ_DROP_PCT)) dropped++;
+    }
+    int64_t temps[] = {get_int64(usage, i, F_TEMPSTART),
+		       get_int64(usage, i, F_TEMPEND)};
+    for (int t = 0; t < 2; t++) {
+      if (temps[t] < 0) continue;
+      if ((coolest < 0) || (temps[t] < coolest)) coolest = temps[t];
+      if (temps[t] > hottest) hottest = temps[t];
+    }
+    int64_t type = get_int64(usage, i, F_CORETYPE);
+    int64_t start_type = get_int64(usage, i, F_STARTTYPE);
+    perf += (type == CORE_PERFORMANCE);
+    eff += (type == CORE_EFFICIENCY);
+    if ((type > 0) && (start_type > 0)) {
+      typed++;
+      moved += (type != start_type);
+    }
+  }
+  if (sampled || (hottest >= 0)) {
+    printf("CPU state:");
+    if (sampled)
+      printf(" Frequency dropped by %d%% or more during %d of %d runs.",
+	     FREQ_DROP_PCT, dropped, sampled);
+    if (hottest >= 0)
+      printf(" Temperature %.1f to %.1f °C.",
+	     (double) coolest / 1000.0, (double) hottest / 1000.0);
+    printf("\n\n");
+  }
+  if (perf && eff) {
+    int64_t p = median_where(usage, start, end, F_TOTAL,
+			     F_CORETYPE, CORE_PERFORMANCE);
+    int64_t e = median_where(usage, start, end, F_TOTAL,
+			     F_CORETYPE, CORE_EFFICIENCY);
+    Units *units = select_units((p > e) ? p : e, time_units);
+    char *ptime = units_in_text(p, units);
+    char *etime = units_in_text(e, units);
+    printf("Warning: %d runs ended on performance cores (median total CPU time %s)\n"
+	   "         and %d on efficiency cores (median %s).\n\n",
+	   perf, ptime, eff, etime);
+    free(ptime);
+    free(etime);
+  }
+  if (moved)
+    printf("Warning: %d of %d runs moved between performance and efficiency cores.\n\n",
+	   moved, typed);
+  fflush(stdout);
+}
+
+// With --quiet, each run waited for a quiet system.  How long it
+// waited, and how busy the system still was at launch, tell us how
+// contended the runs were.
+static int64_t median_of_field(Usage *usage, int start, int end,
+			       FieldCode fc, int64_t *max) {
+  int64_t *X = malloc((end - start) * sizeof(int64_t));
+  if (!X) PANIC_OOM();
+  int n = 0;
+  for (int i = start; i < end; i++)
+    if (get_int64(usage, i, fc) >= 0)
+      X[n++] = get_int64(usage, i, fc);
+  int64_t median = -1;
+  *max = -1;
+  if (n > 0) {
+    qsort(X, n, sizeof(int64_t), compare_int64);
+    median = X[n / 2];
+    *max = X[n - 1];
+  }
+  free(X);
+  return median;
+}
+
+void report_quiet(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t longest, busiest, highest;
+  int64_t wait = median_of_field(usage, start, end, F_QUIETWAIT, &longest);
+  if (wait < 0) return;
+  int64_t busy = median_of_field(usage, start, end, F_BUSY, &busiest);
+  int64_t load = median_of_field(usage, start, end, F_LOADAVG, &highest);
+  Units *units = select_units(longest, time_units);
+  char *median_wait = units_in_text(wait, units);
+  char *longest_wait = units_in_text(longest, units);
+  printf("Waited for a quiet system: median %s, longest %s\n",
+	 median_wait, longest_wait);
+  if (busy >= 0)
+    printf("At launch, other processes used " INT64FMT "%% of the CPUs"
+	   " (median), at most " INT64FMT "%%", busy, busiest);
+  if (load >= 0)
+    printf("; load average %.2f (median), at most %.2f",
+	   (double) load / 100.0, (double) highest / 100.0);
+  printf("\n\n");
+  free(median_wait);
+  free(longest_wait);
+  fflush(stdout);
+}
+
+// With --capture-output, we drained the output as it arrived.  If
+// that took much of our CPU time, or the pipe filled up, the command
+// may have had to wait for us, and its times include that wait.
+#define DRAIN_WARN_PCT 5
+
+void report_capture(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t most, longest;
+  int64_t drain = median_of_field(usage, start, end, F_DRAINCPU, &most);
+  if (drain < 0) return;
+  int64_t wall = median_of_field(usage, start, end, F_WALLNS, &longest);
+  int full = 0;
+  for (int i = start; i < end; i++)
+    full += (get_int64(usage, i, F_PIPEFULL) > 0);
+  int64_t pct = (wall > 0) ? (100 * drain + wall / 2) / wall : 0;
+  Units *units = select_units(most, nanotime_units);
+  char *median_drain = units_in_text(drain, units);
+  char *most_drain = units_in_text(most, units);
+  printf("Draining the output took %s of our CPU time per run (median),"
+	 " at most %s\n", median_drain, most_drain);
+  if (full)
+    printf("The output pipe was full during %d of %d runs, so the command"
+	   " may have waited for us\n", full, end - start);
+  else if (pct >= DRAIN_WARN_PCT)
+    printf("That is " INT64FMT "%% of the wall clock time, so draining may"
+	   " have slowed the command\n", pct);
+  else
+    printf("The output pipe never filled, so draining kept up\n");
+  printf("\n");
+  free(median_drain);
+  free(most_drain);
+  fflush(stdout);
+}
+
+// With --rate, runs started on a schedule.  The achieved rate is
+// that of the actual starts, which falls behind the offered rate when
+// too many runs are in flight (a backlog).  Latency is measured from
+// the scheduled start, and its percentiles use the nearest rank.
+static int64_t nearest_rank(const int64_t *X, int n, int per_mille) {
+  int rank = (int) (((int64_t) per_mille * n + 999) / 1000);
+  return X[(rank < 1) ? 0 : rank - 1];
+}
+
+void report_open_loop(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t *X = malloc((end - start) * sizeof(int64_t));
+  if (!X) PANIC_OOM();
+  int n = 0;
+  int64_t first_start = -1, last_start = -1, last_scheduled = -1;
+  for (int i = start; i < end; i++) {
+    int64_t scheduled = get_int64(usage, i, F_SCHEDULED);
+    int64_t latency = get_int64(usage, i, F_LATENCY);
+    if ((scheduled < 0) || (latency < 0)) continue;
+    int64_t started = scheduled + get_int64(usage, i, F_LAG);
+    if ((first_start < 0) || (started < first_start)) first_start = started;
+    if (started > last_start) last_start = started;
+    if (scheduled > last_scheduled) last_scheduled = scheduled;
+    X[n++] = latency;
+  }
+  if (n == 0) {
+    free(X);
+    return;
+  }
+  qsort(X, n, sizeof(int64_t), compare_int64);
+  int64_t max_lag, max_inflight;
+  int64_t lag = median_of_field(usage, start, end, F_LAG, &max_lag);
+  median_of_field(usage, start, end, F_INFLIGHT, &max_inflight);
+  if (n > 1) {
+    printf("Open loop: offered %.1f runs/s",
+	   (n - 1) * (double) NANOSECS / (double) (last_scheduled ? last_scheduled : 1));
+    printf(", achieved %.1f runs/s\n",
+	   (n - 1) * (double) NANOSECS
+	   / (double) ((last_start > first_start) ? last_start - first_start : 1));
+  } else {
+    printf("Open loop: a single run\n");
+  }
+  Units *units = select_units(X[n - 1], nanotime_units);
+  char *p50 = units_in_text(nearest_rank(X, n, 500), units);
+  char *p99 = units_in_text(nearest_rank(X, n, 990), units);
+  char *p999 = units_in_text(nearest_rank(X, n, 999), units);
+  char *max = units_in_text(X[n - 1], units);
+  printf("Latency from scheduled start: p50 %s, p99 %s, p99.9 %s, max %s\n",
+	 p50, p99, p999, max);
+  units = select_units(max_lag, nanotime_units);
+  char *median_lag = units_in_text(lag, units);
+  char *most_lag = units_in_text(max_lag, units);
+  printf("Backlog: started late by %s (median), at most %s;"
+	 " at most " INT64FMT " other runs in flight\n\n",
+	 median_lag, most_lag, max_inflight);
+  free(p50);
+  free(p99);
+  free(p999);
+  free(max);
+  free(median_lag);
+  free(most_lag);
+  free(X);
+  fflush(stdout);
+}
+
+// With --cgroup, the kernel accounted for every process each run
+// started.  CPU time beyond what wait4() reported was used by
+// processes that were not waited for, such as those left running in
+// the background, which were killed when the run ended.
+void report_cgroup(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t *X = malloc((end - start) * sizeof(int64_t));
+  if (!X) PANIC_OOM();
+  int n = 0, left = 0;
+  for (int i = start; i < end; i++) {
+    int64_t cg = get_int64(usage, i, F_CGCPU);
+    if (cg < 0) continue;
+    X[n++] = cg - get_int64(usage, i, F_USER) - get_int64(usage, i, F_SYSTEM);
+    left += (get_int64(usage, i, F_CGLEFT) > 0);
+  }
+  if (n == 0) {
+    free(X);
+    return;
+  }
+  qsort(X, n, sizeof(int64_t), compare_int64);
+  int64_t missed = X[n / 2];
+  free(X);
+  int64_t most;
+  int64_t cpu = median_of_field(usage, start, end, F_CGCPU, &most);
+  Units *units = select_units(most, time_units);
+  char *median_cpu = units_in_text(cpu, units);
+  char *median_missed = units_in_text((missed < 0) ? 0 : missed, units);
+  printf("Cgroup CPU time: %s (median), of which %s was not reported"
+	 " by wait4\n", median_cpu, median_missed);
+  free(median_cpu);
+  free(median_missed);
+  int64_t peak = median_of_field(usage, start, end, F_CGMEMPEAK, &most);
+  if (peak >= 0) {
+    units = select_units(most, space_units);
+    char *median_peak = units_in_text(peak, units);
+    char *most_peak = units_in_text(most, units);
+    printf("Cgroup memory peak: %s (median), at most %s\n",
+	   median_peak, most_peak);
+    free(median_peak);
+    free(most_peak);
+  }
+  int64_t rd = median_of_field(usage, start, end, F_CGREAD, &most);
+  int64_t wr = median_of_field(usage, start, end, F_CGWRITE, &most);
+  if ((rd >= 0) && (wr >= 0))
+    printf("Cgroup I/O: read " INT64FMT ", wrote " INT64FMT
+	   " bytes (median)\n", rd, wr);
+  int64_t psi[3];
+  psi[0] = median_of_field(usage, start, end, F_PSICPU, &most);
+  psi[1] = median_of_field(usage, start, end, F_PSIMEM, &most);
+  psi[2] = median_of_field(usage, start, end, F_PSIIO, &most);
+  if ((psi[0] >= 0) || (psi[1] >= 0) || (psi[2] >= 0)) {
+    const char *names[] = {"CPU", "memory", "I/O"};
+    printf("Stalled on");
+    for (int i = 0; i < 3; i++) {
+      if (psi[i] < 0) continue;
+      units = select_units(psi[i], time_units);
+      char *stall = units_in_text(psi[i], units);
+      printf(" %s %s%s", names[i], stall, (i < 2) ? "," : "");
+      free(stall);
+    }
+    printf(" (median)\n");
+  }
+  // Under limits (--cpu-quota, --memory-high, --memory-max), how
+  // often the runs were held back by them
+  int throttled = 0, high = 0, max = 0;
+  int64_t oom = 0;
+  for (int i = start; i < end; i++) {
+    throttled += (get_int64(usage, i, F_THROTTLED) > 0);
+    high += (get_int64(usage, i, F_MEMHIGH) > 0);
+    max += (get_int64(usage, i, F_MEMMAX) > 0);
+    if (get_int64(usage, i, F_OOMKILL) > 0)
+      oom += get_int64(usage, i, F_OOMKILL);
+  }
+  if (throttled) {
+    int64_t periods = median_of_field(usage, start, end, F_THROTTLED, &most);
+    int64_t waited = median_of_field(usage, start, end, F_THROTTLEDUS, &most);
+    units = select_units(most, time_units);
+    char *median_waited = units_in_text(waited, units);
+    printf("CPU quota throttled %d of %d runs: " INT64FMT " periods,"
+	   " %s (median)\n", throttled, n, periods, median_waited);
+    free(median_waited);
+  }
+  if (high || max)
+    printf("Memory limits: %d runs went over memory.high, %d reached"
+	   " memory.max, " INT64FMT " processes were killed (OOM)\n",
+	   high, max, oom);
+  if (left)
+    printf("Warning: %d of %d runs left processes running, which were"
+	   " killed\n", left, n);
+  printf("\n");
+  fflush(stdout);
+}
+
+// With --wait-descendants, the orphans that each run left behind
+// were reaped, and their usage added to the run's.  Stragglers were
+// still running after the command exited, so its wall clock time
+// leaves out some of the work done for it.
+void report_descendants(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t most_reaped, latest, longest;
+  int64_t reaped = median_of_field(usage, start, end, F_REAPED, &most_reaped);
+  if (reaped < 0) return;
+  int64_t last = median_of_field(usage, start, end, F_LASTEXIT, &latest);
+  int64_t wall = median_of_field(usage, start, end, F_WALLNS, &longest);
+  int late = 0, n = 0;
+  int64_t most_stragglers = 0;
+  for (int i = start; i < end; i++) {
+    int64_t stragglers = get_int64(usage, i, F_STRAGGLERS);
+    if (stragglers < 0) continue;
+    n++;
+    late += (stragglers > 0);
+    if (stragglers > most_stragglers) most_stragglers = stragglers;
+  }
+  Units *units = select_units((latest > longest) ? latest : longest, nanotime_units);
+  char *median_last = units_in_text(last, units);
+  char *median_wall = units_in_text(wall, units);
+  printf("Descendants reaped: " INT64FMT " per run (median), at most " INT64FMT
+	 "\n", reaped, most_reaped);
+  printf("Last process exited %s after the start (median), where the"
+	 " command took %s\n", median_last, median_wall);
+  if (late)
+    printf("Warning: %d of %d runs left stragglers running after the command"
+	   " exited (at most " INT64FMT "), whose work is not in the wall clock"
+	   " time\n", late, n, most_stragglers);
+  printf("\n");
+  free(median_last);
+  free(median_wall);
+  fflush(stdout);
+}
+
+// With --sweep, each level ran 'c' copies of the command at once,
+// back to back.  By Little's law, the throughput at a level is the
+// number in flight divided by the mean time each spends in the
+// system, here c / (mean wall clock time).  That leaves out the time
+// we took between runs, which would otherwise be counted against the
+// command.  The knee is the last level before throughput gains fell
+// below half of what perfect scaling would give.
+#define MAXSWEEPLEVELS 64
+#define SWEEP_KNEE_PCT 50
+
+static double level_throughput(Usage *usage, int start, int end, int c) {
+  double sum = 0;
+  int n = 0;
+  for (int i = start; i < end; i++) {
+    int64_t wall = get_int64(usage, i, F_WALLNS);
+    if (wall > 0) {
+      sum += (double) wall;
+      n++;
+    }
+  }
+  return (n && (sum > 0)) ? c * (double) NANOSECS * n / sum : 0;
+}
+
+void report_sweep(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int concurrency[MAXSWEEPLEVELS];
+  int bounds[MAXSWEEPLEVELS + 1];
+  double throughput[MAXSWEEPLEVELS];
+  int n = 0;
+  for (int i = start; i < end; i++) {
+    int64_t c = get_int64(usage, i, F_CONCURRENCY);
+    if (c < 1) return;
+    if ((n == 0) || (c != concurrency[n - 1])) {
+      if (n == MAXSWEEPLEVELS) break;
+      concurrency[n] = (int) c;
+      bounds[n++] = i;
+    }
+    bounds[n] = i + 1;
+  }
+  if (n == 0) return;
+
+  int knee = -1;
+  for (int k = 0; k < n; k++) {
+    throughput[k] = level_throughput(usage, bounds[k], bounds[k + 1], concurrency[k]);
+    if ((k > 0) && (knee < 0) && (throughput[k - 1] > 0)) {
+      double gain = throughput[k] / throughput[k - 1] - 1.0;
+      double ideal = (double) concurrency[k] / concurrency[k - 1] - 1.0;
+      if (gain * 100 < ideal * SWEEP_KNEE_PCT) knee = k - 1;
+    }
+  }
+
+  DisplayTable *t = new_display_table(78,
+				      6,
+				      (int []){8,13,13,10,8,8,END},
+				      (int []){2,2,2,2,2,2,END},
+				      "|rrrrrl|", true, true);
+  int row = 0;
+  display_table_fullspan(t, row++, 'c', "Concurrency sweep of %s",
+			 usage->data[start].cmd);
+  display_table_blankline(t, row++);
+  display_table_set(t, row, 0, "At once");
+  display_table_set(t, row, 1, "Wall (median)");
+  display_table_set(t, row, 2, "CPU (median)");
+  display_table_set(t, row, 3, "Throughput");
+  display_table_set(t, row, 4, "Speedup");
+  row++;
+  for (int k = 0; k < n; k++) {
+    int64_t longest, most;
+    int64_t wall = median_of_field(usage, bounds[k], bounds[k + 1], F_WALLNS, &longest);
+    int64_t cpu = median_of_field(usage, bounds[k], bounds[k + 1], F_TOTAL, &most);
+    char *wall_text = units_in_text(wall, select_units(wall, nanotime_units));
+    char *cpu_text = units_in_text(cpu, select_units(cpu, time_units));
+    display_table_set(t, row, 0, "%d", concurrency[k]);
+    display_table_set(t, row, 1, "%s", wall_text);
+    display_table_set(t, row, 2, "%s", cpu_text);
+    display_table_set(t, row, 3, "%.1f/s", throughput[k]);
+    display_table_set(t, row, 4, "%.2f",
+		      (throughput[0] > 0) ? throughput[k] / throughput[0] : 0.0);
+    if (k == knee) display_table_set(t, row, 5, "◀ knee");
+    row++;
+    free(wall_text);
+    free(cpu_text);
+  }
+  display_table(t, 2);
+  free_display_table(t);
+
+  if (n == 1)
+    printf("  Only one level of concurrency, so there is no knee to find\n\n");
+  else if (knee >= 0)
+    printf("  Throughput stops scaling beyond %d runs at once (the knee)\n\n",
+	   concurrency[knee]);
+  else
+    printf("  Throughput kept scaling up to %d runs at once (no knee found)\n\n",
+	   concurrency[n - 1]);
+  if (n > 1) print_sweep_graph(n, concurrency, throughput, knee);
+  fflush(stdout);
+}
+
+// A sweep is a stretch of runs of one command with a concurrency
+void report_sweeps(Usage *usage) {
+  if (!usage) PANIC_NULL();
+  int start = 0;
+  while (start < usage->next) {
+    if (get_int64(usage, start, F_CONCURRENCY) < 1) {
+      start++;
+      continue;
+    }
+    int end = start + 1;
+    while ((end < usage->next)
+	   && (get_int64(usage, end, F_CONCURRENCY) >= 1)
+	   && (strcmp(usage->data[end].cmd, usage->data[start].cmd) == 0))
+      end++;
+    report_sweep(usage, start, end);
+    start = end;
+  }
+}
+
+// With --cache, the command's files were evicted from (or read into)
+// the page cache before each run.  Eviction is only advice to the
+// kernel, so we show how much was cached at launch, along with the
+// page faults, which are what a cold start costs.
+void report_cache(Usage *usage, int start, int end) {
+  if ((end <= start) || !any_per_command_output()) return;
+  int64_t mode = -1;
+  for (int i = start; (i < end) && (mode < 0); i++)
+    mode = get_int64(usage, i, F_CACHE);
+  if (mode < 0) return;
+  int64_t most, max_major, max_minor;
+  int64_t cached = median_of_field(usage, start, end, F_CACHED, &most);
+  int64_t major = median_of_field(usage, start, end, F_FAULTS, &max_major);
+  int64_t minor = median_of_field(usage, start, end, F_RECLAIMS, &max_minor);
+  printf("Page cache was %s before each run",
+	 (mode == CACHE_COLD) ? "cold" : "warm");
+  if (cached >= 0)
+    printf(" (median " INT64FMT "%% of the command's files cached at launch,"
+	   " at most " INT64FMT "%%)", cached, most);
+  printf("\nPage faults per run: median " INT64FMT " major, " INT64FMT " minor;"
+	 " at most " INT64FMT " major, " INT64FMT " minor\n\n",
+	 major, minor, max_major, max_minor);
+  fflush(stdout);
+}
+
+// -----------------------------------------------------------------------------
+// Harness overhead (see --calibrate)
+// -----------------------------------------------------------------------------
+
+static void print_overhead_line(const char *label, const Overhead *o) {
+  if (o->runs == 0) return;
+  Units *units = select_units(o->wall.median, time_units);
+  char *total = apply_units(o->total.median, units, UNITS);
+  char *wall = apply_units(o->wall.median, units, UNITS);
+  printf("  %-14s  Total CPU time %s   Wall clock %s\n", label, total, wall);
+  free(total);
+  free(wall);
+}
+
+void print_overhead(const Calibration *c) {
+  if (!c) PANIC_NULL();
+  printf("Harness overhead (median of %d runs of a null command):\n",
+	 c->plain.runs);
+  print_overhead_line("Without shell", &c->plain);
+  print_overhead_line("With shell", &c->shell);
+  printf("\n");
+  fflush(stdout);
+}
+
+static char *net_repr(const Measures *m, const Measures *o) {
+  int64_t net, ci;
+  net_of_overhead(m, o, &net, &ci);
+  Units *units = select_units(llabs(net) > ci ? llabs(net) : ci, time_units);
+  char *value = apply_units(net, units, UNITS);
+  char *halfwidth = (ci < 0) ? NULL : apply_units(ci, units, NOUNITS);
+  char *repr;
+  if (halfwidth)
+    ASPRINTF(&repr, "%s ± %s", value + strspn(value, " "),
+	     halfwidth + strspn(halfwidth, " "));
+  else
+    ASPRINTF(&repr, "%s", value + strspn(value, " "));
+  free(value);
+  free(halfwidth);
+  return repr;
+}
+
+// Commands run under a shell are compared with the overhead of
+// starting the shell, and others with the overhead of launching a
+// null program.  The ± figure is the half-width of the confidence
+// interval (from the 'alpha' setting) for the difference of medians.
+void report_net_of_overhead(Summary *s, const Calibration *c) {
+  if (!s || !c || (s->runs == 0) || !any_per_command_output()) return;
+  const Overhead *o = (s->shell && *s->shell) ? &c->shell : &c->plain;
+  if (o->runs == 0) return;
+  char *total = net_repr(&s->total, &o->total);
+  char *wall = net_repr(&s->wall, &o->wall);
+  printf("Net of harness overhead:  Total CPU time %s   Wall clock %s\n\n",
+	 total, wall);
+  free(total);
+  free(wall);
+  fflush(stdout);
+}
+
 // report() produces box plots and an overall ranking.  These are the
 // only printed reports that use all of the data (across all
 // commands).
@@ -942,6 +1826,40 @@ void report(Ranking *ranking) {
 			 ranking->usage,
 			 ranking->usageidx[i],
 			 ranking->usageidx[i+1]);
+      report_core_interference(ranking->usage,
+			       ranking->usageidx[i],
+			       ranking->usageidx[i+1]);
+      report_stop_reason(ranking->usage,
+			 ranking->usageidx[i],
+			 ranking->usageidx[i+1]);
+      report_fork_server(ranking->usage,
+			 ranking->usageidx[i],
+			 ranking->usageidx[i+1]);
+      report_repeat(ranking->usage,
+		    ranking->usageidx[i],
+		    ranking->usageidx[i+1]);
+      report_cpu_state(ranking->usage,
+		       ranking->usageidx[i],
+		       ranking->usageidx[i+1]);
+      report_quiet(ranking->usage,
+		   ranking->usageidx[i],
+		   ranking->usageidx[i+1]);
+      report_cache(ranking->usage,
+		   ranking->usageidx[i],
+		   ranking->usageidx[i+1]);
+      report_capture(ranking->usage,
+		     ranking->usageidx[i],
+		     ranking->usageidx[i+1]);
+      report_open_loop(ranking->usage,
+		       ranking->usageidx[i],
+		       ranking->usageidx[i+1]);
+      report_cgroup(ranking->usage,
+		    ranking->usageidx[i],
+		    ranking->usageidx[i+1]);
+      report_descendants(ranking->usage,
+			 ranking->usageidx[i],
+			 ranking->usageidx[i+1]);
+      report_net_of_overhead(s, calibration_for_batch(s->batch));
       // During reporting, user may want to save summary stats
       write_summary_line(csv_output, s);
       write_hf_line(hf_output, s);
@@ -951,6 +1869,7 @@ void report(Ranking *ranking) {
     }
     if (csv_output) fclose(csv_output);
     if (hf_output) fclose(hf_output);
+    report_sweeps(ranking->usage);
 
   } // If action is reporting
 
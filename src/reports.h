@@ -20,8 +20,49 @@ Ranking *read_input_files(int argc, char **argv);
 void print_summary(Summary *s, bool briefly);
 void print_overall_summary(Summary *summaries[], int start, int end);
 void print_distribution_stats(Summary *s);
-void print_tail_stats(Summary *s);
+void print_tail_stats(Summary *s, Usage *usage, int start, int end);
 
 void per_command_output(Summary *s, Usage *usage, int start, int end);
+void report_core_interference(Usage *usage, int start, int end);
+
+// Why a command stopped running.  Recorded in the raw data, on the
+// last run of each command only.
+#define XStopReasons(X)						\
+  X(STOP_FIXED,     "fixed number of runs")			\
+  X(STOP_CONVERGED, "median converged")				\
+  X(STOP_MAXRUNS,   "reached maximum number of runs")		\
+  X(STOP_ELIMINATED, "eliminated as slower than the best")
+
+#define FIRST(a, b) a,
+typedef enum { XStopReasons(FIRST) STOP_LAST } StopReason;
+#undef FIRST
+
+void report_stop_reason(Usage *usage, int start, int end);
+void report_fork_server(Usage *usage, int start, int end);
+void report_repeat(Usage *usage, int start, int end);
+void report_cpu_state(Usage *usage, int start, int end);
+void report_quiet(Usage *usage, int start, int end);
+void report_cache(Usage *usage, int start, int end);
+void report_capture(Usage *usage, int start, int end);
+void report_open_loop(Usage *usage, int start, int end);
+void report_cgroup(Usage *usage, int start, int end);
+void report_descendants(Usage *usage, int start, int end);
+
+// The runs of a concurrency sweep (see --sweep) are recorded with
+// their concurrency, one level after another.  report_sweep() takes
+// the runs of one command, and report_sweeps() finds each sweep in
+// raw data.
+void report_sweep(Usage *usage, int start, int end);
+void report_sweeps(Usage *usage);
+
+// Harness overhead as measured without and with the shell (see
+// --calibrate).  Either may have zero runs (not measured).
+typedef struct Calibration {
+  Overhead plain;
+  Overhead shell;
+} Calibration;
+
+void print_overhead(const Calibration *c);
+void report_net_of_overhead(Summary *s, const Calibration *c);
 
 #endif
@@ -509,6 +509,21 @@ static bool lowvariance(double mean, double stddev) {
     || (stddev < LOWSTDDEV_THRESHOLD);
 }
 
+// The distribution-free confidence interval for the median is
+// bounded by the order statistics X(j) and X(k), where (1-based)
+//   j = ⌊(n - z√n) / 2⌋  and  k = ⌈1 + (n + z√n) / 2⌉
+// which follows from the normal approximation to the binomial.
+// E.g. for n = 100 and z = 1.96, the interval is [X(40), X(61)].
+static double median_ci_halfwidth(const int64_t *X, int n, double z) {
+  double spread = z * sqrt((double) n);
+  double lower = floor((n - spread) / 2.0);
+  double upper = ceil(1.0 + (n + spread) / 2.0);
+  int j = (int) lower;
+  int k = (int) upper;
+  if ((j < 1) || (k > n)) return -1;
+  return (double) (X[k-1] - X[j-1]) / 2.0;
+}
+
 //
 // Produce a statistical summary (stored in 'm') over all runs.  Time
 // values are single int64_t fields storing microseconds.
@@ -532,6 +547,8 @@ static void measure(Usage *usage,
   m->pct95 = percentile(95, X, runs);
   m->pct99 = percentile(99, X, runs);
   m->max = percentile(100, X, runs);
+  double halfwidth = median_ci_halfwidth(X, runs, Zcrit(config.alpha));
+  m->median_ci = (halfwidth < 0) ? -1 : (int64_t) halfwidth;
 
   // Estimates based on the data distribution 
   m->est_mean = estimate_mean(X, runs);
@@ -617,19 +634,116 @@ void free_summaries(Summary **ss, int n) {
 // Compute statistical summary of a sample (collection of observations)
 // -----------------------------------------------------------------------------
 
+// Convert measures to coarser units, e.g. ns to μs.  The estimates
+// of shape (AD score, skew, kurtosis) do not depend on the units.
+static void scale_measures(Measures *m, int64_t divisor) {
+  int64_t *fields[] = {&m->min, &m->max, &m->mode, &m->median,
+		       &m->pct95, &m->pct99, &m->Q1, &m->Q3, &m->median_ci};
+  for (size_t i = 0; i < sizeof(fields) / sizeof(int64_t *); i++)
+    if (*fields[i] >= 0)
+      *fields[i] /= divisor;
+  m->est_mean /= (double) divisor;
+  m->est_stddev /= (double) divisor;
+}
+
+static void no_measures(Measures *m) {
+  m->min = m->max = m->mode = m->median = -1;
+  m->pct95 = m->pct99 = m->Q1 = m->Q3 = -1;
+  m->median_ci = -1;
+  m->est_mean = m->est_stddev = -1;
+  m->p_normal = -1;
+}
+
+// Optional metrics, like performance counters, are -1 when not
+// available.  We summarize them only when every run has a value.
+static void measure_optional(Usage *usage,
+			     int start,
+			     int end,
+			     FieldCode fc,
+			     Comparator compare,
+			     Measures *m) {
+  for (int i = start; i < end; i++)
+    if (get_int64(usage, i, fc) < 0) {
+      no_measures(m);
+      return;
+    }
+  measure(usage, start, end, fc, compare, m);
+}
+
+static bool all_completed(Usage *usage, int start, int end) {
+  for (int i = start; i < end; i++)
+    if (!COMPLETED(usage, i)) return false;
+  return true;
+}
+
+// Append copies of the completed runs in [start, end) to 'sample'
+static void add_completed_runs(Usage *sample, Usage *usage, int start, int end) {
+  for (int i = start; i < end; i++)
+    if (COMPLETED(usage, i)) usage_copy(sample, usage, i);
+}
+
+static Summary *new_command_summary(Usage *usage, int idx) {
+  Summary *s = new_summary();
+  s->cmd = strndup(get_string(usage, idx, F_CMD), MAXCMDLEN);
+  s->shell = strndup(get_string(usage, idx, F_SHELL), MAXCMDLEN);
+  char *tmp = get_string(usage, idx, F_NAME);
+  s->name = tmp ? strndup(tmp, MAXCMDLEN) : NULL;
+  s->batch = usage->data[idx].batch;
+  return s;
+}
+
+// When no run completed, there are no statistics, and every measure
+// is -1, as when it is not available
+static Summary *summarize_none(Usage *usage, int idx) {
+  Summary *s = new_command_summary(usage, idx);
+  Measures *all[] = {&s->user, &s->system, &s->total, &s->maxrss,
+		     &s->vcsw, &s->icsw, &s->tcsw, &s->wall,
+		     &s->cycles, &s->instructions, &s->ipc, &s->cacherefs,
+		     &s->cachemisses, &s->branchmisses, &s->migrations,
+		     &s->taskclock, &s->readbytes, &s->writebytes,
+		     &s->syscr, &s->syscw, &s->blkio, &s->offcpu,
+		     &s->oncpu, &s->runq, &s->slices,
+		     &s->ttfb, &s->outbytes, &s->outrate};
+  for (size_t i = 0; i < sizeof(all) / sizeof(Measures *); i++)
+    no_measures(all[i]);
+  return s;
+}
+
 //
 // Summarize from usage[start] to usage[end-1]
 //
+// Runs that timed out or exceeded a resource limit are counted, but
+// are left out of the statistics, so that a few pathological runs do
+// not distort them.  So are runs flagged for interference, unless
+// option.include_interfered.  If no run completed, the summary has
+// no runs (see summarize_none).
 Summary *summarize(Usage *usage, int start, int end) {
   if (!usage) return NULL;
   if ((start < 0) || (end > usage->next)) return NULL;
 
-  Summary *s = new_summary();
-  s->cmd = strndup(get_string(usage, start, F_CMD), MAXCMDLEN);
-  s->shell = strndup(get_string(usage, start, F_SHELL), MAXCMDLEN);
-  char *tmp = get_string(usage, start, F_NAME);
-  s->name = tmp ? strndup(tmp, MAXCMDLEN) : NULL;
-  s->batch = usage->data[start].batch;
+  int timeouts = 0, limits = 0, interfered = 0;
+  for (int i = start; i < end; i++) {
+    timeouts += (get_int64(usage, i, F_STATUS) == RUN_TIMEOUT);
+    limits += (get_int64(usage, i, F_STATUS) == RUN_LIMIT);
+    interfered += (get_int64(usage, i, F_STATUS) == RUN_INTERFERED);
+  }
+  if (!all_completed(usage, start, end)) {
+    Usage *completed = new_usage_array(end - start);
+    add_completed_runs(completed, usage, start, end);
+    Summary *s = (completed->next > 0)
+      ? summarize(completed, 0, completed->next)
+      : summarize_none(usage, start);
+    s->timeout_count = timeouts;
+    s->limit_count = limits;
+    s->interfered_count = interfered;
+    free_usage_array(completed);
+    return s;
+  }
+
+  Summary *s = new_command_summary(usage, start);
+  s->timeout_count = timeouts;
+  s->limit_count = limits;
+  s->interfered_count = interfered;
   s->runs = end - start;
   for (int i = start; i < end; i++) 
     s->fail_count += (get_int64(usage, i, F_CODE) != 0);
@@ -641,16 +755,71 @@ Summary *summarize(Usage *usage, int start, int end) {
   measure(usage, start, end, F_VCSW, compare_vcsw, &s->vcsw);
   measure(usage, start, end, F_ICSW, compare_icsw, &s->icsw);
   measure(usage, start, end, F_TCSW, compare_tcsw, &s->tcsw);
-  measure(usage, start, end, F_WALL, compare_wall, &s->wall);
+  // Wall clock is measured in ns, which gives distinct values (and
+  // a meaningful mode) for short commands, and reported in μs
+  measure(usage, start, end, F_WALLNS, compare_wallns, &s->wall);
+  scale_measures(&s->wall, 1000);
+
+  measure_optional(usage, start, end, F_CYCLES, compare_cycles, &s->cycles);
+  measure_optional(usage, start, end, F_INSTR, compare_instructions, &s->instructions);
+  measure_optional(usage, start, end, F_IPC, compare_ipc, &s->ipc);
+  measure_optional(usage, start, end, F_CACHEREFS, compare_cacherefs, &s->cacherefs);
+  measure_optional(usage, start, end, F_CACHEMISS, compare_cachemisses, &s->cachemisses);
+  measure_optional(usage, start, end, F_BRANCHMISS, compare_branchmisses, &s->branchmisses);
+  measure_optional(usage, start, end, F_MIGRATIONS, compare_migrations, &s->migrations);
+  measure_optional(usage, start, end, F_TASKCLOCK, compare_taskclock, &s->taskclock);
+
+  measure_optional(usage, start, end, F_READBYTES, compare_readbytes, &s->readbytes);
+  measure_optional(usage, start, end, F_WRITEBYTES, compare_writebytes, &s->writebytes);
+  measure_optional(usage, start, end, F_SYSCR, compare_syscr, &s->syscr);
+  measure_optional(usage, start, end, F_SYSCW, compare_syscw, &s->syscw);
+  measure_optional(usage, start, end, F_BLKIO, compare_blkio, &s->blkio);
+  measure_optional(usage, start, end, F_OFFCPU, compare_offcpu, &s->offcpu);
+  measure_optional(usage, start, end, F_ONCPU, compare_oncpu, &s->oncpu);
+  measure_optional(usage, start, end, F_RUNQ, compare_runq, &s->runq);
+  measure_optional(usage, start, end, F_SLICES, compare_slices, &s->slices);
+  measure_optional(usage, start, end, F_TTFB, compare_ttfb, &s->ttfb);
+  measure_optional(usage, start, end, F_OUTBYTES, compare_outbytes, &s->outbytes);
+  measure_optional(usage, start, end, F_OUTRATE, compare_outrate, &s->outrate);
 
   return s;
 }
 
+// The runs of different commands may be interleaved (see --order),
+// but all the runs of a command share a batch number, and batch
+// numbers are assigned in command order.  Reorder the runs so that
+// each batch is contiguous, keeping the runs of a batch in the order
+// they were done.  The sort key packs the batch number and position
+// into an int64_t, so that the sort is stable.
+void group_by_batch(Usage *usage, int start, int end) {
+  bool grouped = true;
+  for (int i = start + 1; grouped && (i < end); i++)
+    grouped = (usage->data[i].batch >= usage->data[i-1].batch);
+  if (grouped) return;
+
+  int n = end - start;
+  int64_t *key = malloc(n * sizeof(int64_t));
+  UsageData *data = malloc(n * sizeof(UsageData));
+  if (!key || !data) PANIC_OOM();
+
+  for (int i = 0; i < n; i++)
+    key[i] = ((int64_t) usage->data[start + i].batch << 32) | i;
+  qsort(key, n, sizeof(int64_t), compare_int64);
+  for (int i = 0; i < n; i++)
+    data[i] = usage->data[start + (key[i] & 0xFFFFFFFF)];
+  memcpy(&usage->data[start], data, n * sizeof(UsageData));
+
+  free(key);
+  free(data);
+}
+
 static Ranking *make_ranking(Usage *usage, int start, int end) {
   if (!usage) PANIC_NULL();
   if ((start < 0) || (end < 0) || (end <= start))
     PANIC("Start or end index is invalid (%d, %d)", start, end);
 
+  group_by_batch(usage, start, end);
+
   int maxsummaries = end - start;
   Ranking *rank = malloc(sizeof(Ranking));
   if (!rank) PANIC_OOM();
@@ -1066,6 +1235,8 @@ static int compare_median_total_time(const void *idx_ptr1,
   const int idx2 = *((const int *)idx_ptr2);
   int64_t val1 = s[idx1]->total.median;
   int64_t val2 = s[idx2]->total.median;
+  // A command with no completed runs has no median (-1), and is last
+  if ((val1 < 0) != (val2 < 0)) return (val1 < 0) ? 1 : -1;
   if (val1 > val2) return 1;
   if (val1 < val2) return -1;
   return 0;
@@ -1089,6 +1260,18 @@ Inference *compare_samples(Usage *usage,
 			   double alpha,
 			   int ref_start, int ref_end,
 			   int idx_start, int idx_end) {
+  // Compare only the runs that completed (see summarize)
+  if (!all_completed(usage, ref_start, ref_end) ||
+      !all_completed(usage, idx_start, idx_end)) {
+    Usage *sample = new_usage_array(ref_end - ref_start + idx_end - idx_start);
+    add_completed_runs(sample, usage, ref_start, ref_end);
+    int n = sample->next;
+    add_completed_runs(sample, usage, idx_start, idx_end);
+    Inference *stat = compare_samples(sample, alpha, 0, n, n, sample->next);
+    free_usage_array(sample);
+    return stat;
+  }
+
   int n1 = ref_end - ref_start;
   int n2 = idx_end - idx_start;
   if ((n1 < INFERENCE_N_THRESHOLD)
@@ -1146,3 +1329,72 @@ Inference *compare_samples(Usage *usage,
   free(RCSsigned.rank);
   return stat;
 }
+
+// -----------------------------------------------------------------------------
+// Convergence of the median, for an adaptive number of runs
+// -----------------------------------------------------------------------------
+
+OrderedSample *new_ordered_sample(int capacity, double alpha) {
+  if (capacity < 1) PANIC("Invalid capacity (%d)", capacity);
+  OrderedSample *os = malloc(sizeof(OrderedSample));
+  if (!os) PANIC_OOM();
+  os->X = malloc(capacity * sizeof(int64_t));
+  if (!os->X) PANIC_OOM();
+  os->n = 0;
+  os->capacity = capacity;
+  os->z = Zcrit(alpha);
+  return os;
+}
+
+void free_ordered_sample(OrderedSample *os) {
+  if (!os) return;
+  free(os->X);
+  free(os);
+}
+
+// Binary search for the insertion point, then shift the larger
+// values up.  The shift is a single memmove, which is fast compared
+// to running a command.
+void ordered_sample_add(OrderedSample *os, int64_t value) {
+  if (!os) PANIC_NULL();
+  if (os->n == os->capacity) {
+    os->capacity *= 2;
+    os->X = realloc(os->X, os->capacity * sizeof(int64_t));
+    if (!os->X) PANIC_OOM();
+  }
+  int lo = 0, hi = os->n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (os->X[mid] <= value) lo = mid + 1;
+    else hi = mid;
+  }
+  memmove(&os->X[lo + 1], &os->X[lo], (os->n - lo) * sizeof(int64_t));
+  os->X[lo] = value;
+  os->n++;
+}
+
+double median_ci_relative(OrderedSample *os) {
+  if (!os) PANIC_NULL();
+  double halfwidth = median_ci_halfwidth(os->X, os->n, os->z);
+  if (halfwidth < 0) return -1;
+  int64_t median = percentile(50, os->X, os->n);
+  if (median <= 0) return (halfwidth == 0) ? 0 : -1;
+  return halfwidth / (double) median;
+}
+
+// -----------------------------------------------------------------------------
+// Harness overhead (see --calibrate)
+// -----------------------------------------------------------------------------
+
+void net_of_overhead(const Measures *m, const Measures *o,
+		     int64_t *net, int64_t *ci) {
+  if (!m || !o || !net || !ci) PANIC_NULL();
+  *net = m->median - o->median;
+  if ((m->median_ci < 0) || (o->median_ci < 0))
+    *ci = -1;
+  else {
+    double a = (double) m->median_ci, b = (double) o->median_ci;
+    double combined = sqrt(a * a + b * b);
+    *ci = (int64_t) combined;
+  }
+}
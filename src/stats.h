@@ -21,6 +21,7 @@ typedef struct Measures {
   int64_t pct99;
   int64_t Q1;
   int64_t Q3;
+  int64_t median_ci;	// Half-width of the CI for the median, or -1
   double  est_mean;	// Estimated
   double  est_stddev;	// Estimated
   double  ADscore;	// ** See below **
@@ -69,8 +70,11 @@ typedef struct Summary {
   char      *shell;		// Never NULL (can be epsilon)
   char      *name;		// Optional, can be NULL
   int        batch;		// Unique (within a single CSV file) ID
-  int        runs;
+  int        runs;		// Completed runs, used for the statistics
   int        fail_count;
+  int        timeout_count;	// Runs not completed (not in 'runs')
+  int        limit_count;
+  int        interfered_count;	// Flagged (in 'runs' if included)
   Measures   user;
   Measures   system;
   Measures   total;
@@ -79,6 +83,30 @@ typedef struct Summary {
   Measures   icsw;
   Measures   tcsw;
   Measures   wall;
+  // Performance counters: all fields are -1 when not available
+  Measures   cycles;
+  Measures   instructions;
+  Measures   ipc;		// Instructions per 1000 cycles
+  Measures   cacherefs;
+  Measures   cachemisses;
+  Measures   branchmisses;
+  Measures   migrations;
+  Measures   taskclock;	// ns
+  // I/O accounting (Linux): all fields are -1 when not available
+  Measures   readbytes;
+  Measures   writebytes;
+  Measures   syscr;
+  Measures   syscw;
+  Measures   blkio;		// μs waiting for block I/O
+  Measures   offcpu;		// μs of wall clock not on a CPU
+  // Scheduler statistics of the main thread (Linux), or -1
+  Measures   oncpu;		// ns running on a CPU
+  Measures   runq;		// ns waiting for a CPU
+  Measures   slices;		// Times given a CPU
+  // With --capture-output, or -1
+  Measures   ttfb;		// ns from launch to first byte of output
+  Measures   outbytes;		// Written to stdout and stderr
+  Measures   outrate;		// Bytes per second of wall clock
   Inference *infer;		// Can be NULL
 } Summary;
 
@@ -130,6 +158,48 @@ void     free_summary(Summary *s);
 void     free_summaries(Summary **ss, int n);
 
 Ranking *rank(Usage *usage);
+void     group_by_batch(Usage *usage, int start, int end);
 void     free_ranking(Ranking *rank);
 
+// -----------------------------------------------------------------------------
+// Convergence of the median, for an adaptive number of runs
+// -----------------------------------------------------------------------------
+
+// Values are inserted in order as they arrive, so that the median and
+// its confidence interval are available at any time without sorting.
+typedef struct OrderedSample {
+  int64_t *X;
+  int      n;
+  int      capacity;
+  double   z;		// Critical value for the confidence level
+} OrderedSample;
+
+OrderedSample *new_ordered_sample(int capacity, double alpha);
+void           free_ordered_sample(OrderedSample *os);
+void           ordered_sample_add(OrderedSample *os, int64_t value);
+
+// Half-width of the (1 - alpha) confidence interval of the median,
+// relative to the median, e.g. 0.02 means ±2%.  Returns -1 when the
+// sample is too small to have such an interval.
+double median_ci_relative(OrderedSample *os);
+
+// -----------------------------------------------------------------------------
+// Harness overhead (see --calibrate)
+// -----------------------------------------------------------------------------
+
+// Measured by running a null command.  Only the min, Q1, median, Q3,
+// max, and median_ci fields of the Measures are used.
+typedef struct Overhead {
+  int      runs;		// Zero when not measured
+  Measures total;		// μs
+  Measures wall;		// μs
+} Overhead;
+
+// The median of 'm' net of the median overhead 'o', and the
+// half-width of its confidence interval, combining the two intervals
+// as for independent estimates.  The half-width is -1 if either
+// interval is unknown.
+void net_of_overhead(const Measures *m, const Measures *o,
+		     int64_t *net, int64_t *ci);
+
 #endif
@@ -0,0 +1,93 @@
+//  -*- Mode: C; -*-
+//
+//  sysload.c  System-wide CPU usage and load
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#include "sysload.h"
+#include "utils.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// The first window is long enough to span several clock ticks (10ms
+// on most systems), so that a single tick does not dominate
+#define QUIET_WINDOW_NS (50LL * 1000 * 1000)
+#define QUIET_MAX_WINDOW_NS (800LL * 1000 * 1000)
+
+static int64_t ticks_to_ns(long long ticks) {
+  return ticks * (NANOSECS / sysconf(_SC_CLK_TCK));
+}
+
+static int64_t self_cpu_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) return 0;
+  return (int64_t) ts.tv_sec * NANOSECS + ts.tv_nsec;
+}
+
+// The first line of /proc/stat totals the CPUs: user, nice, system,
+// idle, iowait, irq, softirq, steal, and (already counted in user
+// and nice) guest time
+bool sysload_read(SysCPU *s) {
+  if (!s) PANIC_NULL();
+  long long user, nice, system, idle, iowait, irq, softirq, steal;
+  FILE *f = fopen("/proc/stat", "r");
+  if (!f) return false;
+  int n = fscanf(f, "cpu %lld %lld %lld %lld %lld %lld %lld %lld",
+		 &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+  fclose(f);
+  if (n < 4) return false;
+  if (n < 5) iowait = 0;
+  if (n < 6) irq = 0;
+  if (n < 7) softirq = 0;
+  if (n < 8) steal = 0;
+  s->busy_ns = ticks_to_ns(user + nice + system + irq + softirq + steal);
+  s->total_ns = s->busy_ns + ticks_to_ns(idle + iowait);
+  s->self_ns = self_cpu_ns();
+  return true;
+}
+
+double sysload_busy_pct(const SysCPU *a, const SysCPU *b, int64_t exclude_ns) {
+  if (!a || !b) PANIC_NULL();
+  int64_t total = b->total_ns - a->total_ns;
+  int64_t others = (b->busy_ns - a->busy_ns)
+    - (b->self_ns - a->self_ns) - exclude_ns;
+  if (total <= 0) return 0.0;
+  if (others < 0) others = 0;
+  return 100.0 * (double) others / (double) total;
+}
+
+double sysload_interference(const SysCPU *a, const SysCPU *b, int64_t child_ns) {
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1) ncpus = 1;
+  return sysload_busy_pct(a, b, child_ns + 2 * ncpus * ticks_to_ns(1));
+}
+
+int64_t sysload_loadavg(void) {
+  double load;
+  FILE *f = fopen("/proc/loadavg", "r");
+  if (!f) return -1;
+  int n = fscanf(f, "%lf", &load);
+  fclose(f);
+  return (n == 1) ? (int64_t) (load * 100.0 + 0.5) : -1;
+}
+
+int64_t wait_for_quiet(int threshold, double *busy_pct) {
+  if (!busy_pct) PANIC_NULL();
+  int64_t start = monotonic_ns();
+  int64_t window = QUIET_WINDOW_NS;
+  SysCPU a, b;
+  *busy_pct = -1;
+  while (sysload_read(&a)) {
+    struct timespec pause = {.tv_sec = window / NANOSECS,
+			     .tv_nsec = window % NANOSECS};
+    nanosleep(&pause, NULL);
+    if (!sysload_read(&b)) break;
+    *busy_pct = sysload_busy_pct(&a, &b, 0);
+    if ((*busy_pct < threshold)
+	|| (monotonic_ns() - start >= QUIET_MAX_WAIT))
+      break;
+    if (window < QUIET_MAX_WINDOW_NS) window *= 2;
+  }
+  return monotonic_ns() - start;
+}
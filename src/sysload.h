@@ -0,0 +1,53 @@
+//  -*- Mode: C; -*-
+//
+//  sysload.h  System-wide CPU usage and load
+//
+//  Copyright (C) Jamie A. Jennings, 2024
+
+#ifndef sysload_h
+#define sysload_h
+
+#include "bestguess.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// On Linux, /proc/stat has the CPU time spent by the whole system,
+// summed over all CPUs, in clock ticks.  Comparing two readings
+// tells us how busy the system was in between, and subtracting our
+// own CPU time (and that of our children) tells us how busy the
+// other processes were.
+
+typedef struct SysCPU {
+  int64_t busy_ns;		// All CPUs, not idle or waiting for I/O
+  int64_t total_ns;		// All CPUs, busy or not
+  int64_t self_ns;		// Our own CPU time, all threads
+} SysCPU;
+
+// Returns false if /proc/stat cannot be read (e.g. not Linux)
+bool sysload_read(SysCPU *s);
+
+// The CPU time of other processes between 'a' and 'b', as a
+// percentage of the capacity of the system over that interval.
+// 'exclude_ns' is CPU time to leave out besides our own (e.g. that
+// of a child we launched).
+double sysload_busy_pct(const SysCPU *a, const SysCPU *b, int64_t exclude_ns);
+
+// Like sysload_busy_pct(), for judging whether other processes
+// interfered with a run of a child that used 'child_ns' of CPU time.
+// The counts in /proc/stat advance a clock tick at a time, on each
+// CPU, so up to two ticks per CPU are forgiven.  Short runs cannot be
+// judged this way, and come out as 0%.
+double sysload_interference(const SysCPU *a, const SysCPU *b, int64_t child_ns);
+
+// The 1-minute load average, times 100, or -1 if not available
+int64_t sysload_loadavg(void);
+
+// Wait until other processes use less than 'threshold' percent of
+// the system's CPU capacity.  Usage is measured over a short window,
+// which doubles (up to a limit) each time the system is too busy.
+// After QUIET_MAX_WAIT, we stop waiting.  Returns the time spent
+// here, in ns, and stores the last measurement in 'busy_pct'.
+#define QUIET_MAX_WAIT (60LL * 1000 * 1000 * 1000)
+int64_t wait_for_quiet(int threshold, double *busy_pct);
+
+#endif
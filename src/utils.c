@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <stdarg.h> 		// __VA_ARGS__ (var args)
 #include <stdlib.h>		// exit()
+#include <time.h>
 
 #define SECOND(a, b) b,
 const char *Header[] = {XFields(SECOND) NULL};
@@ -79,6 +80,21 @@ int usage_next(Usage *usage) {
   return next;
 }
 
+// Append a copy of src[idx] to dest, returning its index in dest
+int usage_copy(Usage *dest, Usage *src, int idx) {
+  if (!dest || !src) PANIC_NULL();
+  if ((idx < 0) || (idx >= src->next))
+    PANIC("Index %d out of range 0..%d", idx, src->next - 1);
+  int next = usage_next(dest);
+  set_string(dest, next, F_CMD, src->data[idx].cmd);
+  set_string(dest, next, F_SHELL, src->data[idx].shell);
+  set_string(dest, next, F_NAME, src->data[idx].name);
+  dest->data[next].batch = src->data[idx].batch;
+  memcpy(dest->data[next].metrics, src->data[idx].metrics,
+	 sizeof(src->data[idx].metrics));
+  return next;
+}
+
 void free_usage_array(Usage *usage) {
   if (!usage) return;
   for (int i = 0; i < usage->next; i++) {
@@ -141,6 +157,100 @@ void set_int64(Usage *usage, int idx, FieldCode fc, int64_t val) {
   usage->data[idx].metrics[FTONUMERICIDX(fc)] = val;
 }
 
+// Instructions per cycle, scaled by 1000, or -1 if not available
+void set_ipc(Usage *usage, int idx) {
+  int64_t cycles = get_int64(usage, idx, F_CYCLES);
+  int64_t instructions = get_int64(usage, idx, F_INSTR);
+  if ((cycles > 0) && (instructions >= 0))
+    set_int64(usage, idx, F_IPC, (instructions * 1000) / cycles);
+  else
+    set_int64(usage, idx, F_IPC, -1);
+}
+
+int64_t usage_repeats(Usage *usage, int idx) {
+  int64_t k = get_int64(usage, idx, F_REPEAT);
+  return (k > 1) ? k : 1;
+}
+
+// Fields that describe a run, or are the largest value seen, rather
+// than totals over the executions.  The counts of processes left
+// behind, and of times the output pipe was full, are totals, but a
+// run that left one process behind must not round down to none.
+static bool per_run_field(FieldCode fc) {
+  switch (fc) {
+    case F_CODE: case F_MAXRSS: case F_CORE: case F_STOP:
+    case F_STATUS: case F_FORKED: case F_REPEAT:
+    case F_LASTCPU: case F_CORETYPE: case F_STARTTYPE:
+    case F_FREQSTART: case F_FREQEND:
+    case F_TEMPSTART: case F_TEMPEND:
+    case F_QUIETWAIT: case F_BUSY: case F_LOADAVG: case F_INTERFERENCE:
+    case F_CACHE: case F_CACHED:
+    case F_SCHEDULED: case F_LAG: case F_INFLIGHT: case F_LATENCY:
+    case F_CONCURRENCY: case F_CGMEMPEAK: case F_CGLEFT: case F_PIPEFULL:
+    case F_REAPED: case F_STRAGGLERS: case F_LASTEXIT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void usage_per_execution(Usage *usage, int start, int end) {
+  if (!usage) PANIC_NULL();
+  for (int idx = start; idx < end; idx++) {
+    int64_t k = usage_repeats(usage, idx);
+    if (k == 1) continue;
+    for (FieldCode fc = F_STARTDATA; fc < F_ENDDATA; fc++) {
+      int64_t value = get_int64(usage, idx, fc);
+      if (!per_run_field(fc) && (value > 0))
+	set_int64(usage, idx, fc, (value + k / 2) / k);
+    }
+    set_int64(usage, idx, F_TOTAL,
+	      get_int64(usage, idx, F_USER) + get_int64(usage, idx, F_SYSTEM));
+    set_int64(usage, idx, F_TCSW,
+	      get_int64(usage, idx, F_VCSW) + get_int64(usage, idx, F_ICSW));
+    set_ipc(usage, idx);
+    set_offcpu(usage, idx);
+    set_outrate(usage, idx);
+  }
+}
+
+// Wall clock time not spent on a CPU: blocked (e.g. on I/O), sleeping,
+// or waiting to be scheduled.  This is shown together with the I/O
+// accounting, so it is not available when that is not.
+void set_offcpu(Usage *usage, int idx) {
+  int64_t offcpu = get_int64(usage, idx, F_WALL) - get_int64(usage, idx, F_TOTAL);
+  if (get_int64(usage, idx, F_READBYTES) < 0)
+    set_int64(usage, idx, F_OFFCPU, -1);
+  else
+    set_int64(usage, idx, F_OFFCPU, (offcpu > 0) ? offcpu : 0);
+}
+
+// Bytes of output per second of wall clock time, with --capture-output
+void set_outrate(Usage *usage, int idx) {
+  int64_t bytes = get_int64(usage, idx, F_OUTBYTES);
+  int64_t wall_ns = get_int64(usage, idx, F_WALLNS);
+  if ((bytes >= 0) && (wall_ns > 0))
+    set_int64(usage, idx, F_OUTRATE,
+	      (int64_t) ((double) bytes * NANOSECS / (double) wall_ns));
+  else
+    set_int64(usage, idx, F_OUTRATE, -1);
+}
+
+// CLOCK_MONOTONIC_RAW is not slewed by NTP, so short intervals are
+// not stretched or shrunk while the clock is being adjusted.
+#ifdef CLOCK_MONOTONIC_RAW
+#define MONOTONIC_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define MONOTONIC_CLOCK CLOCK_MONOTONIC
+#endif
+
+int64_t monotonic_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(MONOTONIC_CLOCK, &ts))
+    PANIC("Failed to read monotonic clock");
+  return ts.tv_sec * NANOSECS + ts.tv_nsec;
+}
+
 // struct rusage accessors
 
 int64_t rmaxrss(struct rusage *ru) {
@@ -171,6 +281,26 @@ int64_t rmajflt(struct rusage *ru) {
   return ru->ru_majflt;
 }
 
+// See clock_precision.c for an interactive version of this
+int64_t rusage_resolution_us(void) {
+  static int64_t resolution = -1;
+  if (resolution > 0) return resolution;
+  struct rusage ru;
+  int64_t first, next, last;
+  getrusage(RUSAGE_SELF, &ru);
+  first = rusertime(&ru);
+  do {
+    getrusage(RUSAGE_SELF, &ru);
+    next = rusertime(&ru);
+  } while (next == first);
+  do {
+    getrusage(RUSAGE_SELF, &ru);
+    last = rusertime(&ru);
+  } while (last == next);
+  resolution = last - next;
+  return resolution;
+}
+
 #define MAKE_COMPARATOR(name, fieldcode)				\
   int name(const void *idx_ptr1,					\
 	   const void *idx_ptr2,					\
@@ -193,6 +323,33 @@ MAKE_COMPARATOR(compare_vcsw, F_VCSW)
 MAKE_COMPARATOR(compare_icsw, F_ICSW)
 MAKE_COMPARATOR(compare_tcsw, F_TCSW)
 MAKE_COMPARATOR(compare_wall, F_WALL)
+MAKE_COMPARATOR(compare_wallns, F_WALLNS)
+MAKE_COMPARATOR(compare_cycles, F_CYCLES)
+MAKE_COMPARATOR(compare_instructions, F_INSTR)
+MAKE_COMPARATOR(compare_ipc, F_IPC)
+MAKE_COMPARATOR(compare_cacherefs, F_CACHEREFS)
+MAKE_COMPARATOR(compare_cachemisses, F_CACHEMISS)
+MAKE_COMPARATOR(compare_branchmisses, F_BRANCHMISS)
+MAKE_COMPARATOR(compare_migrations, F_MIGRATIONS)
+MAKE_COMPARATOR(compare_taskclock, F_TASKCLOCK)
+MAKE_COMPARATOR(compare_readbytes, F_READBYTES)
+MAKE_COMPARATOR(compare_writebytes, F_WRITEBYTES)
+MAKE_COMPARATOR(compare_syscr, F_SYSCR)
+MAKE_COMPARATOR(compare_syscw, F_SYSCW)
+MAKE_COMPARATOR(compare_blkio, F_BLKIO)
+MAKE_COMPARATOR(compare_offcpu, F_OFFCPU)
+MAKE_COMPARATOR(compare_oncpu, F_ONCPU)
+MAKE_COMPARATOR(compare_runq, F_RUNQ)
+MAKE_COMPARATOR(compare_slices, F_SLICES)
+MAKE_COMPARATOR(compare_ttfb, F_TTFB)
+MAKE_COMPARATOR(compare_outbytes, F_OUTBYTES)
+MAKE_COMPARATOR(compare_outrate, F_OUTRATE)
+
+int compare_int64(const void *a, const void *b) {
+  int64_t x = *((const int64_t *) a);
+  int64_t y = *((const int64_t *) b);
+  return (x > y) - (x < y);
+}
 
 // The argument order for comparators passed to qsort_r differs
 // between linux and macOS.  This is C, where we can't have nice
@@ -610,6 +767,18 @@ Units count_units[] = {
   {"G",  1000*1000*1000, -1,              "%7.2f %-2s", "%7.2f"},
 };
 
+Units nanotime_units[] = {
+  {"ns", 1,               1000,           "%7.0f %-2s", "%7.0f"},
+  {"μs", 1000,            1000*1000,      "%7.2f %-2s", "%7.2f"},
+  {"ms", 1000*1000,       1000*1000*1000, "%7.2f %-2s", "%7.2f"},
+  {"s",  1000*1000*1000, -1,              "%7.2f %-2s", "%7.2f"},
+};
+
+// Ratios like IPC are stored as integers, scaled up by 1000
+Units ratio_units[] = {
+  {"",   1000,           -1,              "%7.2f %-2s", "%7.2f"},
+};
+
 Units *select_units(int64_t maxvalue, Units *options) {
   if (!options) PANIC_NULL();
   int i = 0;
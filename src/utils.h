@@ -14,6 +14,7 @@
 // How many millisecs or microsecs in one second
 #define MILLISECS 1000
 #define MICROSECS 1000000
+#define NANOSECS 1000000000
 
 // 1024 * 1024 = How many things are in a mega-thing
 #define MEGA 1048576
@@ -42,9 +43,72 @@ int64_t max64(int64_t a, int64_t b);
   X(F_VCSW,     "Voluntary Context Switches"   ) \
   X(F_ICSW,     "Involuntary Context Switches" ) \
   X(F_WALL,     "Wall clock (us)"              ) \
+  /* -------- Optional: may be empty ------- */ \
+  X(F_CYCLES,     "Cycles"                     ) \
+  X(F_INSTR,      "Instructions"               ) \
+  X(F_CACHEREFS,  "Cache references"           ) \
+  X(F_CACHEMISS,  "Cache misses"               ) \
+  X(F_BRANCHMISS, "Branch misses"              ) \
+  X(F_MIGRATIONS, "CPU migrations"             ) \
+  X(F_TASKCLOCK,  "Task clock (ns)"            ) \
+  X(F_WALLNS,     "Wall clock (ns)"            ) \
+  X(F_CORE,       "Core"                       ) \
+  X(F_STOP,       "Stop reason"                ) \
+  X(F_STATUS,     "Status"                     ) \
+  X(F_FORKED,     "Fork server"                ) \
+  X(F_REPEAT,     "Executions"                 ) \
+  X(F_READBYTES,  "Read bytes"                 ) \
+  X(F_WRITEBYTES, "Write bytes"                ) \
+  X(F_SYSCR,      "Read syscalls"              ) \
+  X(F_SYSCW,      "Write syscalls"             ) \
+  X(F_BLKIO,      "Block I/O delay (us)"       ) \
+  X(F_ONCPU,      "On-CPU time (ns)"           ) \
+  X(F_RUNQ,       "Run queue delay (ns)"       ) \
+  X(F_SLICES,     "Timeslices"                 ) \
+  X(F_LASTCPU,    "Last CPU"                   ) \
+  X(F_CORETYPE,   "Core type"                  ) \
+  X(F_STARTTYPE,  "Start core type"            ) \
+  X(F_FREQSTART,  "Start frequency (kHz)"      ) \
+  X(F_FREQEND,    "End frequency (kHz)"        ) \
+  X(F_TEMPSTART,  "Start temperature (mC)"     ) \
+  X(F_TEMPEND,    "End temperature (mC)"       ) \
+  X(F_QUIETWAIT,  "Quiet wait (us)"            ) \
+  X(F_BUSY,       "System busy at launch (%)"  ) \
+  X(F_LOADAVG,    "Load average (x100)"        ) \
+  X(F_INTERFERENCE, "Interference (%)"         ) \
+  X(F_CACHE,      "Page cache mode"            ) \
+  X(F_CACHED,     "Cached at launch (%)"       ) \
+  X(F_TTFB,       "First byte (ns)"            ) \
+  X(F_OUTBYTES,   "Output bytes"               ) \
+  X(F_DRAINCPU,   "Drain CPU time (ns)"        ) \
+  X(F_PIPEFULL,   "Pipe full (ct)"             ) \
+  X(F_SCHEDULED,  "Scheduled start (ns)"       ) \
+  X(F_LAG,        "Start lag (ns)"             ) \
+  X(F_INFLIGHT,   "In flight at launch"        ) \
+  X(F_LATENCY,    "Latency (ns)"               ) \
+  X(F_CONCURRENCY, "Concurrency"               ) \
+  X(F_CGCPU,      "Cgroup CPU time (us)"       ) \
+  X(F_CGMEMPEAK,  "Cgroup memory peak (Bytes)" ) \
+  X(F_CGREAD,     "Cgroup read bytes"          ) \
+  X(F_CGWRITE,    "Cgroup write bytes"         ) \
+  X(F_PSICPU,     "CPU pressure (us)"          ) \
+  X(F_PSIMEM,     "Memory pressure (us)"       ) \
+  X(F_PSIIO,      "I/O pressure (us)"          ) \
+  X(F_CGLEFT,     "Cgroup leftovers (ct)"      ) \
+  X(F_THROTTLED,  "Throttled periods (ct)"     ) \
+  X(F_THROTTLEDUS, "Throttled time (us)"       ) \
+  X(F_MEMHIGH,    "Memory high events (ct)"    ) \
+  X(F_MEMMAX,     "Memory max events (ct)"     ) \
+  X(F_OOMKILL,    "OOM kills (ct)"             ) \
+  X(F_REAPED,     "Descendants reaped (ct)"    ) \
+  X(F_STRAGGLERS, "Stragglers (ct)"            ) \
+  X(F_LASTEXIT,   "Last exit (ns)"             ) \
   /* -------- Computed metrics -------------- */ \
   X(F_TOTAL,    "Total time (us)"              ) \
   X(F_TCSW,     "Total Context Switches"       ) \
+  X(F_IPC,      "Instructions per 1000 cycles" ) \
+  X(F_OFFCPU,   "Off-CPU time (us)"            ) \
+  X(F_OUTRATE,  "Output rate (bytes/s)"        ) \
   /* -------- Sentinel ---------------------- */ \
   X(F_LAST,     "SENTINEL"                     )
 
@@ -53,19 +117,44 @@ typedef enum { XFields(FIRST) } FieldCode;
 #undef FIRST
 extern const char *Header[];
 
+// Values of F_STATUS.  Runs that did not complete are recorded in
+// the raw data, but are left out of the statistics.  A missing
+// status (older raw data files) means the run completed.  A run that
+// completed while other processes were busy (see --interference) is
+// left out too, unless we were asked to include it.
+#define XRunStatus(X)					\
+  X(RUN_COMPLETED, "completed")				\
+  X(RUN_TIMEOUT,   "timed out")				\
+  X(RUN_LIMIT,     "exceeded a resource limit")		\
+  X(RUN_INTERFERED, "interfered")
+
+#define FIRST(a, b) a,
+typedef enum { XRunStatus(FIRST) } RunStatus;
+#undef FIRST
+
+#define COMPLETED(usage, idx)					\
+  ((get_int64((usage), (idx), F_STATUS) <= RUN_COMPLETED)		\
+   || (option.include_interfered					\
+       && (get_int64((usage), (idx), F_STATUS) == RUN_INTERFERED)))
+
 // IMPORTANT: Check/alter these if the table structure changes
 // IMPORTANT: Ranges include the start value, not the end value
 
 // For CSV writing, we need to know where the measurements are,
 // because we write those but not the computed metrics.
+// Optional measurements may be missing from older raw data files, or
+// empty when not available on the system that collected them.  We
+// store -1 in that case.
 // For indexing into Usage arrays easily, we need to know which fields
 // have int64_t values.
 #define F_STARTDATA F_CODE
 #define F_ENDDATA F_TOTAL
+#define F_STARTOPTIONAL F_CYCLES
 #define F_STARTNUM F_CODE
 #define F_ENDNUM F_LAST
 
 #define FSTRING(f) (((f) >= 0) || ((f) < F_STARTDATA))
+#define FOPTIONAL(f) (((f) >= F_STARTOPTIONAL) && ((f) < F_ENDDATA))
 #define FRAWDATA(f) (((f) >= F_STARTDATA) && ((f) < F_ENDDATA))
 #define FNUMERIC(f) (((f) >= F_STARTNUM) && ((f) < F_ENDNUM))
 #define FTONUMERICIDX(f) ((f) - F_STARTNUM)
@@ -97,11 +186,26 @@ int64_t     get_int64(Usage *usage, int idx, FieldCode fc);
 // Setters
 void        set_string(Usage *usage, int idx, FieldCode fc, const char *str);
 void        set_int64(Usage *usage, int idx, FieldCode fc, int64_t val);
-
+// Computed metrics
+void        set_ipc(Usage *usage, int idx);
+void        set_offcpu(Usage *usage, int idx);
+void        set_outrate(Usage *usage, int idx);
+
+// A run may execute the command several times (--repeat), storing
+// totals and the number of executions (F_REPEAT).  Normalizing
+// divides the totals to get per-execution values, and must be done
+// exactly once for each run, after it is written to the raw data
+// file or read from one.
+int64_t     usage_repeats(Usage *usage, int idx);
+void        usage_per_execution(Usage *usage, int start, int end);
 
 Usage *new_usage_array(int capacity);
 void   free_usage_array(Usage *usage);
 int    usage_next(Usage *usage);
+int    usage_copy(Usage *dest, Usage *src, int idx);
+
+// Monotonic clock (not subject to NTP adjustment, where possible)
+int64_t monotonic_ns(void);
 
 int64_t rmaxrss(struct rusage *ru);
 int64_t rusertime(struct rusage *ru);
@@ -111,6 +215,11 @@ int64_t ricsw(struct rusage *ru);
 int64_t rminflt(struct rusage *ru);
 int64_t rmajflt(struct rusage *ru);
 
+// Smallest step (μs) by which the CPU times in a struct rusage advance
+// on this system.  Measured once, by spinning, which takes up to two
+// steps.
+int64_t rusage_resolution_us(void);
+
 typedef int (Comparator)(const void *, const void *, void *);
 
 #define COMPARATOR(name) Comparator name
@@ -123,6 +232,27 @@ COMPARATOR(compare_vcsw);
 COMPARATOR(compare_icsw);
 COMPARATOR(compare_tcsw);
 COMPARATOR(compare_wall);
+COMPARATOR(compare_wallns);
+COMPARATOR(compare_cycles);
+COMPARATOR(compare_instructions);
+COMPARATOR(compare_ipc);
+COMPARATOR(compare_cacherefs);
+COMPARATOR(compare_cachemisses);
+COMPARATOR(compare_branchmisses);
+COMPARATOR(compare_migrations);
+COMPARATOR(compare_taskclock);
+COMPARATOR(compare_readbytes);
+COMPARATOR(compare_writebytes);
+COMPARATOR(compare_syscr);
+COMPARATOR(compare_syscw);
+COMPARATOR(compare_blkio);
+COMPARATOR(compare_offcpu);
+COMPARATOR(compare_oncpu);
+COMPARATOR(compare_runq);
+COMPARATOR(compare_slices);
+COMPARATOR(compare_ttfb);
+COMPARATOR(compare_outbytes);
+COMPARATOR(compare_outrate);
 
 #if (defined __APPLE__ || defined __MACH__ || defined __DARWIN__ ||	\
      defined __DragonFly__ || (defined __FreeBSD__ && !defined(qsort_r)))
@@ -140,6 +270,9 @@ COMPARATOR(compare_wall);
 #error "MS qsort_r or qsort_s not supported"
 #endif
 
+// For qsort() of int64_t arrays
+int compare_int64(const void *a, const void *b);
+
 // Like the GNU/Linux qsort_r
 void sort(void *base, size_t nel, size_t width, 
 	  int (*compare)(const void *, const void *, void *),
@@ -202,6 +335,8 @@ typedef struct Units {
 extern Units time_units[];
 extern Units space_units[];
 extern Units count_units[];
+extern Units nanotime_units[];
+extern Units ratio_units[];
 
 #define UNITS 1			// show units (e.g. ms, GB)
 #define NOUNITS 0		// do not show units
@@ -13,6 +13,18 @@ function ok {
     fi
 }
 
+# The position of the column named $2 in the raw data file $1 (after
+# any metadata lines), for use with cut -f and awk.  Look columns up
+# by name, because new fields shift the positions of others.
+function col {
+    local n
+    n=$(grep -v '^#' "$1" | head -1 | tr , '\n' | grep -nxF "$2" | cut -d: -f1)
+    if [[ -z "$n" ]]; then
+	printf "No column named '%s' in %s\n" "$2" "$1" >&2
+    fi
+    echo "$n"
+}
+
 function contains {
     for str in "$@"; do
 	if [[ "$output" != *"$str"* ]]; then
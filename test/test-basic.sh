@@ -12,7 +12,8 @@ printf "%s\n\n" '--------------------------------------'
 allpassed=1
 
 function ok {
-    "$@" >/dev/null 2>&1
+    command="$*"
+    output=$("$@" 2>/dev/null)
     local status=$?
     if [[ $status -ne 0 ]]; then
 	printf "Expected success. Failed with code %d: %s\n" $status "$*"
@@ -20,6 +21,24 @@ function ok {
     fi
 }
 
+function contains {
+    for str in "$@"; do
+	if [[ "$output" != *"$str"* ]]; then
+	    printf "Output did not contain '%s': %s\n" "$str" "$command"
+	    allpassed=0
+	fi
+    done
+}
+
+function missing {
+    for str in "$@"; do
+	if [[ "$output" == *"$str"* ]]; then
+	    printf "Output contained '%s': %s\n" "$str" "$command"
+	    allpassed=0
+	fi
+    done
+}
+
 function usage {
     "$@" >/dev/null 2>&1
     local status=$?
@@ -58,6 +77,8 @@ usage   "$prog" -r 1048577
 usage   "$prog" -w 1048577
 usage   "$prog" --no-such-option
 usage   "$prog" -d
+usage   "$prog" --launcher nosuchlauncher ls
+usage   "$prog" --launcher-report=1 ls
 
 # Missing commands
 usage   "$prog" -r 0
@@ -88,6 +109,140 @@ runtime "$prog" /thisprogramshouldnotexist
 runtime "$prog" ./thisprogramshouldnotexist
 runtime "$prog" ./nosuchdirectory/thisprogramshouldnotexist
 
+# Each launcher starts commands and reports failures the same way
+for launcher in fork vfork spawn; do
+    ok      "$prog" --launcher $launcher -r 2 ls
+    ok      "$prog" --launcher $launcher -r 2 -s "/bin/bash -c" "ls -l"
+    ok      "$prog" --launcher $launcher -r 2 /bin/ls
+    ok      "$prog" --launcher $launcher -r 2 -p "ls" ls
+    runtime "$prog" --launcher $launcher thisprogramshouldnotexist
+    runtime "$prog" --launcher $launcher -s foobarbaz 'ls -l'
+done
+ok      "$prog" --launcher-report -r 1 ls
+
+# Parallel runs, one per core
+usage   "$prog" -j 0 ls
+usage   "$prog" --jobs=-1 ls
+ok      "$prog" -j 1 -r 2 ls
+ok      "$prog" -j $(nproc) -r 4 -w 1 ls "ls -l"
+
+usage   "$prog" --min-runs 0 ls
+usage   "$prog" --min-runs 20 --max-runs 10 ls
+usage   "$prog" --target-ci 0 ls
+usage   "$prog" --target-metric foo ls
+usage   "$prog" --max-runs 5 -j 2 ls
+ok      "$prog" --max-runs 5 ls
+ok      "$prog" --min-runs 3 --max-runs 50 --target-ci 50 --target-metric wall ls
+
+usage   "$prog" --race -j 2 ls
+usage   "$prog" --race --max-runs 5 ls
+ok      "$prog" --race -r 3 ls "ls -l"
+ok      "$prog" --race -r 12 -w 1 ls "ls -l" "ls -la"
+
+usage   "$prog" --order foo ls
+usage   "$prog" --seed 1 ls
+usage   "$prog" --seed -1 --order random ls
+usage   "$prog" --order random -j 2 ls
+ok      "$prog" --order interleaved -r 3 -w 1 ls pwd
+ok      "$prog" --order random --seed 42 -r 3 ls pwd
+ok      "$prog" --order random --race -r 6 ls pwd
+
+usage   "$prog" --metadata ls
+ok      "$prog" --metadata -o /dev/null -r 2 ls
+
+usage   "$prog" --timeout 0 ls
+usage   "$prog" --cpu-limit 0 ls
+usage   "$prog" --mem-limit -5 ls
+usage   "$prog" --files-limit 0 ls
+usage   "$prog" --launcher spawn --cpu-limit 5 ls
+ok      "$prog" --timeout 10 --cpu-limit 10 --mem-limit 4096 --files-limit 64 -r 2 ls
+# A crash is not mistaken for exceeding a limit
+crash=$(mktemp)
+printf '#!/bin/sh\nkill -SEGV $$\n' > "$crash"
+chmod +x "$crash"
+runtime "$prog" --cpu-limit 10 -r 1 "$crash"
+rm -f "$crash"
+
+ok      "$prog" --calibrate -r 2 ls
+contains "Harness overhead" "Net of harness overhead"
+ok      "$prog" --calibrate -N -r 2 ls
+missing "Net of harness overhead"
+
+usage   "$prog" --fork-server -s bash ls
+usage   "$prog" --fork-server -j 2 ls
+usage   "$prog" --fork-server --timeout 5 ls
+ok      "$prog" --fork-server -r 3 -w 1 ls pwd
+contains "Runs were forked from a fork server"
+
+usage   "$prog" --repeat 0 ls
+usage   "$prog" --repeat often ls
+ok      "$prog" --repeat 5 -r 2 ls
+contains "Each run executed the command 5 times"
+ok      "$prog" --repeat auto -r 2 --order interleaved ls pwd
+contains "Each run executed the command"
+
+usage   "$prog" --cpus 3-1 ls
+usage   "$prog" --cpus x ls
+usage   "$prog" --harness-cpu -1 ls
+usage   "$prog" --nice 20 ls
+usage   "$prog" --sched rr ls
+usage   "$prog" --launcher spawn --nice 5 ls
+ok      "$prog" --cpus 0 --nice 5 --sched batch --no-smt -r 2 ls
+ok      "$prog" --cpus 0 -j 1 -r 2 ls pwd
+
+usage   "$prog" --quiet 0 ls
+usage   "$prog" --quiet 101 ls
+usage   "$prog" --quiet 50 -j 2 ls
+ok      "$prog" --quiet 100 -r 2 ls
+contains "Waited for a quiet system" "At launch, other processes used"
+usage   "$prog" --interference 0 ls
+usage   "$prog" --interference 5 -j 2 ls
+usage   "$prog" --max-reruns -1 ls
+ok      "$prog" --interference 100 -r 2 ls
+usage   "$prog" --cache lukewarm ls
+usage   "$prog" --cache-file common.sh ls
+usage   "$prog" --cache warm --cache-file no_such_file ls
+usage   "$prog" --cache cold --repeat 2 ls
+usage   "$prog" --cache cold -j 2 ls
+ok      "$prog" --cache cold -r 2 ls
+contains "Page cache was cold before each run" "Page faults per run"
+ok      "$prog" --cache warm --cache-file common.sh -r 2 ls
+contains "Page cache was warm before each run"
+usage   "$prog" --capture-output --show-output ls
+ok      "$prog" --capture-output -r 2 ls
+contains "First byte" "Output bytes" "Draining the output took"
+usage   "$prog" --rate 0 ls
+usage   "$prog" --rate 10 --arrivals bursty ls
+usage   "$prog" --rate 10 --max-inflight 0 ls
+usage   "$prog" --rate 10 -j 2 ls
+usage   "$prog" --rate 10 --repeat 2 ls
+usage   "$prog" --max-inflight 4 ls
+usage   "$prog" --seed 1 --arrivals poisson ls
+ok      "$prog" --rate 100 -r 5 ls
+contains "Open loop: offered" "Latency from scheduled start: p50" "Backlog:"
+ok      "$prog" --rate 100 --arrivals poisson --seed 1 -r 5 ls
+contains "Runs arrive at random"
+usage   "$prog" --sweep 0 ls
+usage   "$prog" --sweep some ls
+usage   "$prog" --sweep auto -j 2 ls
+usage   "$prog" --sweep auto --rate 10 ls
+ok      "$prog" --sweep auto -r 2 ls
+contains "Concurrency sweep of ls" "Throughput" "Speedup"
+usage   "$prog" --cgroup --launcher spawn ls
+usage   "$prog" --cgroup --fork-server ls
+usage   "$prog" --cgroup --rate 10 ls
+usage   "$prog" --cpu-quota 0 ls
+usage   "$prog" --memory-high 0 ls
+usage   "$prog" --memory-max -1 ls
+usage   "$prog" --io-max 1048576 ls
+usage   "$prog" --cpu-quota 0.5 --launcher spawn ls
+usage   "$prog" --wait-descendants -j 2 ls
+usage   "$prog" --wait-descendants --rate 10 ls
+usage   "$prog" --wait-descendants --fork-server ls
+ok      "$prog" --wait-descendants -r 2 ls
+contains "Descendants reaped: 0 per run"
+missing "stragglers"
+
 #
 # -----------------------------------------------------------------------------
 #
@@ -26,6 +26,295 @@ if [[ $lines -ne 2 ]]; then
     allpassed=0
 fi
 
+# Performance counter and I/O accounting columns are present in the
+# header, and are empty when not available.  Either way, the file can be
+# read back in.
+output=$(head -1 "$ofile")
+contains "Cycles" "Instructions" "Cache misses" "CPU migrations" "Task clock (ns)"
+contains "Wall clock (us)" "Wall clock (ns)"
+contains "Read bytes" "Write bytes" "Read syscalls" "Write syscalls" "Block I/O delay (us)"
+contains "On-CPU time (ns)" "Run queue delay (ns)" "Timeslices"
+contains "Last CPU" "Core type" "Start core type" "Start frequency (kHz)" "End temperature (mC)"
+contains "Quiet wait (us)" "System busy at launch (%)" "Load average (x100)"
+ok "$prog" -o "$ofile" -r 3 ls
+ok ../bestreport "$ofile"
+contains "Command 1: ls" "Total CPU time"
+
+# With an adaptive run count, the reason for stopping is recorded in
+# the raw data and reported again by bestreport
+ok "$prog" -o "$ofile" --min-runs 2 --max-runs 3 --target-ci 0.0001 ls
+output=$(head -1 "$ofile")
+contains "Stop reason"
+ok ../bestreport "$ofile"
+contains "Stopped after 3 runs: reached maximum number of runs"
+
+# In random order, the runs of different commands are mixed in the
+# raw data, which records the seed (with --metadata).  The same seed
+# gives the same order, and bestreport groups the runs by command.
+ok "$prog" -o "$ofile" --metadata --order random --seed 7 -r 4 ls pwd true
+output=$(head -2 "$ofile")
+contains "# order=random" "# seed=7"
+order1=$(grep -v "^#" "$ofile" | cut -d, -f$(col "$ofile" "Batch"))
+ok "$prog" -o "$ofile" --order random --seed 7 -r 4 ls pwd true
+order2=$(cut -d, -f$(col "$ofile" "Batch") "$ofile")
+if [[ "$order1" != "$order2" ]]; then
+    printf "Expected the same seed to give the same order\n"
+    allpassed=0
+fi
+ok ../bestreport "$ofile"
+contains "Command 1: ls" "Command 2: pwd" "Command 3: true"
+
+# Runs that time out are recorded, with a status, and counted
+# separately from the runs that completed
+cmdfile=$(mktemp)
+echo "sleep 1" > "$cmdfile"
+ok "$prog" -o "$ofile" --timeout 0.05 -r 3 -f "$cmdfile"
+rm -f "$cmdfile"
+output=$(head -1 "$ofile")
+contains "Status"
+output=$(cut -d, -f$(col "$ofile" "Status") "$ofile" | sort -u)
+contains "1"
+ok ../bestreport "$ofile"
+contains "3 runs timed out" "No runs completed, so there are no statistics"
+missing "Total CPU time"
+
+# The timeout is for the whole run, however many times it executes
+# the command
+cmdfile=$(mktemp)
+echo "sleep 0.1" > "$cmdfile"
+ok "$prog" -o "$ofile" --timeout 0.25 --repeat 3 -r 2 -f "$cmdfile"
+rm -f "$cmdfile"
+output=$(cut -d, -f$(col "$ofile" "Status") "$ofile" | sort -u)
+contains "1"
+missing "0"
+
+# So are runs killed for exceeding their CPU time limit
+sfile=$(mktemp)
+printf '#!/bin/sh\nwhile :; do :; done\n' > "$sfile"
+chmod +x "$sfile"
+ok "$prog" -o "$ofile" --cpu-limit 1 -r 1 "$sfile"
+output=$(cut -d, -f$(col "$ofile" "Status") "$ofile" | sort -u)
+contains "2"
+ok ../bestreport "$ofile"
+contains "1 runs exceeded a resource limit"
+rm -f "$sfile"
+
+# With --metadata, calibration records the harness overhead in the
+# raw data, so that bestreport can report results net of it
+ok "$prog" -o "$ofile" --metadata --calibrate -r 3 ls
+contains "Harness overhead" "Without shell" "Net of harness overhead"
+output=$(head -1 "$ofile")
+contains "# overhead=100,"
+ok ../bestreport "$ofile"
+contains "Command 1: ls" "Net of harness overhead"
+output=$("$prog" -o "$ofile" --metadata --calibrate -s "/bin/bash -c" -r 3 ls)
+contains "With shell"
+output=$(head -2 "$ofile")
+contains "# overhead=" "# shell-overhead="
+
+# Otherwise, the raw data is plain CSV, starting with the header
+ok "$prog" -o "$ofile" --calibrate -r 3 ls
+output=$(head -1 "$ofile")
+contains "Command,Shell,Name"
+ok ../bestreport "$ofile"
+missing "Net of harness overhead"
+
+# Runs done by a fork server are flagged in the raw data
+ok "$prog" -o "$ofile" --fork-server -r 3 ls
+output=$(head -1 "$ofile")
+contains "Fork server"
+output=$(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Fork server") | sort -u)
+contains "1"
+ok ../bestreport "$ofile"
+contains "Runs were forked from a fork server"
+
+# With --repeat, the raw data holds totals over the executions of
+# each run, and the number of executions, and bestreport divides
+ok "$prog" -o "$ofile" --repeat 4 -r 3 ls
+output=$(head -1 "$ofile")
+contains "Executions"
+output=$(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Executions") | sort -u)
+contains "4"
+ok ../bestreport "$ofile"
+contains "Each run executed the command 4 times"
+
+# When the kernel keeps scheduler statistics, the tail report shows
+# the run queue delay of the runs in the tail
+ok "$prog" -o "$ofile" -r 20 ls
+if [[ -n $(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Run queue delay (ns)") | sort -u) ]]; then
+    ok ../bestreport -T "$ofile"
+    contains "Run Queue Delay in the Tail" "At or above 95th"
+fi
+
+# The CPU state columns are filled in with --cpu-state when sysfs has
+# them, and the report flags runs where the frequency dropped, that
+# ended on different types of cores, or that moved between them
+ok "$prog" -o "$ofile" --cpu-state -r 6 ls
+contains "Command 1: ls"
+sfile=$(mktemp)
+awk -F, -v type=$(col "$ofile" "Core type") -v type0=$(col "$ofile" "Start core type") \
+    -v f0=$(col "$ofile" "Start frequency (kHz)") -v f1=$(col "$ofile" "End frequency (kHz)") \
+    -v t0=$(col "$ofile" "Start temperature (mC)") -v t1=$(col "$ofile" "End temperature (mC)") \
+    'BEGIN { OFS="," } NR == 1 { print; next }
+     { n++; $type = n % 2 + 1; $type0 = (n < 6) ? $type : 3 - $type;
+       $f0 = 3000000; $f1 = (n < 3) ? 2000000 : 3000000;
+       $t0 = 45000; $t1 = 52500; print }' "$ofile" > "$sfile"
+ok ../bestreport "$sfile"
+contains "Frequency dropped by 10% or more during 2 of 6 runs" "Temperature 45.0 to 52.5"
+contains "3 runs ended on performance cores" "3 on efficiency cores"
+contains "1 of 6 runs moved between performance and efficiency cores"
+rm -f "$sfile"
+
+# Runs flagged for interference stay in the raw data, but are left out
+# of the statistics unless asked for
+ok "$prog" -o "$ofile" --interference 100 -r 6 ls
+output=$(head -1 "$ofile")
+contains "Interference (%)"
+sfile=$(mktemp)
+awk -F, -v status=$(col "$ofile" "Status") -v pct=$(col "$ofile" "Interference (%)") \
+    'BEGIN { OFS="," } NR == 1 { print; next }
+     { n++; if (n <= 2) { $status = 3; $pct = 40 }; print }' "$ofile" > "$sfile"
+ok ../bestreport "$sfile"
+contains "2 runs were flagged for interference" "not included above"
+ok ../bestreport --include-interfered "$sfile"
+contains "2 runs were flagged for interference" "(included above)"
+rm -f "$sfile"
+
+# With --cache, each run records the cache mode and how much of the
+# command's files were cached at launch
+ok "$prog" -o "$ofile" --cache warm -r 3 ls
+output=$(head -1 "$ofile")
+contains "Page cache mode" "Cached at launch (%)"
+ok ../bestreport "$ofile"
+contains "Page cache was warm before each run"
+
+# With --capture-output, each run records when its output started and
+# how much there was
+ok "$prog" -o "$ofile" --capture-output -r 3 pwd
+output=$(head -1 "$ofile")
+contains "First byte (ns)" "Output bytes" "Drain CPU time (ns)" "Pipe full (ct)"
+output=$(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Output bytes") | sort -u)
+contains "$(( ${#PWD} + 1 ))"
+rm -f "$ofile"
+
+# With --rate, each run records when it was scheduled to start, and
+# its latency from then, which includes its wall clock time
+ok "$prog" -o "$ofile" --rate 200 --max-inflight 2 -r 5 ls
+output=$(head -1 "$ofile")
+contains "Scheduled start (ns)" "Start lag (ns)" "In flight at launch" "Latency (ns)"
+output=$(tail -n +2 "$ofile" | awk -F, -v lat=$(col "$ofile" "Latency (ns)") -v wall=$(col "$ofile" "Wall clock (ns)") \
+		 '$lat < $wall { print "short latency" }')
+missing "short latency"
+output=$(tail -n +2 "$ofile" | awk -F, -v inflight=$(col "$ofile" "In flight at launch") \
+		 '$inflight > 1 { print "too many in flight" }')
+missing "too many in flight"
+ok ../bestreport -M "$ofile"
+contains "Open loop: offered" "Backlog:"
+rm -f "$ofile"
+
+# A concurrency sweep records the concurrency of each run.  Here, we
+# add levels of 2 (which scales perfectly) and 4 (where each run takes
+# four times as long), so the knee is at 2.
+ok "$prog" -o "$ofile" --sweep 1 -r 3 ls
+output=$(head -1 "$ofile")
+contains "Concurrency"
+sfile=$(mktemp)
+(cat "$ofile"
+ for c in 2 4; do
+     tail -n +2 "$ofile" | \
+	 awk -F, -v OFS=, -v c=$c -v conc=$(col "$ofile" "Concurrency") \
+	     -v batch=$(col "$ofile" "Batch") -v wall=$(col "$ofile" "Wall clock (ns)") \
+	     '{ $conc=c; $batch=$batch+c; if (c==4) $wall=$wall*4;
+		for (k=0; k<c; k++) print }'
+ done) > "$sfile"
+ok ../bestreport -M "$sfile"
+contains "Concurrency sweep of ls" "stops scaling beyond 2 runs at once" "◀ knee"
+rm -f "$ofile" "$sfile"
+
+# With --cgroup (when this system lets us create cgroups), a process
+# left running in the background is accounted for, then killed
+if "$prog" --cgroup -r 1 true >/dev/null 2>&1; then
+    sfile=$(mktemp)
+    printf '#!/bin/sh\nsleep 5 &\n' > "$sfile"
+    chmod +x "$sfile"
+    ok "$prog" -o "$ofile" --cgroup -r 2 "$sfile"
+    contains "Cgroup CPU time" "runs left processes running"
+    output=$(head -1 "$ofile")
+    contains "Cgroup CPU time (us)" "CPU pressure (us)" "Cgroup leftovers (ct)"
+    output=$(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Cgroup leftovers (ct)") | sort -u)
+    contains "1"
+    rm -f "$ofile" "$sfile"
+fi
+
+# Under cgroup limits, each run records how often it was throttled.
+# Here, we fill those columns in, since the controllers that set the
+# limits may not be available to us.
+ok "$prog" -o "$ofile" -r 4 ls
+output=$(head -1 "$ofile")
+contains "Throttled periods (ct)" "Throttled time (us)" "Memory high events (ct)" "OOM kills (ct)"
+sfile=$(mktemp)
+(head -1 "$ofile"
+ tail -n +2 "$ofile" | \
+     awk -F, -v OFS=, -v cg=$(col "$ofile" "Cgroup CPU time (us)") \
+	 -v user=$(col "$ofile" "User time (us)") -v sys=$(col "$ofile" "System time (us)") \
+	 -v left=$(col "$ofile" "Cgroup leftovers (ct)") \
+	 -v periods=$(col "$ofile" "Throttled periods (ct)") \
+	 -v throttled=$(col "$ofile" "Throttled time (us)") \
+	 -v high=$(col "$ofile" "Memory high events (ct)") \
+	 -v max=$(col "$ofile" "Memory max events (ct)") -v oom=$(col "$ofile" "OOM kills (ct)") \
+	 '{ $cg=$user+$sys; $left=0; $periods=3; $throttled=25000; $high=1; $max=0; $oom=0;
+	    print }') > "$sfile"
+ok ../bestreport -M "$sfile"
+contains "CPU quota throttled 4 of 4 runs: 3 periods" "4 runs went over memory.high, 0 reached memory.max"
+rm -f "$ofile" "$sfile"
+
+# With --wait-descendants, a process left running in the background
+# is waited for, and the time of its exit is recorded
+sfile=$(mktemp)
+printf '#!/bin/sh\nsleep 0.1 &\n' > "$sfile"
+chmod +x "$sfile"
+ok "$prog" -o "$ofile" --wait-descendants -r 2 "$sfile"
+contains "Descendants reaped: 1 per run" "2 of 2 runs left stragglers"
+output=$(head -1 "$ofile")
+contains "Descendants reaped (ct)" "Stragglers (ct)" "Last exit (ns)"
+output=$(tail -n +2 "$ofile" | awk -F, -v stragglers=$(col "$ofile" "Stragglers (ct)") \
+		 -v last=$(col "$ofile" "Last exit (ns)") \
+		 '$stragglers != 1 || $last < 100000000 { print "not waited for" }')
+missing "not waited for"
+
+# An orphan that exits before the command does is reaped, but is not
+# a straggler, and does not move the last exit past the command's
+printf '#!/bin/sh\nsh -c "sleep 0.01 & exit"\nsleep 0.1\n' > "$sfile"
+ok "$prog" -o "$ofile" --wait-descendants -r 2 "$sfile"
+missing "stragglers"
+output=$(tail -n +2 "$ofile" | awk -F, -v reaped=$(col "$ofile" "Descendants reaped (ct)") \
+		 -v stragglers=$(col "$ofile" "Stragglers (ct)") -v last=$(col "$ofile" "Last exit (ns)") \
+		 -v wall=$(col "$ofile" "Wall clock (ns)") \
+		 '$reaped != 1 || $stragglers != 0 || $last != $wall { print "wrong exit" }')
+missing "wrong exit"
+
+# With --repeat, a straggler left by one execution of four is still
+# reported (the counts are per run, not divided by the executions)
+mfile=$(mktemp -u)
+printf '#!/bin/sh\n[ -e %s ] && exit\ntouch %s\nsleep 0.1 &\n' "$mfile" "$mfile" > "$sfile"
+ok "$prog" -o "$ofile" --wait-descendants --repeat 4 -w 0 -r 1 "$sfile"
+contains "Descendants reaped: 1 per run" "1 of 1 runs left stragglers"
+rm -f "$mfile"
+
+# What the prepare command leaves running is not the run's
+printf '#!/bin/sh\nsleep 1 &\n' > "$sfile"
+ok "$prog" -o "$ofile" --wait-descendants -p "$sfile" -r 2 ls
+contains "Descendants reaped: 0 per run"
+
+# Stragglers still running at the deadline are killed, and the run
+# is recorded as timed out
+printf '#!/bin/sh\nsleep 5 &\n' > "$sfile"
+ok "$prog" -o "$ofile" --wait-descendants --timeout 0.2 -r 2 "$sfile"
+contains "2 runs timed out"
+output=$(tail -n +2 "$ofile" | cut -d, -f$(col "$ofile" "Status") | sort -u)
+contains "1"
+rm -f "$ofile" "$sfile"
+
 #
 # -----------------------------------------------------------------------------
 #